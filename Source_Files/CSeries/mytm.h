@@ -51,6 +51,8 @@ extern void myTMCleanup(bool waitForFinishers);
 // ZZZ: Use these for mutually exclusive operation with any emulated TMTasks
 extern bool take_mytm_mutex();
 extern bool release_mytm_mutex();
+// Returns false at once, rather than waiting, if someone else has the mutex
+extern bool try_take_mytm_mutex();
 
 // ghs: exception-safe version of above
 class MyTMMutexTaker
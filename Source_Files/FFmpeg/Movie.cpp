@@ -45,31 +45,243 @@
 #include "interface.h"
 #include "screen.h"
 #include "preferences.h"
+#include "map.h"
+
+#include <ctype.h>
 
 #ifdef __WIN32__
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #endif
 
+static bool is_wav_path(const std::string& path)
+{
+    static const char extension[] = ".wav";
+    const size_t length = sizeof(extension) - 1;
+    if (path.size() <= length)
+        return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (tolower(path[path.size() - length + i]) != extension[i])
+            return false;
+    }
+    return true;
+}
+
+static int openal_bytes_per_sample(ALCint format)
+{
+    switch (format)
+    {
+        case ALC_FLOAT_SOFT:
+        case ALC_INT_SOFT:
+            return 4;
+        case ALC_SHORT_SOFT:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+// canonical 44-byte header; written with a zero length first and again
+// with the real one when the export finishes
+static void write_wav_header(FILE *file, int rate, int channels, ALCint format, uint32 data_bytes)
+{
+    const int bytes_per_sample = openal_bytes_per_sample(format);
+    uint8 header[44];
+    uint8 *p = header;
+    auto put_tag = [&p](const char *tag) { memcpy(p, tag, 4); p += 4; };
+    auto put = [&p](uint32 value, int bytes) { for (int i = 0; i < bytes; i++) *p++ = (value >> (8 * i)) & 0xff; };
+
+    put_tag("RIFF"); put(36 + data_bytes, 4);
+    put_tag("WAVE");
+    put_tag("fmt "); put(16, 4);
+    put(format == ALC_FLOAT_SOFT ? 3 : 1, 2); // IEEE float or PCM
+    put(channels, 2);
+    put(rate, 4);
+    put(rate * channels * bytes_per_sample, 4);
+    put(channels * bytes_per_sample, 2);
+    put(8 * bytes_per_sample, 2);
+    put_tag("data"); put(data_bytes, 4);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, sizeof(header), 1, file);
+    fseek(file, 0, SEEK_END);
+}
+
+void Movie::ThrowUserError(std::string error_msg)
+{
+    StopRecording();
+    std::string full_msg = "Your movie could not be exported. (";
+    full_msg += error_msg;
+    full_msg += ".)";
+    logError(full_msg.c_str());
+    alert_user(full_msg.c_str());
+}
+
+bool Movie::SetupAudioExport()
+{
+    auto manager = OpenALManager::Get();
+    if (!manager)
+        return false;
+
+    wav_file = fopen(moviefile.c_str(), "wb");
+    if (!wav_file) { ThrowUserError("Could not create " + moviefile); return false; }
+
+    wav_sample_frame_size = manager->GetChannelCount() * openal_bytes_per_sample(manager->GetRenderingFormat());
+    wav_sample_frames = 0;
+    wav_blocks = 0;
+    audio_stats = {};
+    write_wav_header(wav_file, manager->GetFrequency(), manager->GetChannelCount(), manager->GetRenderingFormat(), 0);
+
+    manager->SetProfiling(true);
+    return true;
+}
+
+// Called once per rendered frame; the game advances one tick every
+// fps / TICKS_PER_SECOND frames, so the blocks add up to exactly one tick of
+// samples per tick whatever the frame rate.
+void Movie::ExportAudio()
+{
+    auto manager = OpenALManager::Get();
+    const int rate = manager->GetFrequency();
+    const int fps = std::max(get_fps_target(), static_cast<int16_t>(TICKS_PER_SECOND));
+
+    const uint64_t end = (wav_blocks + 1) * rate / fps;
+    const int length = static_cast<int>(end - wav_sample_frames);
+    wav_block.resize(length * wav_sample_frame_size);
+    if (length > 0)
+    {
+        auto oldVol = manager->GetMasterVolume();
+        manager->SetMasterVolume(SoundManager::From_db(sound_preferences->video_export_volume_db));
+        manager->GetPlayBackAudio(&wav_block.front(), length);
+        manager->SetMasterVolume(oldVol);
+    }
+
+    const auto& profile = manager->GetRenderProfile();
+    const int tick = static_cast<int>(wav_sample_frames * TICKS_PER_SECOND / rate);
+    if (tick != audio_stats.current_tick)
+    {
+        audio_stats.worst_tick_mix_seconds = std::max(audio_stats.worst_tick_mix_seconds, audio_stats.current_tick_mix_seconds);
+        audio_stats.current_tick_mix_seconds = 0;
+        audio_stats.current_tick = tick;
+    }
+    audio_stats.current_tick_mix_seconds += profile.mix_seconds;
+    audio_stats.mix_seconds += profile.mix_seconds;
+    audio_stats.decode_seconds += profile.decode_seconds;
+    audio_stats.source_samples += profile.active_sources;
+    audio_stats.peak_sources = std::max(audio_stats.peak_sources, profile.active_sources);
+
+#if SDL_BYTEORDER == SDL_BIG_ENDIAN
+    // WAV is little endian
+    const int bytes_per_sample = openal_bytes_per_sample(manager->GetRenderingFormat());
+    for (size_t i = 0; bytes_per_sample > 1 && i < wav_block.size(); i += bytes_per_sample)
+        std::reverse(wav_block.begin() + i, wav_block.begin() + i + bytes_per_sample);
+#endif
+    fwrite(wav_block.data(), 1, wav_block.size(), wav_file);
+
+    wav_sample_frames = end;
+    wav_blocks++;
+}
+
+void Movie::FinishAudioExport()
+{
+    if (!wav_file)
+        return;
+
+    auto manager = OpenALManager::Get();
+    if (manager)
+    {
+        manager->SetProfiling(false);
+        write_wav_header(wav_file, manager->GetFrequency(), manager->GetChannelCount(), manager->GetRenderingFormat(), wav_sample_frames * wav_sample_frame_size);
+    }
+    fclose(wav_file);
+    wav_file = NULL;
+
+    const int ticks = manager ? static_cast<int>(wav_sample_frames * TICKS_PER_SECOND / manager->GetFrequency()) : 0;
+    if (ticks > 0 && wav_blocks > 0)
+    {
+        audio_stats.worst_tick_mix_seconds = std::max(audio_stats.worst_tick_mix_seconds, audio_stats.current_tick_mix_seconds);
+
+        char report[256];
+        snprintf(report, sizeof(report), "Exported %d ticks of audio: mixing %.3f ms/tick (worst %.3f ms), decoding %.3f ms/tick, %.1f active sources (peak %d)",
+                 ticks,
+                 1000 * audio_stats.mix_seconds / ticks,
+                 1000 * audio_stats.worst_tick_mix_seconds,
+                 1000 * audio_stats.decode_seconds / ticks,
+                 static_cast<double>(audio_stats.source_samples) / wav_blocks,
+                 audio_stats.peak_sources);
+        logNote(report);
+        printf("%s\n", report);
+    }
+}
+
 #ifndef HAVE_FFMPEG
 
 struct libav_vars {
     bool inited;
 };
 
+// Without libav only the audio can be exported
 void Movie::PromptForRecording() {}
-void Movie::StartRecording(std::string path) {}
-bool Movie::IsRecording() { return false; }
-void Movie::StopRecording() {}
-void Movie::AddFrame(FrameType ftype) {}
+
+void Movie::StartRecording(std::string path)
+{
+    if (!OpenALManager::Get() || !is_wav_path(path)) return;
+
+    StopRecording();
+    moviefile = path;
+    audio_only = true;
+    OpenALManager::Get()->Stop();
+    OpenALManager::Get()->ToggleDeviceMode(IsRecording());
+    OpenALManager::Get()->Start();
+}
+
+bool Movie::IsRecording() { return (moviefile.length() > 0); }
+
+void Movie::StopRecording()
+{
+    FinishAudioExport();
+    moviefile = "";
+    if (OpenALManager::Get()) {
+        OpenALManager::Get()->ToggleDeviceMode(false);
+        OpenALManager::Get()->Start();
+    }
+}
+
+void Movie::AddFrame(FrameType ftype)
+{
+    if (!IsRecording())
+        return;
+    if (!wav_file)
+    {
+        if (ftype == FRAME_FADE || !SetupAudioExport())
+            return;
+    }
+    if (ftype == FRAME_FADE && get_keyboard_controller_status())
+        return;
+    ExportAudio();
+}
 
 bool Movie::Setup() { return false; }
 int Movie::Movie_EncodeThread(void *arg) { return 0; }
 void Movie::EncodeThread() {}
-void Movie::EncodeVideo(bool last) {}
-void Movie::EncodeAudio(bool last) {}
-long Movie::GetCurrentAudioTimeStamp() { return 0; }
-Movie::Movie() {}
+void Movie::EncodeVideo(Frame *frame) {}
+void Movie::EncodeAudio(Frame *frame) {}
+long Movie::GetCurrentAudioTimeStamp()
+{
+    return IsRecording() && wav_file ? wav_sample_frames * 1000 / OpenALManager::Get()->GetFrequency() : 0;
+}
+Movie::Movie() :
+  moviefile(""),
+  frames_queued(0),
+  frames_encoded(0),
+  av(NULL),
+  encodeThread(NULL),
+  encodeReady(NULL),
+  fillReady(NULL),
+  audio_only(false),
+  wav_file(NULL)
+{}
 
 #else
 
@@ -157,7 +369,8 @@ int ScaleQuality(int quality, int zeroLevel, int fiftyLevel, int hundredLevel)
 
 Movie::Movie() :
   moviefile(""),
-  temp_surface(NULL),
+  frames_queued(0),
+  frames_encoded(0),
   av(NULL),
   encodeThread(NULL),
   encodeReady(NULL),
@@ -165,7 +378,8 @@ Movie::Movie() :
   frameBufferObject(nullptr),
 #endif
   fillReady(NULL),
-  stillEncoding(0)
+  audio_only(false),
+  wav_file(NULL)
 {
     av = new libav_vars_t;
     memset(av, 0, sizeof(libav_vars_t));
@@ -185,6 +399,7 @@ void Movie::StartRecording(std::string path)
 
 	StopRecording(); 
 	moviefile = path;
+	audio_only = is_wav_path(path);
     OpenALManager::Get()->Stop();
     OpenALManager::Get()->ToggleDeviceMode(IsRecording());
     OpenALManager::Get()->Start();
@@ -215,12 +430,6 @@ bool Movie::Setup()
 
     const auto fps = std::max(get_fps_target(), static_cast<int16_t>(30));
 
-    temp_surface = SDL_CreateRGBSurface(SDL_SWSURFACE, view_rect.w, view_rect.h, 32,
-        0x00ff0000, 0x0000ff00, 0x000000ff,
-        0);
-
-    if (temp_surface == NULL) { ThrowUserError("Could not create SDL surface"); return false; }
-
     av->ffmpeg_file = SDL_ffmpegCreate(moviefile.c_str());
 
     if (!av->ffmpeg_file) { ThrowUserError("Could not create ffmpeg file: " + std::string(SDL_ffmpegGetError())); return false; }
@@ -282,16 +491,30 @@ bool Movie::Setup()
     av->audio_fifo = av_fifo_alloc(262144);
     if (!av->audio_fifo) { ThrowUserError("Could not allocate audio fifo"); return false; }
 
-    // set up our threads and intermediate storage
-    videobuf.resize(view_rect.w * view_rect.h * 4 + 10000);
-    audiobuf.resize(2 * in_bps * OpenALManager::Get()->GetFrequency() / fps);
-
     // TODO: fixme!
     if (OpenALManager::Get()->GetFrequency() % fps != 0) { ThrowUserError("Audio buffer size is non-integer; try lowering FPS target"); return false; }
 
+    // set up our threads and intermediate storage
+    frames.resize(std::max<int>(graphics_preferences->movie_export_frame_queue, 1));
+    for (auto& frame : frames)
+    {
+        frame.surface = SDL_CreateRGBSurface(SDL_SWSURFACE, view_rect.w, view_rect.h, 32,
+            0x00ff0000, 0x0000ff00, 0x000000ff,
+            0);
+        if (frame.surface == NULL) { ThrowUserError("Could not create SDL surface"); return false; }
+
+        frame.needs_flip = false;
+        frame.audio.resize(2 * in_bps * OpenALManager::Get()->GetFrequency() / fps);
+#ifdef HAVE_OPENGL
+        if (MainScreenIsOpenGL())
+            frame.readback.resize(view_rect.w * view_rect.h * 4);
+#endif
+    }
+    frames_queued = 0;
+    frames_encoded = 0;
+
 	encodeReady = SDL_CreateSemaphore(0);
-	fillReady = SDL_CreateSemaphore(1);
-	stillEncoding = true;
+	fillReady = SDL_CreateSemaphore(frames.size());
     if (!encodeReady || !fillReady) { ThrowUserError("Could not create movie thread semaphores"); return false; }
 
 	encodeThread = SDL_CreateThread(Movie_EncodeThread, "MovieSetup_encodeThread", this);
@@ -307,18 +530,10 @@ bool Movie::Setup()
 	return av->inited = true;
 }
 
-void Movie::ThrowUserError(std::string error_msg)
-{
-    StopRecording();
-    std::string full_msg = "Your movie could not be exported. (";
-    full_msg += error_msg;
-    full_msg += ".)";
-    logError(full_msg.c_str());
-    alert_user(full_msg.c_str());
-}
-
 long Movie::GetCurrentAudioTimeStamp()
 {
+    if (audio_only)
+        return IsRecording() && wav_file ? wav_sample_frames * 1000 / OpenALManager::Get()->GetFrequency() : 0;
     return IsRecording() && av->inited && av->ffmpeg_file->audioStream ? av->ffmpeg_file->audioStream->lastTimeStamp : 0;
 }
 
@@ -328,15 +543,24 @@ int Movie::Movie_EncodeThread(void *arg)
 	return 0;
 }
 
-void Movie::EncodeVideo(bool last)
+void Movie::EncodeVideo(Frame *frame)
 {
-    SDL_ffmpegAddVideoFrame(av->ffmpeg_file, temp_surface, av->video_counter++, last);
+    if (frame && frame->needs_flip)
+    {
+        // OpenGL reads back bottom row first
+        const int row_bytes = view_rect.w * 4;
+        for (int y = 0; y < view_rect.h; y++)
+            memcpy((uint8 *)frame->surface->pixels + frame->surface->pitch * y, &frame->readback.front() + row_bytes * (view_rect.h - y - 1), row_bytes);
+    }
+    SDL_ffmpegAddVideoFrame(av->ffmpeg_file, frame ? frame->surface : NULL, av->video_counter++, !frame);
 }
 
-void Movie::EncodeAudio(bool last)
+void Movie::EncodeAudio(Frame *frame)
 {
-    av_fifo_generic_write(av->audio_fifo, &audiobuf[0], audiobuf.size(), NULL);
+    if (frame)
+        av_fifo_generic_write(av->audio_fifo, &frame->audio[0], frame->audio.size(), NULL);
     auto acodec = av->ffmpeg_file->audioStream->_ctx;
+    const bool last = !frame;
     
     // bps: bytes per sample
     int channels = acodec->channels;
@@ -358,16 +582,17 @@ void Movie::EncodeThread()
 	while (true)
 	{
 		SDL_SemWait(encodeReady);
-		if (!stillEncoding)
+		if (frames_encoded == frames_queued.load(std::memory_order_acquire))
 		{
-			// signal to quit
-			SDL_SemPost(fillReady);
+			// nothing queued, so this is the signal to quit
 			return;
 		}
         
         // add video and audio
-        EncodeVideo(false);
-        EncodeAudio(false);
+        Frame& frame = frames[frames_encoded % frames.size()];
+        EncodeVideo(&frame);
+        EncodeAudio(&frame);
+        frames_encoded++;
 		
 		SDL_SemPost(fillReady);
 	}
@@ -377,23 +602,31 @@ void Movie::AddFrame(FrameType ftype)
 {
 	if (!IsRecording())
 		return;
-	if (!av->inited)
+	if (audio_only ? !wav_file : !av->inited)
 	{
 	  if (ftype == FRAME_FADE)
 	    return;
-	  if (!Setup())
+	  if (!(audio_only ? SetupAudioExport() : Setup()))
 	    return;
 	}
 	
 	if (ftype == FRAME_FADE && get_keyboard_controller_status())
 		return;
+
+	if (audio_only)
+	{
+		ExportAudio();
+		return;
+	}
 	
 	SDL_SemWait(fillReady);
+	Frame& frame = frames[frames_queued.load(std::memory_order_relaxed) % frames.size()];
   	
 	if (!MainScreenIsOpenGL())
 	{
 		SDL_Surface *video = MainScreenSurface();
-		SDL_BlitSurface(video, &view_rect, temp_surface, NULL);
+		SDL_BlitSurface(video, &view_rect, frame.surface, NULL);
+		frame.needs_flip = false;
 	}
 #ifdef HAVE_OPENGL
 	else
@@ -408,22 +641,22 @@ void Movie::AddFrame(FrameType ftype)
 
         // Read our new frame buffer with rescaled pixels
         frameBufferObject->activate(true, GL_READ_FRAMEBUFFER_EXT);
-        glReadPixels(view_rect.x, view_rect.y, view_rect.w, view_rect.h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &videobuf.front());
+        glReadPixels(view_rect.x, view_rect.y, view_rect.w, view_rect.h, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &frame.readback.front());
         frameBufferObject->deactivate();
 
-		// Copy pixel buffer (which is upside-down) to surface
-		for (int y = 0; y < view_rect.h; y++)
-			memcpy((uint8 *)temp_surface->pixels + temp_surface->pitch * y, &videobuf.front() + view_rect.w * 4 * (view_rect.h - y - 1), view_rect.w * 4);
+		// the encoder thread turns it right side up
+		frame.needs_flip = true;
 	}
 #endif
 	
-	int bytes = audiobuf.size();
+	int bytes = frame.audio.size();
     int frameSize = 2 * in_bps;
     auto oldVol = OpenALManager::Get()->GetMasterVolume();
     OpenALManager::Get()->SetMasterVolume(SoundManager::From_db(sound_preferences->video_export_volume_db));
-    OpenALManager::Get()->GetPlayBackAudio(&audiobuf.front(), bytes / frameSize);
+    OpenALManager::Get()->GetPlayBackAudio(&frame.audio.front(), bytes / frameSize);
     OpenALManager::Get()->SetMasterVolume(oldVol);
 	
+	frames_queued.fetch_add(1, std::memory_order_release);
 	SDL_SemPost(encodeReady);
 }
 
@@ -431,7 +664,7 @@ void Movie::StopRecording()
 {
 	if (encodeThread)
 	{
-		stillEncoding = false;
+		// the encoder finishes the queued frames before it sees this
 		SDL_SemPost(encodeReady);
 		SDL_WaitThread(encodeThread, NULL);
 		encodeThread = NULL;
@@ -446,19 +679,20 @@ void Movie::StopRecording()
 		SDL_DestroySemaphore(fillReady);
 		fillReady = NULL;
 	}
-	if (temp_surface)
-	{
-		SDL_FreeSurface(temp_surface);
-		temp_surface = NULL;
-	}
     if (av->inited)
     {
         // flush video and audio
-        EncodeVideo(true);
-        EncodeAudio(true);
+        EncodeVideo(NULL);
+        EncodeAudio(NULL);
         SDL_ffmpegFree(av->ffmpeg_file);
         av->inited = false;
     }
+	for (auto& frame : frames)
+	{
+		if (frame.surface)
+			SDL_FreeSurface(frame.surface);
+	}
+	frames.clear();
     if (av->audio_frame)
     {
         SDL_ffmpegFreeAudioFrame(av->audio_frame);
@@ -470,6 +704,8 @@ void Movie::StopRecording()
         av->audio_fifo = NULL;
     }
 
+    FinishAudioExport();
+
 	moviefile = "";
     if (OpenALManager::Get()) {
         OpenALManager::Get()->ToggleDeviceMode(false);
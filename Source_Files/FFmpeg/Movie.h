@@ -26,7 +26,9 @@
 
 #include "cseries.h"
 #include "OGL_FBO.h"
+#include <atomic>
 #include <memory>
+#include <stdio.h>
 #include <string.h>
 #include <vector>
 #include <SDL2/SDL_thread.h>
@@ -58,10 +60,19 @@ private:
   
   std::string moviefile;
   SDL_Rect view_rect;
-  SDL_Surface *temp_surface;
   
-  std::vector<uint8> videobuf;
-  std::vector<uint8> audiobuf;
+  // Captured frames waiting for the encoder. The game fills frames in order
+  // and only waits when all of them are still queued; pixel format conversion
+  // and the OpenGL flip happen on the encoder thread.
+  struct Frame {
+    SDL_Surface *surface;
+    std::vector<uint8> readback; // OpenGL frame buffer, bottom row first
+    bool needs_flip;
+    std::vector<uint8> audio;
+  };
+  std::vector<Frame> frames;
+  std::atomic<size_t> frames_queued;
+  size_t frames_encoded;
   int in_bps;
   
   struct libav_vars *av;
@@ -69,7 +80,24 @@ private:
   SDL_Thread *encodeThread;
   SDL_sem *encodeReady;
   SDL_sem *fillReady;
-  bool stillEncoding;
+
+  // Exporting to a .wav file renders only the audio, straight from the
+  // mixer, and times it; the report at the end is an audio benchmark.
+  bool audio_only;
+  FILE *wav_file;
+  std::vector<uint8> wav_block;
+  int wav_sample_frame_size;
+  uint64_t wav_sample_frames;
+  uint64_t wav_blocks;
+  struct AudioExportStats {
+    int ticks;
+    double mix_seconds, decode_seconds;
+    double worst_tick_mix_seconds;
+    uint64_t source_samples; // sum of active sources over blocks
+    int peak_sources;
+    int current_tick;
+    double current_tick_mix_seconds;
+  } audio_stats;
 
 #ifdef HAVE_OPENGL
   std::unique_ptr<FBO> frameBufferObject;
@@ -79,9 +107,13 @@ private:
   bool Setup();
   static int Movie_EncodeThread(void *arg);
   void EncodeThread();
-  void EncodeVideo(bool last);
-  void EncodeAudio(bool last);
+  void EncodeVideo(Frame *frame);
+  void EncodeAudio(Frame *frame);
   void ThrowUserError(std::string error_msg);
+
+  bool SetupAudioExport();
+  void ExportAudio();
+  void FinishAudioExport();
 };
 	
 #endif
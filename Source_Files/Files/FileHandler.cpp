@@ -531,6 +531,15 @@ TimeType FileSpecifier::GetDate()
 	return err == 0 ? mtime : 0;
 }
 
+// Get size
+uintmax_t FileSpecifier::GetSize()
+{
+	sys::error_code ec;
+	const auto size = fs::file_size(utf8_to_path(name), ec);
+	err = to_posix_code_or_unknown(ec);
+	return err == 0 ? size : 0;
+}
+
 static const char * alephone_extensions[] = {
 	".sceA",
 	".sgaA",
@@ -287,6 +287,9 @@ public:
 	// Gets the modification date
 	TimeType GetDate();
 	
+	// Gets the size in bytes (0 if it could not be found)
+	uintmax_t GetSize();
+	
 	// Returns _typecode_unknown if the type could not be identified;
 	// the types returned are the _typecode_stuff in tags.h
 	Typecode GetType();
@@ -32,7 +32,9 @@ Nov 6, 2000 (Loren Petrich);
 #include <stdlib.h>
 
 #include "cseries.h"
+#ifndef A1_NETWORK_STANDALONE_HUB
 #include "FileHandler.h"
+#endif
 #include "crc.h"
 
 /* ---------- constants */
@@ -44,13 +46,17 @@ Nov 6, 2000 (Loren Petrich);
 static uint32 *crc_table= NULL;
 
 /* ---------- local prototypes ------- */
+#ifndef A1_NETWORK_STANDALONE_HUB
 static uint32 calculate_file_crc(unsigned char *buffer, 
 	short buffer_size, OpenedFile& OFile);
+#endif
 static uint32 calculate_buffer_crc(int32 count, uint32 crc, void *buffer);
 static bool build_crc_table(void);
 static void free_crc_table(void);
 
 /* -------------- Entry Point ----------- */
+// the standalone hub only checksums packets
+#ifndef A1_NETWORK_STANDALONE_HUB
 uint32 calculate_crc_for_file(FileSpecifier& File)
 {
 	uint32 crc = 0;
@@ -83,6 +89,7 @@ uint32 calculate_crc_for_opened_file(OpenedFile& OFile)
 
 	return crc;
 }
+#endif
 
 /* Calculate the crc for a file using the given buffer.. */
 uint32 calculate_data_crc(
@@ -161,6 +168,7 @@ static uint32 calculate_buffer_crc(
 	return crc;
 }
 
+#ifndef A1_NETWORK_STANDALONE_HUB
 /* Calculate the crc for a file using the given buffer.. */
 static uint32 calculate_file_crc(
 	unsigned char *buffer, 
@@ -205,6 +213,7 @@ static uint32 calculate_file_crc(
 
 	return (crc ^= 0xFFFFFFFFL);
 }
+#endif
 
 /*  crcccitt.c - a demonstration of look up table based CRC
  *               computation using the non-reversed CCITT_CRC
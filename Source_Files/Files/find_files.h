@@ -33,8 +33,13 @@ Aug 26, 2000 (Loren Petrich):
 // Finds every type of file
 const Typecode WILDCARD_TYPE = _typecode_unknown;
 
+#include <functional>
 #include <vector>
 
+// Calls task(i) for every i in [0, count), spread over a few worker threads;
+// tasks may read files, but must leave game state and the log alone
+void parallel_scan(size_t count, const std::function<void(size_t)>& task);
+
 // File-finder base class
 class FileFinder {
 public:
@@ -31,12 +31,81 @@
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
+
+/*
+ *  Worker pool for directory scans
+ */
+
+struct parallel_scan_state {
+	const std::function<void(size_t)>* task;
+	size_t count;
+	std::atomic<size_t> next;
+};
+
+static int parallel_scan_thread(void *data)
+{
+	parallel_scan_state *state = static_cast<parallel_scan_state *>(data);
+	for (size_t i = state->next++; i < state->count; i = state->next++)
+		(*state->task)(i);
+	return 0;
+}
+
+void parallel_scan(size_t count, const std::function<void(size_t)>& task)
+{
+	// small scans aren't worth the threads
+	static const size_t min_items_per_thread = 8;
+	static const int max_threads = 8;
+	
+	int threads = std::min(SDL_GetCPUCount(), max_threads);
+	threads = std::min<size_t>(threads, count / min_items_per_thread);
+	
+	parallel_scan_state state;
+	state.task = &task;
+	state.count = count;
+	state.next = 0;
+	
+	std::vector<SDL_Thread *> workers;
+	for (int i = 1; i < threads; ++i)
+	{
+		SDL_Thread *thread = SDL_CreateThread(parallel_scan_thread, "FileFinder_scanThread", &state);
+		if (!thread)
+			break;
+		workers.push_back(thread);
+	}
+	
+	// this thread works too, and covers everything if no workers started
+	parallel_scan_thread(&state);
+	
+	for (SDL_Thread *thread : workers)
+		SDL_WaitThread(thread, NULL);
+}
 
 
 /*
  *  File finder base class
  */
 
+// Sniffing a type opens the file, so results are kept until it changes
+struct sniffed_type {
+	TimeType date;
+	Typecode type;
+};
+static std::unordered_map<std::string, sniffed_type> sniffed_types;
+
+static Typecode get_file_type(FileSpecifier& file, TimeType date)
+{
+	auto it = sniffed_types.find(file.GetPath());
+	if (it != sniffed_types.end() && it->second.date == date)
+		return it->second.type;
+	
+	Typecode type = file.GetType();
+	sniffed_types[file.GetPath()] = { date, type };
+	return type;
+}
+
 bool FileFinder::_Find(DirectorySpecifier &dir, Typecode type, bool recursive, int depth)
 {
 	// Get list of entries in directory
@@ -65,7 +134,7 @@ bool FileFinder::_Find(DirectorySpecifier &dir, Typecode type, bool recursive, i
 		} else {
 
 			// Check file type and call found() function
-			if (type == WILDCARD_TYPE || type == file.GetType())
+			if (type == WILDCARD_TYPE || type == get_file_type(file, i->date))
 				if (found(file))
 					return true;
 		}
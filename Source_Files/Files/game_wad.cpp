@@ -115,6 +115,7 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 #include "preferences.h"
 #include "SoundManager.h"
 #include "Plugins.h"
+#include "QuickSave.h"
 #include "ephemera.h"
 
 // LP change: added chase-cam init and render allocation
@@ -561,112 +562,33 @@ bool new_game(
 	return success;
 }
 
-bool get_indexed_entry_point(
-	struct entry_point *entry_point, 
-	short *index, 
-	int32 type)
-{
-	short actual_index;
-	
-	// Open map file
-	assert(file_is_set);
-	OpenedFile MapFile;
-	if (!open_wad_file_for_reading(MapFileSpec,MapFile))
-		return false;
-
-	// Read header
-	wad_header header;
-	if (!read_wad_header(MapFile, &header)) {
-		close_wad_file(MapFile);
-		return false;
-	}
-    
-	bool success = false;
-	if (header.application_specific_directory_data_size == SIZEOF_directory_data)
-	{
-
-		// New style wad
-		void *total_directory_data= read_directory_data(MapFile, &header);
-
-		assert(total_directory_data);
-		for(actual_index= *index; actual_index<header.wad_count; ++actual_index)
-		{
-			uint8 *p = (uint8 *)get_indexed_directory_data(&header, actual_index, total_directory_data);
-			directory_data directory;
-			unpack_directory_data(p, &directory, 1);
-
-			/* Find the flags that match.. */
-			if(directory.entry_point_flags & type)
-			{
-				/* This one is valid! */
-				entry_point->level_number= actual_index;
-				strncpy(entry_point->level_name, directory.level_name, 66);
-			
-				*index= actual_index+1;
-				success= true;
-				break; /* Out of the for loop */
-			}
-		}
-		free(total_directory_data);
-
-	} else {
-
-		// Old style wad, find the index
-		for(actual_index= *index; !success && actual_index<header.wad_count; ++actual_index)
-		{
-			struct wad_data *wad;
-
-			/* Read the file */
-			wad= read_indexed_wad_from_file(MapFile, &header, actual_index, true);
-			if (wad)
-			{
-				/* IF this has the proper type.. */
-				size_t length;
-				uint8 *p = (uint8 *)extract_type_from_wad(wad, MAP_INFO_TAG, &length);
-				assert(length == SIZEOF_static_data);
-				static_data map_info;
-				unpack_static_data(p, &map_info, 1);
-
-				// single-player Marathon 1 levels aren't always marked
-				if (header.data_version == MARATHON_ONE_DATA_VERSION &&
-				    map_info.entry_point_flags == 0)
-					map_info.entry_point_flags = _single_player_entry_point;
-
-				// Marathon 1 handled (then-unused) coop flag differently
-				if (header.data_version == MARATHON_ONE_DATA_VERSION)
-				{
-					if (map_info.entry_point_flags & _single_player_entry_point)
-						map_info.entry_point_flags |= _multiplayer_cooperative_entry_point;
-					if (map_info.entry_point_flags & _multiplayer_carnage_entry_point)
-						map_info.entry_point_flags &= ~_multiplayer_cooperative_entry_point;
-				}
-
-				if(map_info.entry_point_flags & type)
-				{
-					/* This one is valid! */
-					entry_point->level_number= actual_index;
-					assert(strlen(map_info.level_name)<LEVEL_NAME_LENGTH);
-					strncpy(entry_point->level_name, map_info.level_name, 66);
-		
-					*index= actual_index+1;
-					success= true;
-				}
-				
-				free_wad(wad);
-			}
-		}
-	}
-
-	return success;
-}
+// Every level of the current map file with its entry point flags; the
+// level pickers ask for these over and over, and old style wads have to
+// be read level by level to find them
+struct cached_entry_point {
+	entry_point point;
+	int32 flags;
+};
+static std::vector<cached_entry_point> cached_entry_points;
+static std::string cached_entry_points_path;
+static TimeType cached_entry_points_date = 0;
+static uintmax_t cached_entry_points_size = 0;
 
-// Get vector of map entry points matching given type
-bool get_entry_points(vector<entry_point> &vec, int32 type)
+static bool load_entry_points(void)
 {
-	vec.clear();
+	assert(file_is_set);
+	
+	TimeType date = MapFileSpec.GetDate();
+	uintmax_t size = MapFileSpec.GetSize();
+	if (date && date == cached_entry_points_date && size == cached_entry_points_size && cached_entry_points_path == MapFileSpec.GetPath())
+		return true;
+	
+	cached_entry_points.clear();
+	cached_entry_points_path.clear();
+	cached_entry_points_date = 0;
+	cached_entry_points_size = 0;
 
 	// Open map file
-	assert(file_is_set);
 	OpenedFile MapFile;
 	if (!open_wad_file_for_reading(MapFileSpec,MapFile))
 		return false;
@@ -678,28 +600,22 @@ bool get_entry_points(vector<entry_point> &vec, int32 type)
 		return false;
 	}
 
-	bool success = false;
 	if (header.application_specific_directory_data_size == SIZEOF_directory_data) {
 
 		// New style wad, read directory data
 		void *total_directory_data = read_directory_data(MapFile, &header);
 		assert(total_directory_data);
 
-		// Push matching directory entries into vector
 		for (int i=0; i<header.wad_count; i++) {
 			uint8 *p = (uint8 *)get_indexed_directory_data(&header, i, total_directory_data);
 			directory_data directory;
 			unpack_directory_data(p, &directory, 1);
 
-			if (directory.entry_point_flags & type) {
-
-				// This one is valid
-				entry_point point;
-				point.level_number = i;
-				strncpy(point.level_name, directory.level_name, 66);
-				vec.push_back(point);
-				success = true;
-			}
+			cached_entry_point cached;
+			cached.point.level_number = i;
+			strncpy(cached.point.level_name, directory.level_name, 66);
+			cached.flags = directory.entry_point_flags;
+			cached_entry_points.push_back(cached);
 		}
 		free(total_directory_data);
 
@@ -733,22 +649,66 @@ bool get_entry_points(vector<entry_point> &vec, int32 type)
 					map_info.entry_point_flags &= ~_multiplayer_cooperative_entry_point;
 			}
 
-			if (map_info.entry_point_flags & type) {
-
-				// This one is valid
-				entry_point point;
-				point.level_number = i;
-				assert(strlen(map_info.level_name) < LEVEL_NAME_LENGTH);
-				strncpy(point.level_name, map_info.level_name, 66);
-				vec.push_back(point);
-				success = true;
-			}
+			cached_entry_point cached;
+			cached.point.level_number = i;
+			assert(strlen(map_info.level_name) < LEVEL_NAME_LENGTH);
+			strncpy(cached.point.level_name, map_info.level_name, 66);
+			cached.flags = map_info.entry_point_flags;
+			cached_entry_points.push_back(cached);
 				
 			free_wad(wad);
 		}
 	}
 
-	return success;
+	close_wad_file(MapFile);
+	
+	cached_entry_points_path = MapFileSpec.GetPath();
+	cached_entry_points_date = date;
+	cached_entry_points_size = size;
+	return true;
+}
+
+bool get_indexed_entry_point(
+	struct entry_point *entry_point, 
+	short *index, 
+	int32 type)
+{
+	if (!load_entry_points())
+		return false;
+	
+	for (const auto& cached : cached_entry_points)
+	{
+		/* Find the flags that match.. */
+		if (cached.point.level_number >= *index && (cached.flags & type))
+		{
+			/* This one is valid! */
+			obj_copy(*entry_point, cached.point);
+			*index= cached.point.level_number+1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Get vector of map entry points matching given type
+bool get_entry_points(vector<entry_point> &vec, int32 type)
+{
+	vec.clear();
+
+	if (!load_entry_points())
+		return false;
+
+	// Push matching entries into vector
+	for (const auto& cached : cached_entry_points)
+	{
+		if (cached.flags & type)
+		{
+			vec.push_back(cached.point);
+		}
+	}
+
+	return !vec.empty();
 }
 
 extern void LoadSoloLua();
@@ -1288,6 +1248,9 @@ bool revert_game(
 	
 	if (revert_game_data.game_is_from_disk)
 	{
+		/* The last save may still be on its way to disk */
+		wait_for_quick_saves();
+		
 		/* Reload their last saved game.. */
 		successful= load_game_from_file(revert_game_data.SavedGame, true);
 		if (successful) 
@@ -1418,10 +1381,32 @@ bool save_game_file(FileSpecifier& File, const std::string& metadata, const std:
 	struct wad_header header;
 	short err = 0;
 	bool success= false;
-	int32 offset, wad_length;
-	struct directory_entry entries[2];
-	struct wad_data *wad, *meta_wad;
+	int32 wad_length;
+	struct wad_data *wad;
+
+	wad= capture_save_game(File, &header, &wad_length);
+	if (wad)
+	{
+		err= write_save_game_file(File, &header, wad, wad_length, metadata, imagedata);
+		success= !err;
+		free_wad(wad);
+	}
+	
+	if(err || error_pending())
+	{
+		if(!err) err= get_game_error(NULL);
+		alert_user(infoError, strERRORS, fileError, err);
+		clear_game_error();
+		success= false;
+	}
+	
+	return success;
+}
 
+/* Snapshot the game state for a saved game; this must happen on the game
+   thread, but the result can be written out later from any thread */
+struct wad_data *capture_save_game(FileSpecifier& File, struct wad_header *header, int32 *length)
+{
 	/* Save off the random seed. */
 	dynamic_world->random_seed= get_random_seed();
 
@@ -1429,89 +1414,101 @@ bool save_game_file(FileSpecifier& File, const std::string& metadata, const std:
 	revert_game_data.game_is_from_disk= true;
 	revert_game_data.SavedGame = File;
 
+	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
+	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, header);
+	header->parent_checksum= read_wad_file_checksum(MapFileSpec);
+
+	return build_save_game_wad(header, length);
+}
+
+/* Write a captured game state and its metadata; touches no game globals,
+   so it is safe to call off the game thread. Returns an error code. */
+short write_save_game_file(FileSpecifier& File, struct wad_header *header, struct wad_data *wad, int32 wad_length, const std::string& metadata, const std::string& imagedata)
+{
+	short err = 0;
+	bool success= false;
+	int32 offset, meta_wad_length;
+	struct directory_entry entries[2];
+	struct wad_data *meta_wad;
+
 	// LP: add a file here; use temporary file for a safe save.
 	// Write into the temporary file first
 	FileSpecifier TempFile;
 	TempFile.SetTempName(File);
 	
-	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
-	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
-		
 	/* Assume that we confirmed on save as... */
 	if (create_wadfile(TempFile,_typecode_savegame))
 	{
 		OpenedFile SaveFile;
-		if(open_wad_file_for_writing(TempFile,SaveFile))
+		if(TempFile.Open(SaveFile, true))
 		{
 			/* Write out the new header */
-			if (write_wad_header(SaveFile, &header))
+			if (write_wad_header(SaveFile, header))
 			{
 				offset= SIZEOF_wad_header;
 		
-				wad= build_save_game_wad(&header, &wad_length);
-				if (wad)
+				/* Set the entry data.. */
+				set_indexed_directory_offset_and_length(header, 
+					entries, 0, offset, wad_length, 0);
+				
+				/* Save it.. */
+				if (write_wad(SaveFile, header, wad, offset))
 				{
-					/* Set the entry data.. */
-					set_indexed_directory_offset_and_length(&header, 
-						entries, 0, offset, wad_length, 0);
+					/* Update the new header */
+					offset+= wad_length;
+					header->directory_offset= offset;
 					
-					/* Save it.. */
-					if (write_wad(SaveFile, &header, wad, offset))
+					/* Create metadata wad */
+					meta_wad = build_meta_game_wad(metadata, imagedata, header, &meta_wad_length);
+					if (meta_wad)
 					{
-						/* Update the new header */
-						offset+= wad_length;
-						header.directory_offset= offset;
-						header.parent_checksum= read_wad_file_checksum(MapFileSpec);
+						set_indexed_directory_offset_and_length(header,
+							entries, 1, offset, meta_wad_length, SAVE_GAME_METADATA_INDEX);
 						
-						/* Create metadata wad */
-						meta_wad = build_meta_game_wad(metadata, imagedata, &header, &wad_length);
-						if (meta_wad)
+						if (write_wad(SaveFile, header, meta_wad, offset))
 						{
-							set_indexed_directory_offset_and_length(&header,
-								entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
-							
-							if (write_wad(SaveFile, &header, meta_wad, offset))
+							offset+= meta_wad_length;
+							header->directory_offset= offset;
+					
+							if (write_wad_header(SaveFile, header) && write_directorys(SaveFile, header, entries))
 							{
-								offset+= wad_length;
-								header.directory_offset= offset;
-						
-								if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
-								{
-									/* We win. */
-									success= true;
-								}
+								/* We win. */
+								success= true;
 							}
-							
-							free_wad(meta_wad);
 						}
+						
+						free_wad(meta_wad);
 					}
-
-					free_wad(wad);
 				}
 			}
 
 			err = SaveFile.GetError();
 			close_wad_file(SaveFile);
 		}
+		else
+		{
+			err = TempFile.GetError();
+		}
 		
-		if (!err)
+		/* Only replace the old save once the new one is complete */
+		if (!err && success)
 		{
 			if (!TempFile.Rename(File))
 			{
-				err = 1;
+				err = TempFile.GetError();
 			}
 		}
 	}
-	
-	if(err || error_pending())
+	else
 	{
-		if(!err) err= get_game_error(NULL);
-		alert_user(infoError, strERRORS, fileError, err);
-		clear_game_error();
-		success= false;
+		err = TempFile.GetError();
 	}
 	
-	return success;
+	/* Nothing failed at the file level (the metadata wad could not be built) */
+	if (!err && !success)
+		err = unknown_filesystem_error;
+	
+	return err;
 }
 
 /* -------- static functions */
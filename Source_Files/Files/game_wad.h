@@ -40,6 +40,9 @@ Aug 12, 2000 (Loren Petrich):
 class FileSpecifier;
 
 bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata);
+// split phases of save_game_file(): capture on the game thread, write from anywhere
+struct wad_data *capture_save_game(FileSpecifier& File, struct wad_header *header, int32 *length);
+short write_save_game_file(FileSpecifier& File, struct wad_header *header, struct wad_data *wad, int32 wad_length, const std::string& metadata, const std::string& imagedata);
 struct wad_data *build_meta_game_wad(const std::string& metadata, const std::string& imagedata, struct wad_header *header, int32 *length);
 
 bool export_level(FileSpecifier& File);
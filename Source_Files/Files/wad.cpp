@@ -90,6 +90,11 @@ Jan 25, 2002 (Br'fin (Jeremy Parsons)):
 #include "FileHandler.h"
 #include "Packing.h"
 
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 // Formerly in portable_files.h
 inline short memory_error() {return 0;}
 
@@ -104,6 +109,18 @@ bool BetweenLevels = true;
 /* ---------------- private global data */
 struct wad_internal_data *internal_data[MAXIMUM_OPEN_WADFILES]= {NULL, NULL, NULL};
 
+// Headers of wad files already looked at, keyed by path and checked against
+// the modification date and size; checksum searches and level pickers
+// otherwise reopen every map in a directory each time they look for
+// something. Saves are written from worker threads, hence the lock.
+struct cached_wad_header {
+	TimeType date;
+	uintmax_t size;
+	struct wad_header header;
+};
+static std::unordered_map<std::string, cached_wad_header> wad_header_cache;
+static std::mutex wad_header_cache_mutex;
+
 /* ---------------- private prototypes */
 static int32 calculate_directory_offset(struct wad_header *header, short index);
 static short get_directory_base_length(struct wad_header *header);
@@ -123,6 +140,7 @@ static bool size_of_indexed_wad(OpenedFile& OFile, struct wad_header *header, sh
 
 static bool write_to_file(OpenedFile& OFile, int32 offset, void *data, int32 length);
 static bool read_from_file(OpenedFile& OFile, int32 offset, void *data, int32 length);
+static bool read_wad_header_cached(FileSpecifier& File, struct wad_header *header);
 
 // LP: routines for packing and unpacking the data from streams of bytes
 static uint8 *unpack_wad_header(uint8 *Stream, wad_header *Objects, size_t Count);
@@ -260,6 +278,76 @@ void *extract_type_from_wad(
 	return return_value;
 }
 
+bool read_tag_from_wad_file(
+	OpenedFile& OFile,
+	short index,
+	WadDataType type,
+	std::vector<uint8>& data)
+{
+	data.clear();
+	
+	int32 file_length;
+	uint8 header_buffer[SIZEOF_wad_header];
+	if (!OFile.GetLength(file_length) || file_length < SIZEOF_wad_header ||
+		!read_from_file(OFile, 0, header_buffer, SIZEOF_wad_header))
+		return false;
+	
+	wad_header header;
+	unpack_wad_header(header_buffer, &header, 1);
+	if (header.version > CURRENT_WADFILE_VERSION || header.version == 3 || header.version < 0 ||
+		header.data_version > 2 || header.wad_count < 1)
+		return false;
+	
+	// the sizes the directory and entry header readers would assert on
+	int base_entry_size = get_directory_base_length(&header);
+	int entry_header_size = get_entry_header_length(&header);
+	if ((base_entry_size != SIZEOF_old_directory_entry && base_entry_size < SIZEOF_directory_entry) ||
+		header.application_specific_directory_data_size < 0 ||
+		entry_header_size < SIZEOF_old_entry_header || index < 0)
+		return false;
+	
+	int32 unit_size = base_entry_size + header.application_specific_directory_data_size;
+	if (header.directory_offset < 0 ||
+		header.directory_offset > file_length ||
+		header.wad_count > (file_length - header.directory_offset) / unit_size)
+		return false;
+	
+	directory_entry entry;
+	if (!read_indexed_directory_data(OFile, &header, index, &entry) ||
+		entry.offset_to_start < 0 || entry.length < entry_header_size ||
+		entry.offset_to_start > file_length || entry.length > file_length - entry.offset_to_start)
+		return false;
+	
+	// padded so the last entry header can always be unpacked whole
+	std::vector<uint8> raw(entry.length + SIZEOF_entry_header);
+	if (!read_from_file(OFile, entry.offset_to_start, raw.data(), entry.length))
+		return false;
+	
+	uint32 offset = 0;
+	while (offset <= static_cast<uint32>(entry.length - entry_header_size))
+	{
+		entry_header tag_header;
+		unpack_entry_header(raw.data() + offset, &tag_header, 1);
+		
+		uint32 start = offset + entry_header_size;
+		if (tag_header.length < 0 || static_cast<uint32>(tag_header.length) > entry.length - start)
+			return false;
+		
+		if (tag_header.tag == type)
+		{
+			data.assign(raw.begin() + start, raw.begin() + start + tag_header.length);
+			return true;
+		}
+		
+		// tags only ever go forward, so a damaged offset cannot loop
+		if (tag_header.next_offset == 0 || tag_header.next_offset <= offset)
+			break;
+		offset = tag_header.next_offset;
+	}
+	
+	return false;
+}
+
 bool wad_file_has_checksum(
 	FileSpecifier& File, 
 	uint32 checksum)
@@ -279,15 +367,9 @@ uint32 read_wad_file_checksum(FileSpecifier& File)
 	struct wad_header header;
 	uint32 checksum= 0;
 	
-	OpenedFile OFile;
-	if (open_wad_file_for_reading(File,OFile))
+	if(read_wad_header_cached(File, &header))
 	{
-		if(read_wad_header(OFile, &header))
-		{
-			checksum= header.checksum;
-		}
-		
-		close_wad_file(OFile);
+		checksum= header.checksum;
 	}
 	
 	return checksum;
@@ -295,19 +377,12 @@ uint32 read_wad_file_checksum(FileSpecifier& File)
 
 uint32 read_wad_file_parent_checksum(FileSpecifier& File)
 {
-	// fileref file_id;
 	struct wad_header header;
 	uint32 checksum= 0;
 
-	OpenedFile OFile;
-	if (open_wad_file_for_reading(File,OFile))
+	if(read_wad_header_cached(File, &header))
 	{
-		if(read_wad_header(OFile, &header))
-		{
-			checksum= header.parent_checksum;
-		}
-		
-		close_wad_file(OFile);
+		checksum= header.parent_checksum;
 	}
 	
 	return checksum;
@@ -317,27 +392,16 @@ bool wad_file_has_parent_checksum(
 	FileSpecifier& File, 
 	uint32 parent_checksum)
 {
-	// fileref file_id;
 	bool has_checksum= false;
 	struct wad_header header;
 
-	OpenedFile OFile;
-	if (open_wad_file_for_reading(File,OFile))
-	// file_id= open_wad_file_for_reading(file);
-	// if(file_id>=0)
+	if(read_wad_header_cached(File, &header))
 	{
-		if(read_wad_header(OFile, &header))
-		// if(read_wad_header(file_id, &header))
+		if(header.parent_checksum==parent_checksum)
 		{
-			if(header.parent_checksum==parent_checksum)
-			{
-				/* Found a match!  */
-				has_checksum= true;
-			}
+			/* Found a match!  */
+			has_checksum= true;
 		}
-		
-		close_wad_file(OFile);
-		// close_wad_file(file_id);
 	}
 	
 	return has_checksum;
@@ -723,18 +787,11 @@ bool write_wad(
 short number_of_wads_in_file(FileSpecifier& File)
 {
 	short count= NONE;
+	struct wad_header header;
 	
-	OpenedFile OFile;
-	if (open_wad_file_for_reading(File,OFile))
+	if (read_wad_header_cached(File, &header))
 	{
-		struct wad_header header;
-		
-		/* read the header */
-		read_wad_header(OFile, &header);
-		
 		count= header.wad_count;
-		
-		close_wad_file(OFile);
 	}
 	
 	return count;
@@ -926,6 +983,11 @@ void dump_wad(
 /* ---------- file management routines */
 bool create_wadfile(FileSpecifier& File, Typecode Type)
 {
+	// whatever gets written may replace a file we have cached
+	{
+		std::lock_guard<std::mutex> lock(wad_header_cache_mutex);
+		wad_header_cache.clear();
+	}
 	return File.Create(Type);
 }
 
@@ -955,6 +1017,48 @@ void close_wad_file(OpenedFile& File)
 }
 
 /* ------------------------------ Private Code --------------- */
+
+static bool read_wad_header_cached(
+	FileSpecifier& File,
+	struct wad_header *header)
+{
+	TimeType date = File.GetDate();
+	uintmax_t size = File.GetSize();
+	
+	{
+		std::lock_guard<std::mutex> lock(wad_header_cache_mutex);
+		auto it = wad_header_cache.find(File.GetPath());
+		if (date && it != wad_header_cache.end() && it->second.date == date && it->second.size == size)
+		{
+			obj_copy(*header, it->second.header);
+			return true;
+		}
+	}
+	
+	bool success = false;
+	OpenedFile OFile;
+	if (open_wad_file_for_reading(File, OFile))
+	{
+		success = read_wad_header(OFile, header);
+		close_wad_file(OFile);
+	}
+	
+	std::lock_guard<std::mutex> lock(wad_header_cache_mutex);
+	if (success && date)
+	{
+		cached_wad_header& entry = wad_header_cache[File.GetPath()];
+		entry.date = date;
+		entry.size = size;
+		obj_copy(entry.header, *header);
+	}
+	else
+	{
+		wad_header_cache.erase(File.GetPath());
+	}
+	
+	return success;
+}
+
 static bool size_of_indexed_wad(
 	OpenedFile& OFile, 
 	struct wad_header *header, 
@@ -1094,6 +1198,12 @@ static bool read_indexed_directory_data(
 	} else {
 
 		short directory_index;
+		
+		/* Read the whole directory at once instead of an entry at a time */
+		int32 unit_size= calculate_directory_offset(header, 1) - calculate_directory_offset(header, 0);
+		std::vector<uint8> directory(header->wad_count * unit_size);
+		if (!read_from_file(OFile, header->directory_offset, directory.data(), static_cast<int32>(directory.size())))
+			return false;
 
 		/* Pin it, so we can try to read future file formats */
 		if(base_entry_size>SIZEOF_directory_entry) 
@@ -1109,12 +1219,10 @@ static bool read_indexed_directory_data(
 			short test_index= (index+directory_index)%header->wad_count;
 		
 			/* Calculate the offset */
-			offset= calculate_directory_offset(header, test_index);
+			offset= calculate_directory_offset(header, test_index) - header->directory_offset;
 
 			/* Read it.. */
-			uint8 buffer[MAX(SIZEOF_old_directory_entry,SIZEOF_directory_entry)];
-			if (!read_from_file(OFile, offset, buffer, base_entry_size))
-				return false;
+			uint8 *buffer= directory.data() + offset;
 			switch (base_entry_size)
 			{
 			case SIZEOF_old_directory_entry:
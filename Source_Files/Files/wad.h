@@ -41,6 +41,8 @@ Aug 12, 2000 (Loren Petrich):
 
 #include "tags.h"
 
+#include <vector>
+
 #define PRE_ENTRY_POINT_WADFILE_VERSION 0
 #define WADFILE_HAS_DIRECTORY_ENTRY 1
 #define WADFILE_SUPPORTS_OVERLAYS 2
@@ -151,6 +153,12 @@ bool read_wad_header(OpenedFile& OFile, struct wad_header *header);
 struct wad_data *read_indexed_wad_from_file(OpenedFile& OFile, 
 	struct wad_header *header, short index, bool read_only);
 
+/* Copy one tag of the indexed wad straight from the file. Unlike the functions above,
+   this leaves the game error and the level memory alone and checks every offset, so it
+   is safe on worker threads and on damaged files; false if anything is amiss */
+bool read_tag_from_wad_file(OpenedFile& OFile, short index, WadDataType type,
+	std::vector<uint8>& data);
+
 /* Properly deal with the memory.. */
 void free_wad(struct wad_data *wad);
 
@@ -122,6 +122,99 @@ struct ContrailInfo {
 // tick and use that for interpolation
 static std::vector<ContrailInfo> contrail_tracking;
 
+// indices of what changed between the previous and current tick, in
+// ascending order; nothing else needs interpolating, so the per-frame work
+// scales with what moved rather than with the size of the map
+static std::vector<int16_t> moving_polygons;
+static std::vector<int16_t> moving_lines;
+static std::vector<int16_t> moving_objects;
+static std::vector<int16_t> moving_ephemera;
+
+// when set, every entity is treated as moving, which is how the world was
+// interpolated before; the output must not differ
+static bool interpolate_every_entity = false;
+
+static bool same_location(const world_point3d& a, const world_point3d& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+static bool tick_object_moved(const TickObjectData& prev,
+							  const TickObjectData& next)
+{
+	return SLOT_IS_USED(&next) && SLOT_IS_USED(&prev) &&
+		(!same_location(prev.location, next.location) ||
+		 prev.polygon != next.polygon);
+}
+
+static void find_moving_entities()
+{
+	moving_polygons.clear();
+	for (auto i = 0; i < dynamic_world->polygon_count; ++i)
+	{
+		auto& prev = previous_tick_polygons[i];
+		auto& next = current_tick_polygons[i];
+		bool moved = prev.floor_height != next.floor_height ||
+			prev.ceiling_height != next.ceiling_height;
+
+		auto& polygon = map_polygons[i];
+		for (auto j = 0; !moved && j < polygon.vertex_count; ++j)
+		{
+			auto side_index = polygon.side_indexes[j];
+			moved = side_index != NONE &&
+				current_tick_sides[side_index].y0 !=
+				previous_tick_sides[side_index].y0;
+		}
+
+		if (moved || interpolate_every_entity)
+		{
+			moving_polygons.push_back(i);
+		}
+	}
+
+	moving_lines.clear();
+	for (auto i = 0; i < MAXIMUM_LINES_PER_MAP; ++i)
+	{
+		auto& prev = previous_tick_lines[i];
+		auto& next = current_tick_lines[i];
+		if (interpolate_every_entity ||
+			prev.highest_adjacent_floor != next.highest_adjacent_floor ||
+			prev.lowest_adjacent_ceiling != next.lowest_adjacent_ceiling)
+		{
+			moving_lines.push_back(i);
+		}
+	}
+
+	moving_objects.clear();
+	for (auto i = 0; i < MAXIMUM_OBJECTS_PER_MAP; ++i)
+	{
+		if (interpolate_every_entity ||
+			tick_object_moved(previous_tick_objects[i], current_tick_objects[i]))
+		{
+			moving_objects.push_back(i);
+		}
+	}
+
+	moving_ephemera.clear();
+	for (auto i = 0; i < get_dynamic_limit(_dynamic_limit_ephemera); ++i)
+	{
+		if (interpolate_every_entity ||
+			tick_object_moved(previous_tick_ephemera[i], current_tick_ephemera[i]))
+		{
+			moving_ephemera.push_back(i);
+		}
+	}
+}
+
+void set_interpolate_every_entity(bool every_entity)
+{
+	interpolate_every_entity = every_entity;
+	if (world_is_interpolated)
+	{
+		find_moving_entities();
+	}
+}
+
 void init_interpolated_world()
 {
 	if (get_fps_target() == 30)
@@ -229,9 +322,10 @@ void enter_interpolated_world()
 	}
 	
 	start_machine_tick = machine_tick_count();
-	
-	previous_tick_objects.assign(current_tick_objects.begin(),
-								 current_tick_objects.end());
+
+	// last tick's current state becomes the previous state; every entry of
+	// the current state is rewritten below
+	previous_tick_objects.swap(current_tick_objects);
 	
 	for (auto i = 0; i < MAXIMUM_OBJECTS_PER_MAP; ++i)
 	{
@@ -249,8 +343,7 @@ void enter_interpolated_world()
 		}
 	}
 
-	previous_tick_polygons.assign(current_tick_polygons.begin(),
-								  current_tick_polygons.end());
+	previous_tick_polygons.swap(current_tick_polygons);
 
 	for (auto i = 0; i < dynamic_world->polygon_count; ++i)
 	{
@@ -274,16 +367,15 @@ void enter_interpolated_world()
 		}
 	}
 	
-	previous_tick_sides.assign(current_tick_sides.begin(),
-							   current_tick_sides.end());
+	previous_tick_sides.swap(current_tick_sides);
+	current_tick_sides.resize(previous_tick_sides.size());
 	
 	for (auto i = 0; i < MAXIMUM_SIDES_PER_MAP; ++i)
 	{
 		current_tick_sides[i].y0 = map_sides[i].primary_texture.y0;
 	}
 	
-	previous_tick_lines.assign(current_tick_lines.begin(),
-							   current_tick_lines.end());
+	previous_tick_lines.swap(current_tick_lines);
 	for (auto i = 0; i < MAXIMUM_LINES_PER_MAP; ++i)
 	{
 		auto& tick_line = current_tick_lines[i];
@@ -293,8 +385,7 @@ void enter_interpolated_world()
 		tick_line.lowest_adjacent_ceiling = line->lowest_adjacent_ceiling;
 	}
 
-	previous_tick_ephemera.assign(current_tick_ephemera.begin(),
-								  current_tick_ephemera.end());
+	previous_tick_ephemera.swap(current_tick_ephemera);
 	for (auto i = 0; i < get_dynamic_limit(_dynamic_limit_ephemera); ++i)
 	{
 		auto& tick_ephemera = current_tick_ephemera[i];
@@ -322,8 +413,7 @@ void enter_interpolated_world()
 	next->origin = view->origin;
 	next->maximum_depth_intensity = view->maximum_depth_intensity;
 
-	previous_tick_weapon_display.assign(current_tick_weapon_display.begin(),
-										current_tick_weapon_display.end());
+	previous_tick_weapon_display.swap(current_tick_weapon_display);
 
 	current_tick_weapon_display.clear();
 	short count = 0;
@@ -343,6 +433,8 @@ void enter_interpolated_world()
 		}
 	}
 
+	find_moving_entities();
+
 	world_is_interpolated = true;
 }
 
@@ -490,7 +582,7 @@ void update_interpolated_world(float heartbeat_fraction)
 		return;
 	}
 
-	for (auto i = 0; i < dynamic_world->polygon_count; ++i)
+	for (auto i : moving_polygons)
 	{
 		if (!TEST_RENDER_FLAG(i, _polygon_is_visible))
 		{
@@ -530,7 +622,7 @@ void update_interpolated_world(float heartbeat_fraction)
 		}
 	}
 
-	for (auto i = 0; i < MAXIMUM_LINES_PER_MAP; ++i)
+	for (auto i : moving_lines)
 	{
 		auto line = get_line_data(i);
 		if ((line->clockwise_polygon_owner == NONE ||
@@ -562,7 +654,7 @@ void update_interpolated_world(float heartbeat_fraction)
 		}
 	}
 	
-	for (auto i = 0; i < MAXIMUM_OBJECTS_PER_MAP; ++i)
+	for (auto i : moving_objects)
 	{
 		auto prev = &previous_tick_objects[i];
 		auto next = &current_tick_objects[i];
@@ -629,7 +721,7 @@ void update_interpolated_world(float heartbeat_fraction)
 	}
 
 	// TODO: this is not very DRY, see above
-	for (auto i = 0; i < get_dynamic_limit(_dynamic_limit_ephemera); ++i)
+	for (auto i : moving_ephemera)
 	{
 		auto prev = &previous_tick_ephemera[i];
 		auto next = &current_tick_ephemera[i];
@@ -34,6 +34,10 @@ void exit_interpolated_world();
 void update_interpolated_world(float heartbeat_fraction);
 void interpolate_world_view(float heartbeat_fraction);
 
+// Interpolate every entity rather than only those that moved since the
+// previous tick; the output is the same, so this is only for checking that
+void set_interpolate_every_entity(bool every_entity);
+
 void track_contrail_interpolation(int16_t projectile_index, int16_t effect_index);
 bool get_interpolated_weapon_display_information(short* count, weapon_display_information* data);
 
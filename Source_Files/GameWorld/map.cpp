@@ -124,6 +124,7 @@ find_line_crossed leaving polygon could be sped up considerable by reversing the
 #include <limits.h>
 
 #include <list>
+#include <unordered_map>
 
 /* ---------- structures */
 
@@ -244,6 +245,7 @@ short LoadedWallTexture = NONE;
 /* ---------- private prototypes */
 
 static short _new_map_object(shape_descriptor shape, angle facing);
+static void invalidate_sound_obstruction_cache(void);
 
 // ZZZ: factored out some functionality for prediction, but ended up not using this stuff,
 // so am not "publishing" it via map.h yet.
@@ -378,6 +380,7 @@ void initialize_map_for_new_game(
 	void)
 {
 	obj_clear(*dynamic_world);
+	invalidate_sound_obstruction_cache();
 
 	initialize_players();
 	initialize_monsters();
@@ -392,6 +395,9 @@ void initialize_map_for_new_level(
 	short player_count;
 	struct game_data game_information;
 
+	/* the tick count carries over, so cached sound obstructions would too */
+	invalidate_sound_obstruction_cache();
+
 	/* The player count, tick count, and random seed must persist.. */
 	/* And the game information! (ajr) */
 	player_count= dynamic_world->player_count;
@@ -2545,72 +2551,124 @@ world_location3d *_sound_listener_proc(
 		nullptr);
 }
 
-// stuff floating on top of media is above it
+/* The sound manager asks for the obstruction of every playing sound (and of
+	every ambient source) on each idle pass, usually with the same few sources
+	over and over; the answer can only change when the world or the listener
+	does, so it is remembered until the next tick. */
+static struct sound_obstruction_cache_data
+{
+	bool valid;
+	uint32 tick_count;
+	world_location3d listener;
+	std::unordered_map<uint64_t, uint16> flags; /* keyed by source point and polygon */
+} sound_obstruction_cache;
+
+static void invalidate_sound_obstruction_cache(
+	void)
+{
+	sound_obstruction_cache.valid= false;
+	sound_obstruction_cache.flags.clear();
+}
+
+static uint64_t sound_obstruction_key(
+	world_location3d *source)
+{
+	return (uint64_t(uint16(source->point.x))<<48) | (uint64_t(uint16(source->point.y))<<32) |
+		(uint64_t(uint16(source->point.z))<<16) | uint64_t(uint16(source->polygon_index));
+}
+
+static uint16 calculate_sound_obstruction(world_location3d *source, world_location3d *listener);
+
 uint16 _sound_obstructed_proc(
 	world_location3d *source)
 {
 	world_location3d *listener= _sound_listener_proc();
+	
+	if (!listener) return 0;
+	
+	sound_obstruction_cache_data& cache= sound_obstruction_cache;
+	if (!cache.valid || cache.tick_count!=dynamic_world->tick_count ||
+		cache.listener.polygon_index!=listener->polygon_index ||
+		cache.listener.point.x!=listener->point.x || cache.listener.point.y!=listener->point.y || cache.listener.point.z!=listener->point.z)
+	{
+		cache.flags.clear();
+		cache.valid= true;
+		cache.tick_count= dynamic_world->tick_count;
+		cache.listener= *listener;
+	}
+	
+	uint64_t key= sound_obstruction_key(source);
+	std::unordered_map<uint64_t, uint16>::const_iterator it= cache.flags.find(key);
+	if (it!=cache.flags.end()) return it->second;
+	
+	uint16 flags= calculate_sound_obstruction(source, listener);
+	cache.flags[key]= flags;
+	return flags;
+}
+
+// stuff floating on top of media is above it
+static uint16 calculate_sound_obstruction(
+	world_location3d *source,
+	world_location3d *listener)
+{
 	uint16 flags= 0;
 	
-	if (listener)
+	if (line_is_obstructed(source->polygon_index, (world_point2d *)&source->point,
+		listener->polygon_index, (world_point2d *)&listener->point))
 	{
-		if (line_is_obstructed(source->polygon_index, (world_point2d *)&source->point,
-			listener->polygon_index, (world_point2d *)&listener->point))
-		{
-			flags|= _sound_was_obstructed;
-		}
-		else
+		flags|= _sound_was_obstructed;
+	}
+	else
+	{
+		struct polygon_data *source_polygon= get_polygon_data(source->polygon_index);
+		struct polygon_data *listener_polygon= get_polygon_data(listener->polygon_index);
+		bool source_under_media= false, listener_under_media= false;
+		
+		// LP change: idiot-proofed the media handling
+		if (source_polygon->media_index!=NONE)
 		{
-			struct polygon_data *source_polygon= get_polygon_data(source->polygon_index);
-			struct polygon_data *listener_polygon= get_polygon_data(listener->polygon_index);
-			bool source_under_media= false, listener_under_media= false;
-			
-			// LP change: idiot-proofed the media handling
-			if (source_polygon->media_index!=NONE)
+			media_data *media = get_media_data(source_polygon->media_index);
+			if (media)
 			{
-				media_data *media = get_media_data(source_polygon->media_index);
-				if (media)
+				if (source->point.z<media->height)
 				{
-					if (source->point.z<media->height)
-					{
-						source_under_media= true;
-					}
+					source_under_media= true;
 				}
 			}
-			
-			if (listener_polygon->media_index!=NONE)
+		}
+		
+		if (listener_polygon->media_index!=NONE)
+		{
+			media_data *media = get_media_data(listener_polygon->media_index);
+			if (media)
 			{
-				media_data *media = get_media_data(listener_polygon->media_index);
-				if (media)
+				if (listener->point.z<media->height)
 				{
-					if (listener->point.z<media->height)
-					{
-						listener_under_media= true;
-					}
+					listener_under_media= true;
 				}
 			}
-			
-			if (source_under_media)
+		}
+		
+		if (source_under_media)
+		{
+			if (!listener_under_media || source_polygon->media_index!=listener_polygon->media_index)
 			{
-				if (!listener_under_media || source_polygon->media_index!=listener_polygon->media_index)
-				{
-					flags|= _sound_was_media_obstructed;
-				}
-				else
-				{
-					flags|= _sound_was_media_muffled;
-				}
+				flags|= _sound_was_media_obstructed;
 			}
 			else
 			{
-				if (listener_under_media)
-				{
-					flags|= _sound_was_media_obstructed;
-				}
+				flags|= _sound_was_media_muffled;
+			}
+		}
+		else
+		{
+			if (listener_under_media)
+			{
+				flags|= _sound_was_media_obstructed;
 			}
 		}
 	}
-	
+
 	return flags;
 }
 
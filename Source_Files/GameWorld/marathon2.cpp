@@ -120,6 +120,7 @@ Feb 8, 2003 (Woody Zenfell):
 #include "Statistics.h"
 
 #include "motion_sensor.h"
+#include "overhead_map.h"
 
 #include <limits.h>
 #include <thread>
@@ -660,6 +661,9 @@ bool entering_map(bool restoring_saved)
 {
 	bool success= true;
 
+	/* the overhead map's retained geometry belongs to the previous level */
+	InvalidateOverheadMapGeometry();
+
 	/* if any active monsters think they have paths, we'll make them reconsider */
 	initialize_monsters_for_new_level();
 
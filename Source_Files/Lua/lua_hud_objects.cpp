@@ -909,6 +909,7 @@ const luaL_Reg Lua_Font_Set[] = {
 
 static int Lua_Font_GC(lua_State *L)
 {
+	Lua_HUDInstance()->forget_font(Lua_Font::Object(L, 1));
 	delete Lua_Font::Object(L, 1);
 	Lua_Font::Invalidate(L, Lua_Font::Index(L, 1));
 	return 0;
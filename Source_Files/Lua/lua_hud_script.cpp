@@ -78,7 +78,8 @@ class LuaHUDState
 {
 public:
 	LuaHUDState() : running_(false), inited_(false), num_scripts_(0) {
-		state_.reset(luaL_newstate(), lua_close);
+		state_.reset(L_New_State(true), L_Close_State);
+		L_Set_State_Name(State(), "HUD Lua");
 	}
 
 	virtual ~LuaHUDState() {
@@ -32,6 +32,7 @@ LUA_MAP.CPP
 #include "lightsource.h"
 #include "map.h"
 #include "media.h"
+#include "overhead_map.h"
 #include "platforms.h"
 #include "player.h"
 #include "projectile_definitions.h"
@@ -742,6 +743,7 @@ static int Lua_Polygon_Floor_Set_Height(lua_State *L)
 		recalculate_redundant_endpoint_data(polygon->endpoint_indexes[i]);
 		recalculate_redundant_line_data(polygon->line_indexes[i]);
 	}
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -801,6 +803,7 @@ static int Lua_Polygon_Floor_Set_Transfer_Mode(lua_State *L)
 {
 	polygon_data *polygon = get_polygon_data(Lua_Polygon_Floor::Index(L, 1));
 	polygon->floor_transfer_mode = Lua_TransferMode::ToIndex(L, 2);
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -896,6 +899,7 @@ static int Lua_Polygon_Ceiling_Set_Height(lua_State *L)
 		recalculate_redundant_endpoint_data(polygon->endpoint_indexes[i]);
 		recalculate_redundant_line_data(polygon->line_indexes[i]);
 	}
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -955,6 +959,7 @@ static int Lua_Polygon_Ceiling_Set_Transfer_Mode(lua_State *L)
 {
 	polygon_data *polygon = get_polygon_data(Lua_Polygon_Ceiling::Index(L, 1));
 	polygon->ceiling_transfer_mode = Lua_TransferMode::ToIndex(L, 2);
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -1290,6 +1295,7 @@ int Lua_Polygon_Change_Height(lua_State* L)
 			recalculate_redundant_line_data(polygon->line_indexes[i]);
 			recalculate_redundant_endpoint_data(polygon->endpoint_indexes[i]);
 		}
+		InvalidateOverheadMapGeometry();
 	}
 
 	lua_pushboolean(L, success);
@@ -1711,6 +1717,7 @@ static int Lua_Polygon_Set_Media(lua_State *L)
 	}
 
 	polygon->media_index = media_index;
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 		
@@ -1721,6 +1728,7 @@ static int Lua_Polygon_Set_Permutation(lua_State *L)
 	
 	int permutation = static_cast<int>(lua_tonumber(L, 2));
 	get_polygon_data(Lua_Polygon::Index(L, 1))->permutation = permutation;
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -1728,6 +1736,7 @@ static int Lua_Polygon_Set_Type(lua_State *L)
 {
 	polygon_data* polygon = get_polygon_data(Lua_Polygon::Index(L, 1));
 	polygon->type = Lua_PolygonType::ToIndex(L, 2);
+	InvalidateOverheadMapGeometry();
 	return 0;
 }
 
@@ -53,17 +53,34 @@ bool Lua_MonsterClass_Valid(int32 index)
 char Lua_MonsterClasses_Name[] = "MonsterClasses";
 typedef L_EnumContainer<Lua_MonsterClasses_Name, Lua_MonsterClass> Lua_MonsterClasses;
 
+// classes are bit flags, so resume from the bit after the last one
 template<>
 int L_Container<Lua_MonsterClasses_Name, Lua_MonsterClass>::_iterator(lua_State *L)
 {
-	int32 index = static_cast<int32>(lua_tonumber(L, lua_upvalueindex(1)));
+	bool direct = lua_isnone(L, 2);
+	int32 index = 0;
+	if (direct)
+	{
+		index = static_cast<int32>(lua_tonumber(L, lua_upvalueindex(1)));
+	}
+	else if (!lua_isnil(L, 2))
+	{
+		int32 last = Lua_MonsterClass::Index(L, 2);
+		while (last > 1 << index)
+			++index;
+		++index;
+	}
+	
 	while (index < Length())
 	{
 		if (Lua_MonsterClass::Valid(1 << index))
 		{
 			Lua_MonsterClass::Push(L, 1 << index);
-			lua_pushnumber(L, ++index);
-			lua_replace(L, lua_upvalueindex(1));
+			if (direct)
+			{
+				lua_pushnumber(L, index + 1);
+				lua_replace(L, lua_upvalueindex(1));
+			}
 			return 1;
 		}
 		else
@@ -1128,8 +1145,84 @@ int Lua_Monsters_New(lua_State *L)
 	return 1;
 }
 
+// Monsters.snapshot([t])
+// fills t with parallel arrays describing every valid monster, reusing the
+// arrays of an earlier snapshot, so per-tick scans don't churn the GC
+int Lua_Monsters_Snapshot(lua_State *L)
+{
+	static const char *fields[] = { "monster", "x", "y", "z", "polygon", "vitality" };
+	static const int num_fields = sizeof(fields) / sizeof(fields[0]);
+	
+	if (lua_isnoneornil(L, 1))
+		lua_newtable(L);
+	else if (lua_istable(L, 1))
+		lua_pushvalue(L, 1);
+	else
+		return luaL_error(L, "snapshot: incorrect argument type");
+	int t = lua_gettop(L);
+	
+	lua_getfield(L, t, "count");
+	int old_count = lua_isnumber(L, -1) ? static_cast<int>(lua_tonumber(L, -1)) : 0;
+	lua_pop(L, 1);
+	
+	// the arrays end up at t + 1 .. t + num_fields
+	for (int f = 0; f < num_fields; ++f)
+	{
+		lua_getfield(L, t, fields[f]);
+		if (!lua_istable(L, -1))
+		{
+			lua_pop(L, 1);
+			lua_newtable(L);
+			lua_pushvalue(L, -1);
+			lua_setfield(L, t, fields[f]);
+		}
+	}
+	
+	int count = 0;
+	int32 length = Lua_Monsters::Length();
+	for (int32 i = 0; i < length; ++i)
+	{
+		if (!Lua_Monster::Valid(i))
+			continue;
+		
+		monster_data *monster = get_monster_data(i);
+		object_data *object = get_object_data(monster->object_index);
+		++count;
+		
+		Lua_Monster::Push(L, i);
+		lua_rawseti(L, t + 1, count);
+		lua_pushnumber(L, (double) object->location.x / WORLD_ONE);
+		lua_rawseti(L, t + 2, count);
+		lua_pushnumber(L, (double) object->location.y / WORLD_ONE);
+		lua_rawseti(L, t + 3, count);
+		lua_pushnumber(L, (double) object->location.z / WORLD_ONE);
+		lua_rawseti(L, t + 4, count);
+		Lua_Polygon::Push(L, object->polygon);
+		lua_rawseti(L, t + 5, count);
+		lua_pushnumber(L, monster->vitality);
+		lua_rawseti(L, t + 6, count);
+	}
+	
+	// drop what's left of a bigger snapshot
+	for (int i = count + 1; i <= old_count; ++i)
+	{
+		for (int f = 0; f < num_fields; ++f)
+		{
+			lua_pushnil(L);
+			lua_rawseti(L, t + 1 + f, i);
+		}
+	}
+	
+	lua_pushnumber(L, count);
+	lua_setfield(L, t, "count");
+	
+	lua_settop(L, t);
+	return 1;
+}
+
 const luaL_Reg Lua_Monsters_Methods[] = {
 	{"new", L_TableFunction<Lua_Monsters_New>},
+	{"snapshot", L_TableFunction<Lua_Monsters_Snapshot>},
 	{0, 0}
 };
 
@@ -69,6 +69,8 @@ extern "C"
 #include "lualib.h"
 }
 
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <string>
 #include <stdlib.h>
@@ -185,12 +187,82 @@ void* L_Persistent_Table_Key()
 std::map<int, std::string> PassedLuaState;
 std::map<int, std::string> SavedLuaState;
 
+// the functions in the Triggers table the engine calls
+enum LuaTrigger {
+	_trigger_init,
+	_trigger_idle,
+	_trigger_cleanup,
+	_trigger_postidle,
+	_trigger_start_refuel,
+	_trigger_end_refuel,
+	_trigger_tag_switch,
+	_trigger_light_switch,
+	_trigger_platform_switch,
+	_trigger_projectile_switch,
+	_trigger_terminal_enter,
+	_trigger_terminal_exit,
+	_trigger_pattern_buffer,
+	_trigger_got_item,
+	_trigger_light_activated,
+	_trigger_platform_activated,
+	_trigger_player_revived,
+	_trigger_player_killed,
+	_trigger_monster_killed,
+	_trigger_monster_damaged,
+	_trigger_player_damaged,
+	_trigger_projectile_detonated,
+	_trigger_projectile_created,
+	_trigger_item_created,
+	NUMBER_OF_LUA_TRIGGERS
+};
+
+static const char *lua_trigger_names[NUMBER_OF_LUA_TRIGGERS] = {
+	"init",
+	"idle",
+	"cleanup",
+	"postidle",
+	"start_refuel",
+	"end_refuel",
+	"tag_switch",
+	"light_switch",
+	"platform_switch",
+	"projectile_switch",
+	"terminal_enter",
+	"terminal_exit",
+	"pattern_buffer",
+	"got_item",
+	"light_activated",
+	"platform_activated",
+	"player_revived",
+	"player_killed",
+	"monster_killed",
+	"monster_damaged",
+	"player_damaged",
+	"projectile_detonated",
+	"projectile_created",
+	"item_created",
+};
+
+// time spent in each trigger, per script type; kept across levels
+struct LuaTriggerProfile {
+	uint32 calls = 0;
+	uint64 counts = 0; // SDL performance counter
+};
+typedef std::array<LuaTriggerProfile, NUMBER_OF_LUA_TRIGGERS> lua_trigger_profile;
+
+static bool lua_profiling = false;
+static bool lua_profiling_film = false; // started for a replay, reported to the log
+static std::map<ScriptType, lua_trigger_profile> lua_trigger_profiles;
+
+extern bool game_is_being_replayed();
+
 class LuaState
 {
 	friend bool CollectLuaStats(std::map<std::string, std::string>&, std::map<std::string, std::string>&);
 public:
-	LuaState() : running_(false), num_scripts_(0) {
-		state_.reset(luaL_newstate(), lua_close);
+	LuaState() : running_(false), num_scripts_(0), triggers_table_(nullptr), triggers_table_ref_(LUA_NOREF), profile_(nullptr), current_trigger_(_trigger_init) {
+		state_.reset(L_New_State(), L_Close_State);
+		std::fill_n(trigger_function_refs_, NUMBER_OF_LUA_TRIGGERS, LUA_NOREF);
 	}
 
 	virtual ~LuaState() {
@@ -206,6 +278,8 @@ public:
 	bool Matches(lua_State *state) { return state == State(); }
 	void MarkCollections(std::set<short>* collections);
 	void ExecuteCommand(const std::string& line);
+	void SetProfile(lua_trigger_profile* profile) { profile_ = profile; }
+	void SetName(const char* name) { L_Set_State_Name(State(), name); }
 	std::string SavePassed();
 	std::string SaveAll();
 
@@ -240,6 +314,15 @@ public:
 		lua_newtable(State());
 		lua_settable(State(), LUA_REGISTRYINDEX);
 
+		// intern the trigger names once, rather than on every call
+		lua_pushstring(State(), "Triggers");
+		triggers_ref_ = luaL_ref(State(), LUA_REGISTRYINDEX);
+		for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+		{
+			lua_pushstring(State(), lua_trigger_names[i]);
+			trigger_refs_[i] = luaL_ref(State(), LUA_REGISTRYINDEX);
+		}
+
 		RegisterFunctions();
 		LoadCompatibility();
 	}
@@ -249,7 +332,7 @@ public:
 	}
 
 protected:
-	bool GetTrigger(const char *trigger);
+	bool GetTrigger(LuaTrigger trigger);
 	void CallTrigger(int numArgs = 0);
 
 	virtual void RegisterFunctions();
@@ -297,6 +380,19 @@ public:
 private:
 	bool running_;
 	int num_scripts_;
+
+	int triggers_ref_;
+	int trigger_refs_[NUMBER_OF_LUA_TRIGGERS];
+
+	// the Triggers table last seen, and the functions last found in it
+	const void* triggers_table_;
+	int triggers_table_ref_;
+	int trigger_function_refs_[NUMBER_OF_LUA_TRIGGERS];
+
+	void InvalidateTriggers();
+
+	lua_trigger_profile* profile_;
+	LuaTrigger current_trigger_;
 };
 
 typedef LuaState EmbeddedLuaState;
@@ -315,39 +411,99 @@ public:
 	}
 };
 
-bool LuaState::GetTrigger(const char* trigger)
+// Trigger functions are cached as registry refs next to the script's own
+// Triggers table, which is left exactly as the script built it. Each call
+// still looks the trigger up with its interned key, so rawset, metatables
+// and pairs() behave as for any table; a cached ref is only used while it
+// is the function found there. Replacing Triggers itself drops every ref;
+// the table last seen is held in the registry, so its address can't be
+// reused.
+bool LuaState::GetTrigger(LuaTrigger trigger)
 {
 	if (!running_)
 		return false;
 
-	lua_getglobal(State(), "Triggers");
+	lua_rawgeti(State(), LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+	lua_rawgeti(State(), LUA_REGISTRYINDEX, triggers_ref_);
+	lua_gettable(State(), -2);
+	lua_remove(State(), -2);
 	if (!lua_istable(State(), -1))
 	{
 		lua_pop(State(), 1);
 		return false;
 	}
 
-	lua_pushstring(State(), trigger);
+	if (lua_topointer(State(), -1) != triggers_table_)
+	{
+		InvalidateTriggers();
+		luaL_unref(State(), LUA_REGISTRYINDEX, triggers_table_ref_);
+		triggers_table_ = lua_topointer(State(), -1);
+		lua_pushvalue(State(), -1);
+		triggers_table_ref_ = luaL_ref(State(), LUA_REGISTRYINDEX);
+	}
+
+	lua_rawgeti(State(), LUA_REGISTRYINDEX, trigger_refs_[trigger]);
 	lua_gettable(State(), -2);
+	lua_remove(State(), -2);
 	if (!lua_isfunction(State(), -1))
 	{
-		lua_pop(State(), 2);
+		lua_pop(State(), 1);
 		return false;
 	}
 
-	lua_remove(State(), -2);
+	int& ref = trigger_function_refs_[trigger];
+	if (ref != LUA_NOREF)
+	{
+		lua_rawgeti(State(), LUA_REGISTRYINDEX, ref);
+		bool current = lua_rawequal(State(), -1, -2);
+		lua_pop(State(), 1);
+		if (!current)
+		{
+			luaL_unref(State(), LUA_REGISTRYINDEX, ref);
+			ref = LUA_NOREF;
+		}
+	}
+
+	if (ref == LUA_NOREF)
+	{
+		lua_pushvalue(State(), -1);
+		ref = luaL_ref(State(), LUA_REGISTRYINDEX);
+	}
+
+	current_trigger_ = trigger;
 	return true;
 }
 
+void LuaState::InvalidateTriggers()
+{
+	for (int& ref : trigger_function_refs_)
+	{
+		luaL_unref(State(), LUA_REGISTRYINDEX, ref);
+		ref = LUA_NOREF;
+	}
+}
+
 void LuaState::CallTrigger(int numArgs)
 {
+	if (lua_profiling && profile_)
+	{
+		// triggers can fire from inside other triggers; times are inclusive
+		LuaTriggerProfile& profile = (*profile_)[current_trigger_];
+		uint64 start = SDL_GetPerformanceCounter();
+		if (lua_pcall(State(), numArgs, 0, 0) == LUA_ERRRUN)
+			L_Error(lua_tostring(State(), -1));
+		profile.counts += SDL_GetPerformanceCounter() - start;
+		++profile.calls;
+		return;
+	}
+	
 	if (lua_pcall(State(), numArgs, 0, 0) == LUA_ERRRUN)
 		L_Error(lua_tostring(State(), -1));
 }
 
 void LuaState::Init(bool fRestoringSaved)
 {
-	if (GetTrigger("init"))
+	if (GetTrigger(_trigger_init))
 	{
 		lua_pushboolean(State(), fRestoringSaved);
 		CallTrigger(1);
@@ -356,25 +512,25 @@ void LuaState::Init(bool fRestoringSaved)
 
 void LuaState::Idle()
 {
-	if (GetTrigger("idle"))
+	if (GetTrigger(_trigger_idle))
 		CallTrigger();
 }
 
 void LuaState::Cleanup()
 {
-	if (GetTrigger("cleanup"))
+	if (GetTrigger(_trigger_cleanup))
 		CallTrigger();
 }
 
 void LuaState::PostIdle()
 {
-	if (GetTrigger("postidle"))
+	if (GetTrigger(_trigger_postidle))
 		CallTrigger();
 }
 
 void LuaState::StartRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("start_refuel"))
+	if (GetTrigger(_trigger_start_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -385,7 +541,7 @@ void LuaState::StartRefuel(short type, short player_index, short panel_side_inde
 
 void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("end_refuel"))
+	if (GetTrigger(_trigger_end_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -396,7 +552,7 @@ void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 
 void LuaState::TagSwitch(short tag, short player_index, short side_index)
 {
-	if (GetTrigger("tag_switch"))
+	if (GetTrigger(_trigger_tag_switch))
 	{
 		Lua_Tag::Push(State(), tag);
 		Lua_Player::Push(State(), player_index);
@@ -407,7 +563,7 @@ void LuaState::TagSwitch(short tag, short player_index, short side_index)
 
 void LuaState::LightSwitch(short light, short player_index, short side_index)
 {
-	if (GetTrigger("light_switch"))
+	if (GetTrigger(_trigger_light_switch))
 	{
 		Lua_Light::Push(State(), light);
 		Lua_Player::Push(State(), player_index);
@@ -418,7 +574,7 @@ void LuaState::LightSwitch(short light, short player_index, short side_index)
 
 void LuaState::PlatformSwitch(short platform, short player_index, short side_index)
 {
-	if (GetTrigger("platform_switch"))
+	if (GetTrigger(_trigger_platform_switch))
 	{
 		Lua_Polygon::Push(State(), platform);
 		Lua_Player::Push(State(), player_index);
@@ -429,7 +585,7 @@ void LuaState::PlatformSwitch(short platform, short player_index, short side_ind
 
 void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 {
-	if (GetTrigger("projectile_switch"))
+	if (GetTrigger(_trigger_projectile_switch))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		Lua_Side::Push(State(), side_index);
@@ -439,7 +595,7 @@ void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 
 void LuaState::TerminalEnter(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_enter"))
+	if (GetTrigger(_trigger_terminal_enter))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -449,7 +605,7 @@ void LuaState::TerminalEnter(short terminal_id, short player_index)
 
 void LuaState::TerminalExit(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_exit"))
+	if (GetTrigger(_trigger_terminal_exit))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -459,7 +615,7 @@ void LuaState::TerminalExit(short terminal_id, short player_index)
 
 void LuaState::PatternBuffer(short side_index, short player_index)
 {
-	if (GetTrigger("pattern_buffer"))
+	if (GetTrigger(_trigger_pattern_buffer))
 	{
 		Lua_Side::Push(State(), side_index);
 		Lua_Player::Push(State(), player_index);
@@ -469,7 +625,7 @@ void LuaState::PatternBuffer(short side_index, short player_index)
 
 void LuaState::GotItem(short type, short player_index)
 {
-	if (GetTrigger("got_item"))
+	if (GetTrigger(_trigger_got_item))
 	{
 		Lua_ItemType::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -479,7 +635,7 @@ void LuaState::GotItem(short type, short player_index)
 
 void LuaState::LightActivated(short index)
 {
-	if (GetTrigger("light_activated"))
+	if (GetTrigger(_trigger_light_activated))
 	{
 		Lua_Light::Push(State(), index);
 		CallTrigger(1);
@@ -488,7 +644,7 @@ void LuaState::LightActivated(short index)
 
 void LuaState::PlatformActivated(short index)
 {
-	if (GetTrigger("platform_activated"))
+	if (GetTrigger(_trigger_platform_activated))
 	{
 		Lua_Polygon::Push(State(), index);
 		CallTrigger(1);
@@ -497,7 +653,7 @@ void LuaState::PlatformActivated(short index)
 
 void LuaState::PlayerRevived (short player_index)
 {
-	if (GetTrigger("player_revived"))
+	if (GetTrigger(_trigger_player_revived))
 	{
 		Lua_Player::Push(State(), player_index);
 		CallTrigger(1);
@@ -506,7 +662,7 @@ void LuaState::PlayerRevived (short player_index)
 
 void LuaState::PlayerKilled (short player_index, short aggressor_player_index, short action, short projectile_index)
 {
-	if (GetTrigger("player_killed"))
+	if (GetTrigger(_trigger_player_killed))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -527,7 +683,7 @@ void LuaState::PlayerKilled (short player_index, short aggressor_player_index, s
 
 void LuaState::MonsterKilled (short monster_index, short aggressor_player_index, short projectile_index)
 {
-	if (GetTrigger("monster_killed"))
+	if (GetTrigger(_trigger_monster_killed))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_player_index != -1)
@@ -546,7 +702,7 @@ void LuaState::MonsterKilled (short monster_index, short aggressor_player_index,
 
 void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("monster_damaged"))
+	if (GetTrigger(_trigger_monster_damaged))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_monster_index != -1) 
@@ -569,7 +725,7 @@ void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index
 
 void LuaState::PlayerDamaged (short player_index, short aggressor_player_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("player_damaged"))
+	if (GetTrigger(_trigger_player_damaged))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -597,7 +753,7 @@ void LuaState::PlayerDamaged (short player_index, short aggressor_player_index,
 
 void LuaState::ProjectileDetonated(short type, short owner_index, short polygon, world_point3d location, uint16_t flags, int16_t obstruction_index, int16_t line_index) 
 {
-	if (GetTrigger("projectile_detonated"))
+	if (GetTrigger(_trigger_projectile_detonated))
 	{
 		Lua_ProjectileType::Push(State(), type);
 		if (owner_index != -1)
@@ -646,7 +802,7 @@ void LuaState::ProjectileDetonated(short type, short owner_index, short polygon,
 
 void LuaState::ProjectileCreated (short projectile_index)
 {
-	if (GetTrigger("projectile_created"))
+	if (GetTrigger(_trigger_projectile_created))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		CallTrigger(1);
@@ -655,7 +811,7 @@ void LuaState::ProjectileCreated (short projectile_index)
 
 void LuaState::ItemCreated (short item_index)
 {
-	if (GetTrigger("item_created"))
+	if (GetTrigger(_trigger_item_created))
 	{
 		Lua_Item::Push(State(), item_index);
 		CallTrigger(1);
@@ -705,6 +861,244 @@ void LuaState::InvalidateEphemera(short ephemera_index)
 	Lua_Ephemera::Invalidate(State(), ephemera_index);
 }
 
+// Each state allocates through its own pool: small blocks come from size
+// classes carved out of large chunks, so the collector's churn doesn't hit
+// the system allocator, and every byte is counted against its state
+class LuaPool
+{
+public:
+	LuaPool() : name("Lua"), L(nullptr), bytes(0), peak_bytes(0), cycles(0), live_after_cycle(0), idle_steps(0), idle_counts(0), max_idle_counts(0), collect_in_idle_time(false), closing(false), cursor_(nullptr), end_(nullptr) {
+		for (int i = 0; i < NUMBER_OF_SIZE_CLASSES; ++i)
+			free_[i] = nullptr;
+	}
+	
+	~LuaPool() {
+		for (char* chunk : chunks_)
+			free(chunk);
+	}
+	
+	static void* Alloc(void* ud, void* ptr, size_t osize, size_t nsize);
+	
+	const char* name;
+	lua_State* L;
+	
+	size_t bytes;
+	size_t peak_bytes;
+	uint32 cycles;
+	size_t live_after_cycle;
+	uint32 idle_steps;
+	uint64 idle_counts; // SDL performance counter
+	uint64 max_idle_counts;
+	bool collect_in_idle_time;
+	bool closing;
+
+private:
+	static const size_t GRANULARITY = 16;
+	static const size_t MAX_POOLED_SIZE = 256;
+	static const int NUMBER_OF_SIZE_CLASSES = MAX_POOLED_SIZE / GRANULARITY;
+	static const size_t CHUNK_SIZE = 64 * 1024;
+	
+	static int size_class(size_t size) { return static_cast<int>((size - 1) / GRANULARITY); }
+	
+	void* allocate(size_t size);
+	void release(void* ptr, size_t size);
+	
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+	FreeBlock* free_[NUMBER_OF_SIZE_CLASSES];
+	
+	std::vector<char*> chunks_;
+	char* cursor_;
+	char* end_;
+};
+
+void* LuaPool::allocate(size_t size)
+{
+	if (size > MAX_POOLED_SIZE)
+		return malloc(size);
+	
+	int c = size_class(size);
+	if (free_[c])
+	{
+		FreeBlock* block = free_[c];
+		free_[c] = block->next;
+		return block;
+	}
+	
+	size_t rounded = (c + 1) * GRANULARITY;
+	if (static_cast<size_t>(end_ - cursor_) < rounded)
+	{
+		// the tail of the old chunk is too small to matter
+		char* chunk = static_cast<char*>(malloc(CHUNK_SIZE));
+		if (!chunk)
+			return nullptr;
+		chunks_.push_back(chunk);
+		cursor_ = chunk;
+		end_ = chunk + CHUNK_SIZE;
+	}
+	
+	void* ptr = cursor_;
+	cursor_ += rounded;
+	return ptr;
+}
+
+void LuaPool::release(void* ptr, size_t size)
+{
+	if (size > MAX_POOLED_SIZE)
+	{
+		free(ptr);
+		return;
+	}
+	
+	FreeBlock* block = static_cast<FreeBlock*>(ptr);
+	int c = size_class(size);
+	block->next = free_[c];
+	free_[c] = block;
+}
+
+// lua_Alloc: Lua passes the old size of every block it frees or resizes
+void* LuaPool::Alloc(void* ud, void* ptr, size_t osize, size_t nsize)
+{
+	LuaPool* pool = static_cast<LuaPool*>(ud);
+	if (!ptr)
+		osize = 0; // it's a type tag
+	
+	void* result = nullptr;
+	if (nsize == 0)
+	{
+		if (ptr)
+			pool->release(ptr, osize);
+	}
+	else if (!ptr)
+	{
+		result = pool->allocate(nsize);
+	}
+	else if (osize > MAX_POOLED_SIZE && nsize > MAX_POOLED_SIZE)
+	{
+		result = realloc(ptr, nsize);
+	}
+	else if (osize <= MAX_POOLED_SIZE && nsize <= MAX_POOLED_SIZE && size_class(osize) == size_class(nsize))
+	{
+		result = ptr;
+	}
+	else
+	{
+		result = pool->allocate(nsize);
+		if (result)
+		{
+			memcpy(result, ptr, std::min(osize, nsize));
+			pool->release(ptr, osize);
+		}
+		else if (nsize <= osize)
+		{
+			// shrinking must not fail; keep the old block
+			return ptr;
+		}
+	}
+	
+	if (nsize == 0 || result)
+	{
+		pool->bytes = pool->bytes + nsize - osize;
+		pool->peak_bytes = std::max(pool->peak_bytes, pool->bytes);
+	}
+	return result;
+}
+
+static std::set<LuaPool*> lua_pools;
+
+static int L_Panic(lua_State* L)
+{
+	logFatal("PANIC: unprotected error in call to Lua API (%s)", lua_tostring(L, -1));
+	return 0;
+}
+
+// A finalizer-only userdata that gets collected, and replaced, once per
+// collection cycle
+static int L_Cycle_Sentinel(lua_State* L);
+
+static void L_New_Cycle_Sentinel(lua_State* L)
+{
+	lua_newuserdata(L, 1);
+	lua_newtable(L);
+	lua_pushcfunction(L, L_Cycle_Sentinel);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+}
+
+static int L_Cycle_Sentinel(lua_State* L)
+{
+	void* ud;
+	lua_getallocf(L, &ud);
+	LuaPool* pool = static_cast<LuaPool*>(ud);
+	if (!pool->closing)
+	{
+		++pool->cycles;
+		pool->live_after_cycle = pool->bytes;
+		L_New_Cycle_Sentinel(L);
+	}
+	return 0;
+}
+
+lua_State* L_New_State(bool collect_in_idle_time)
+{
+	LuaPool* pool = new LuaPool;
+	pool->collect_in_idle_time = collect_in_idle_time;
+	lua_State* L = lua_newstate(LuaPool::Alloc, pool);
+	if (!L)
+	{
+		delete pool;
+		return nullptr;
+	}
+	
+	lua_atpanic(L, L_Panic);
+	pool->L = L;
+	lua_pools.insert(pool);
+	L_New_Cycle_Sentinel(L);
+	return L;
+}
+
+void L_Close_State(lua_State* L)
+{
+	void* ud;
+	lua_getallocf(L, &ud);
+	LuaPool* pool = static_cast<LuaPool*>(ud);
+	pool->closing = true;
+	lua_close(L);
+	lua_pools.erase(pool);
+	delete pool;
+}
+
+void L_Set_State_Name(lua_State* L, const char* name)
+{
+	void* ud;
+	lua_getallocf(L, &ud);
+	static_cast<LuaPool*>(ud)->name = name;
+}
+
+// Called when the main loop has time to spare before the next frame. Once a
+// state is halfway from its last live size to the point where an automatic
+// cycle would start, the collector's work is done here, one step per call,
+// instead of in the middle of a tick. Game scripts are left to their own
+// collector, which runs in step with the ticks on every machine
+void L_Idle_Collect_Garbage()
+{
+	for (LuaPool* pool : lua_pools)
+	{
+		if (!pool->collect_in_idle_time || pool->bytes < pool->live_after_cycle + pool->live_after_cycle / 2)
+			continue;
+		
+		uint64 start = SDL_GetPerformanceCounter();
+		lua_gc(pool->L, LUA_GCSTEP, 0);
+		uint64 counts = SDL_GetPerformanceCounter() - start;
+		
+		++pool->idle_steps;
+		pool->idle_counts += counts;
+		pool->max_idle_counts = std::max(pool->max_idle_counts, counts);
+	}
+}
+
 static char L_SEARCH_PATH_KEY[] = "search_path";
 
 void L_Set_Search_Path(lua_State* L, const std::string& path)
@@ -991,8 +1385,7 @@ int LuaState::RestoreAll(const std::string& s)
 		return 1;
 	}
 
-	std::stringbuf sb(s);
-	if (lua_restore(State(), &sb))
+	if (lua_restore(State(), s.data(), s.size()))
 	{
 		lua_pushlightuserdata(State(), L_Persistent_Table_Key());
 		lua_insert(State(), -2);
@@ -1016,8 +1409,7 @@ int LuaState::RestorePassed(const std::string& s)
 		return 1;
 	}
 
-	std::stringbuf sb(s);
-	if (lua_restore(State(), &sb))
+	if (lua_restore(State(), s.data(), s.size()))
 	{
 		lua_pushlightuserdata(State(), L_Persistent_Table_Key());
 		lua_gettable(State(), LUA_REGISTRYINDEX);
@@ -1058,11 +1450,7 @@ std::string LuaState::SaveAll()
 	lua_pushnil(State());
 	lua_setfield(State(), -2, Lua_Ephemera_Name);
 
-	std::stringbuf sb;
-	if (lua_save(State(), &sb))
-	{
-		retval = sb.str();
-	}
+	lua_save(State(), retval);
 
 	// restore the ephemera fields
 	lua_pushlightuserdata(State(), const_cast<char*>(&key));
@@ -1089,15 +1477,9 @@ std::string LuaState::SavePassed()
 	
 	lua_remove(State(), -2);
 
-	std::stringbuf sb;
-	if (lua_save(State(), &sb))
-	{
-		return sb.str();
-	} 
-	else
-	{
-		return std::string();
-	}
+	std::string retval;
+	lua_save(State(), retval);
+	return retval;
 }
 
 typedef std::map<ScriptType, std::unique_ptr<LuaState>> state_map;
@@ -1768,19 +2150,133 @@ static int L_Prompt(lua_State *L)
 
 
 
+static const char *script_type_name(ScriptType script_type)
+{
+	switch (script_type) {
+		case _embedded_lua_script:
+			return "Map Lua";
+		case _lua_netscript:
+			return "Netscript";
+		case _solo_lua_script:
+			return "Solo Lua";
+		case _stats_lua_script:
+			return "Stats Lua";
+	}
+	return "level_script";
+}
+
+// one line per trigger that has run, busiest first
+static std::vector<std::string> lua_profile_report()
+{
+	struct row {
+		ScriptType script_type;
+		int trigger;
+		LuaTriggerProfile profile;
+	};
+	
+	std::vector<row> rows;
+	for (const auto& it : lua_trigger_profiles)
+	{
+		for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+		{
+			if (it.second[i].calls)
+				rows.push_back({ it.first, i, it.second[i] });
+		}
+	}
+	std::sort(rows.begin(), rows.end(), [](const row& a, const row& b) {
+		return a.profile.counts > b.profile.counts;
+	});
+
+	double ms_per_count = 1000.0 / SDL_GetPerformanceFrequency();
+	std::vector<std::string> report;
+	for (const row& r : rows)
+	{
+		double ms = r.profile.counts * ms_per_count;
+		char line[256];
+		snprintf(line, sizeof(line), "%s %s: %u calls, %.2f ms (%.1f us/call)", script_type_name(r.script_type), lua_trigger_names[r.trigger], r.profile.calls, ms, ms * 1000.0 / r.profile.calls);
+		report.push_back(line);
+	}
+	
+	for (const LuaPool* pool : lua_pools)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "%s memory: %zu KB (peak %zu KB), %u collections, %u idle GC steps taking %.2f ms (max %.2f ms)", pool->name, pool->bytes / 1024, pool->peak_bytes / 1024, pool->cycles, pool->idle_steps, pool->idle_counts * ms_per_count, pool->max_idle_counts * ms_per_count);
+		report.push_back(line);
+	}
+	
+	return report;
+}
+
+struct start_lua_profile
+{
+	void operator()(const std::string&) const {
+		// states point into the map, so reset the entries in place
+		for (auto& it : lua_trigger_profiles)
+			it.second.fill(LuaTriggerProfile());
+		lua_profiling = true;
+		screen_printf("Lua trigger profiling started");
+	}
+};
+
+struct stop_lua_profile
+{
+	void operator()(const std::string&) const {
+		lua_profiling = false;
+		screen_printf("Lua trigger profiling stopped");
+	}
+};
+
+struct report_lua_profile
+{
+	void operator()(const std::string&) const {
+		std::vector<std::string> report = lua_profile_report();
+		if (report.empty())
+			screen_printf("No Lua triggers have been profiled");
+		for (const std::string& line : report)
+			screen_printf("%s", line.c_str());
+	}
+};
+
+static void register_lua_profile_commands()
+{
+	static bool registered = false;
+	if (registered)
+		return;
+	
+	CommandParser profileParser;
+	profileParser.register_command("start", start_lua_profile());
+	profileParser.register_command("stop", stop_lua_profile());
+	profileParser.register_command("report", report_lua_profile());
+	Console::instance()->register_command("profile", profileParser);
+	registered = true;
+}
+
 static std::unique_ptr<LuaState> LuaStateFactory(ScriptType script_type)
 {
+	register_lua_profile_commands();
+	
+	std::unique_ptr<LuaState> state;
 	switch (script_type) {
 	case _embedded_lua_script:
-        return std::make_unique<EmbeddedLuaState>();
+        state = std::make_unique<EmbeddedLuaState>();
+        break;
 	case _lua_netscript:
-        return std::make_unique<NetscriptState>();
+        state = std::make_unique<NetscriptState>();
+        break;
 	case _solo_lua_script:
-        return std::make_unique<SoloScriptState>();
+        state = std::make_unique<SoloScriptState>();
+        break;
 	case _stats_lua_script:
-        return std::make_unique<StatsLuaState>();
+        state = std::make_unique<StatsLuaState>();
+        break;
 	}
-    return nullptr;
+	
+	if (state)
+	{
+		state->SetProfile(&lua_trigger_profiles[script_type]);
+		state->SetName(script_type_name(script_type));
+	}
+    return state;
 }
 
 bool LoadLuaScript(const char *buffer, size_t len, ScriptType script_type)
@@ -1791,22 +2287,7 @@ bool LoadLuaScript(const char *buffer, size_t len, ScriptType script_type)
 		states.insert({ script_type, LuaStateFactory(script_type) });
 		states[script_type]->Initialize();
 	}
-	const char *desc = "level_script";
-	switch (script_type) {
-		case _embedded_lua_script:
-			desc = "Map Lua";
-			break;
-		case _lua_netscript:
-			desc = "Netscript";
-			break;
-		case _solo_lua_script:
-			desc = "Solo Lua";
-			break;
-		case _stats_lua_script:
-			desc = "Stats Lua";
-			break;
-	}
-	return states[script_type]->Load(buffer, len, desc);
+	return states[script_type]->Load(buffer, len, script_type_name(script_type));
 }
 
 #ifdef HAVE_OPENGL
@@ -1864,6 +2345,15 @@ bool RunLuaScript()
 		running |= it->second->Run();
 	}
 
+	// films always get a per-level trigger profile in the log, unless one
+	// was already started from the console
+	if (running && game_is_being_replayed() && !lua_profiling)
+	{
+		for (auto& it : lua_trigger_profiles)
+			it.second.fill(LuaTriggerProfile());
+		lua_profiling = lua_profiling_film = true;
+	}
+
 	return running;
 }
 
@@ -2071,6 +2561,16 @@ void LoadReplayNetLua()
 
 void CloseLuaScript()
 {
+	if (lua_profiling_film)
+	{
+		std::vector<std::string> report = lua_profile_report();
+		if (report.size())
+			logSummary("Lua trigger profile for %s:", mac_roman_to_utf8(static_world->level_name).c_str());
+		for (const std::string& line : report)
+			logSummary("  %s", line.c_str());
+		lua_profiling = lua_profiling_film = false;
+	}
+	
 	// save variables for going into next level
 	PassedLuaState.clear();
 	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
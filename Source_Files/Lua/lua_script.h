@@ -98,6 +98,9 @@ ActionQueues* GetLuaActionQueues();
 
 void MarkLuaCollections(bool active);
 
+// runs the HUD Lua collector in spare frame time
+void L_Idle_Collect_Garbage();
+
 void LuaTexturePaletteClear();
 int LuaTexturePaletteSize();
 shape_descriptor LuaTexturePaletteTexture(size_t);
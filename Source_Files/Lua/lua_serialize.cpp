@@ -26,8 +26,27 @@ LUA_SERIALIZE.CPP
 
 #include "BStream.h"
 
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/stream_buffer.hpp>
+namespace io = boost::iostreams;
+
+// Version 1 is written depth first through a BStream, one recursive call per
+// value; version 2 is written into a flat buffer by an explicit work list,
+// shares repeated strings, and stores the numeric array part of each table
+// in bulk. Version 1 data can still be restored.
 const static int SAVED_REFERENCE_PSEUDOTYPE = -2;
-const uint16 kVersion = 1;
+const static int SAVED_STRING_REFERENCE_PSEUDOTYPE = -3;
+const uint16 kVersion = 2;
+
+// stack slots used for bookkeeping while saving or restoring
+enum {
+	kReferencesIndex = 1,
+	kStringsIndex = 2
+};
 
 static bool valid_key(int type)
 {
@@ -38,134 +57,296 @@ static bool valid_key(int type)
 		type == LUA_TUSERDATA);
 }
 
-static void save(lua_State *L, BOStreamBE& s, uint32& counter)
+class SaveBuffer
 {
-	// if the object has already been written, write a reference to it
+public:
+	explicit SaveBuffer(std::string& out) : m_out(out) { }
+
+	void write_int8(int8 v) { m_out.push_back(static_cast<char>(v)); }
+	void write_uint8(uint8 v) { m_out.push_back(static_cast<char>(v)); }
+	void write_uint16(uint16 v) {
+		char b[2] = { static_cast<char>(v >> 8), static_cast<char>(v) };
+		m_out.append(b, sizeof(b));
+	}
+	void write_uint32(uint32 v) {
+		char b[4] = { static_cast<char>(v >> 24), static_cast<char>(v >> 16),
+			      static_cast<char>(v >> 8), static_cast<char>(v) };
+		m_out.append(b, sizeof(b));
+	}
+	void write_double(double d) {
+		uint64 v;
+		memcpy(&v, &d, sizeof(v));
+		write_uint32(static_cast<uint32>(v >> 32));
+		write_uint32(static_cast<uint32>(v));
+	}
+	void write(const char* s, size_t n) { m_out.append(s, n); }
 
-	lua_pushvalue(L, -1);
-	lua_rawget(L, 1);
+private:
+	std::string& m_out;
+};
+
+class Saver
+{
+public:
+	Saver(lua_State* L, SaveBuffer& s) : L(L), s(s), m_objects(0), m_strings(0) { }
+
+	// writes the value on top of the stack
+	void save();
+
+private:
+	struct Frame {
+		int table;		// stack index of the table being walked
+		uint32 array_count;	// keys 1..array_count were written in bulk
+		enum { Next, Value, Pop } step;
+	};
+
+	void write_string(int index);
+	void emit();
+
+	lua_State* L;
+	SaveBuffer& s;
+	std::vector<Frame> m_frames;
+	uint32 m_objects;
+	uint32 m_strings;
+};
+
+void Saver::write_string(int index)
+{
+	lua_pushvalue(L, index);
+	lua_rawget(L, kStringsIndex);
 	if (!lua_isnil(L, -1))
 	{
-		s << static_cast<int8>(SAVED_REFERENCE_PSEUDOTYPE)
-		  << static_cast<uint32>(lua_tonumber(L, -1));
+		s.write_int8(SAVED_STRING_REFERENCE_PSEUDOTYPE);
+		s.write_uint32(static_cast<uint32>(lua_tonumber(L, -1)));
 		lua_pop(L, 1);
 		return;
 	}
 	lua_pop(L, 1);
 
-	s << static_cast<int8>(lua_type(L, -1));
-	switch (lua_type(L, -1))
+	lua_pushvalue(L, index);
+	lua_pushnumber(L, static_cast<lua_Number>(++m_strings));
+	lua_rawset(L, kStringsIndex);
+
+	size_t length;
+	const char* str = lua_tolstring(L, index, &length);
+	s.write_int8(LUA_TSTRING);
+	s.write_uint32(static_cast<uint32>(length));
+	s.write(str, length);
+}
+
+// writes and pops the value on top of the stack; a table seen for the first
+// time is instead left on the stack with a nil key above it, and a frame is
+// pushed to walk its contents
+void Saver::emit()
+{
+	int type = lua_type(L, -1);
+	if (type == LUA_TTABLE || type == LUA_TUSERDATA)
+	{
+		// if the object has already been written, write a reference to it
+		lua_pushvalue(L, -1);
+		lua_rawget(L, kReferencesIndex);
+		if (!lua_isnil(L, -1))
+		{
+			s.write_int8(SAVED_REFERENCE_PSEUDOTYPE);
+			s.write_uint32(static_cast<uint32>(lua_tonumber(L, -1)));
+			lua_pop(L, 2);
+			return;
+		}
+		lua_pop(L, 1);
+
+		// add to the reference table
+		lua_pushvalue(L, -1);
+		lua_pushnumber(L, static_cast<lua_Number>(++m_objects));
+		lua_rawset(L, kReferencesIndex);
+	}
+
+	switch (type)
 	{
 		case LUA_TNIL:
+			s.write_int8(LUA_TNIL);
 			break;
 		case LUA_TNUMBER:
-			{
-				s << static_cast<double>(lua_tonumber(L, -1));
-			}
+			s.write_int8(LUA_TNUMBER);
+			s.write_double(lua_tonumber(L, -1));
 			break;
 		case LUA_TBOOLEAN:
-			s << static_cast<uint8>(lua_toboolean(L, -1) ? 1 : 0);
+			s.write_int8(LUA_TBOOLEAN);
+			s.write_uint8(lua_toboolean(L, -1) ? 1 : 0);
 			break;
-		case LUA_TSTRING: 
-			{
-				s << static_cast<uint32>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
-			}
+		case LUA_TSTRING:
+			write_string(-1);
 			break;
 		case LUA_TTABLE:
 			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
+				if (!lua_checkstack(L, 4))
+				{
+					throw basic_bstream::failure("tables nested too deeply");
+				}
 
-				// write the reference
-				s << counter;
+				s.write_int8(LUA_TTABLE);
+				s.write_uint32(m_objects);
 
-				// write all k/v pairs
-				lua_pushnil(L);
-				while (lua_next(L, -2)) 
+				// the leading run of numbers is written without keys
+				uint32 count = 0;
+				for (;;)
 				{
-					if (valid_key(lua_type(L, -2))) {
-						// another key
-						lua_pushvalue(L, -2);
-						
-						save(L, s, counter);
-						lua_pop(L, 1);
-						
-						save(L, s, counter);
-						lua_pop(L, 1);
-					} else {
-						lua_pop(L, 1);
-					}
+					lua_rawgeti(L, -1, count + 1);
+					bool number = lua_type(L, -1) == LUA_TNUMBER;
+					lua_pop(L, 1);
+					if (!number)
+						break;
+					++count;
+				}
+
+				s.write_uint32(count);
+				for (uint32 i = 1; i <= count; ++i)
+				{
+					lua_rawgeti(L, -1, i);
+					s.write_double(lua_tonumber(L, -1));
+					lua_pop(L, 1);
 				}
 
+				Frame frame;
+				frame.table = lua_gettop(L);
+				frame.array_count = count;
+				frame.step = Frame::Next;
+				m_frames.push_back(frame);
+
 				lua_pushnil(L);
-				save(L, s, counter);
-				lua_pop(L, 1);
 			}
-			break;
+			return;
 		case LUA_TUSERDATA:
 			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
-
-				// write the reference
-				s << counter;
+				s.write_int8(LUA_TUSERDATA);
+				s.write_uint32(m_objects);
 
 				// assume that this is one of our userdata
 				lua_getmetatable(L, -1);
-				lua_gettable(L, LUA_REGISTRYINDEX);
-
-				s << static_cast<uint8>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
+				lua_rawget(L, LUA_REGISTRYINDEX);
+				if (lua_type(L, -1) != LUA_TSTRING)
+				{
+					lua_pop(L, 1);
+					lua_pushliteral(L, "");
+				}
+				write_string(-1);
 				lua_pop(L, 1);
 
 				lua_getfield(L, -1, "index");
-				
-				s << static_cast<uint32>(lua_tonumber(L, -1));
+				s.write_uint32(static_cast<uint32>(lua_tonumber(L, -1)));
 				lua_pop(L, 1);
 			}
 			break;
-		
 		default:
 			// we silently ignore other types
+			s.write_int8(LUA_TNIL);
 			break;
 	}
+
+	lua_pop(L, 1);
 }
 
-bool lua_save(lua_State *L, std::streambuf* sb)
+void Saver::save()
+{
+	lua_pushvalue(L, -1);
+	emit();
+
+	while (!m_frames.empty())
+	{
+		// stack: ... table key [value]
+		Frame& frame = m_frames.back();
+		switch (frame.step)
+		{
+			case Frame::Next:
+				if (!lua_next(L, frame.table))
+				{
+					// end of table
+					s.write_int8(LUA_TNIL);
+					lua_pop(L, 1);
+					m_frames.pop_back();
+					break;
+				}
+
+				if (!valid_key(lua_type(L, -2)) || !valid_key(lua_type(L, -1)))
+				{
+					lua_pop(L, 1);
+					break;
+				}
+
+				if (frame.array_count && lua_type(L, -2) == LUA_TNUMBER)
+				{
+					lua_Number n = lua_tonumber(L, -2);
+					if (n >= 1 && n <= frame.array_count && n == static_cast<uint32>(n))
+					{
+						lua_pop(L, 1);
+						break;
+					}
+				}
+
+				frame.step = Frame::Value;
+				lua_pushvalue(L, -2);
+				emit();
+				break;
+			case Frame::Value:
+				frame.step = Frame::Pop;
+				lua_pushvalue(L, -1);
+				emit();
+				break;
+			case Frame::Pop:
+				frame.step = Frame::Next;
+				lua_pop(L, 1);
+				break;
+		}
+	}
+}
+
+bool lua_save(lua_State *L, std::string& out)
 {
 	lua_assert(lua_gettop(L) == 1);
 
-	// create a references table
+	// create the references and strings tables, and put them at the
+	// bottom of the stack
 	lua_newtable(L);
-
-	// put it at the bottom of the stack
 	lua_insert(L, 1);
-	
-	uint32 counter = 0;
-	BOStreamBE s(sb);
-	try 
+	lua_newtable(L);
+	lua_insert(L, 2);
+
+	out.clear();
+	SaveBuffer s(out);
+	try
 	{
-		s << kVersion;
-		save(L, s, counter);
+		s.write_uint16(kVersion);
+		Saver(L, s).save();
 	}
 	catch (const basic_bstream::failure& e)
 	{
 		logWarning("failed to save Lua data; %s", e.what());
 		lua_settop(L, 0);
+		out.clear();
 		return false;
 	}
 
-	// remove the reference table
+	// remove the bookkeeping tables
 	lua_remove(L, 1);
+	lua_remove(L, 1);
+	return true;
+}
+
+bool lua_save(lua_State *L, std::streambuf* sb)
+{
+	std::string out;
+	if (!lua_save(L, out))
+		return false;
+
+	if (sb->sputn(out.data(), out.size()) != static_cast<std::streamsize>(out.size()))
+	{
+		logWarning("failed to save Lua data; write failed");
+		return false;
+	}
+
 	return true;
 }
 
-static int restore(lua_State *L, BIStreamBE& s)
+static int restore_v1(lua_State *L, BIStreamBE& s)
 {
 	int8 type;
 	s >> type;
@@ -207,10 +388,10 @@ static int restore(lua_State *L, BIStreamBE& s)
 				lua_pushvalue(L, -2);
 				lua_rawset(L, 1);
 
-				int key_type = restore(L, s);
+				int key_type = restore_v1(L, s);
 				while (key_type != LUA_TNIL)
 				{
-					restore(L, s); // value
+					restore_v1(L, s); // value
 					if (lua_isnil(L, -2)) 
 					{
 						// maybe an invalid userdata?
@@ -220,7 +401,7 @@ static int restore(lua_State *L, BIStreamBE& s)
 					{
 						lua_rawset(L, -3);
 					}
-					key_type = restore(L, s); // next key
+					key_type = restore_v1(L, s); // next key
 				}
 				lua_pop(L, 1);
 			}
@@ -275,25 +456,236 @@ static int restore(lua_State *L, BIStreamBE& s)
 	return type;
 }
 
-bool lua_restore(lua_State *L, std::streambuf* sb)
+class RestoreBuffer
 {
-	// create a reference table
-	lua_newtable(L);
+public:
+	RestoreBuffer(const char* data, size_t size) : m_p(data), m_end(data + size) { }
+
+	int8 peek_int8() const {
+		if (!remaining())
+			throw basic_bstream::failure("unexpected end of data");
+		return static_cast<int8>(*m_p);
+	}
+	int8 read_int8() { return static_cast<int8>(*take(1)); }
+	uint8 read_uint8() { return static_cast<uint8>(*take(1)); }
+	uint16 read_uint16() {
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(take(2));
+		return static_cast<uint16>((b[0] << 8) | b[1]);
+	}
+	uint32 read_uint32() {
+		const unsigned char* b = reinterpret_cast<const unsigned char*>(take(4));
+		return (static_cast<uint32>(b[0]) << 24) | (static_cast<uint32>(b[1]) << 16) |
+			(static_cast<uint32>(b[2]) << 8) | b[3];
+	}
+	double read_double() {
+		uint64 v = static_cast<uint64>(read_uint32()) << 32;
+		v |= read_uint32();
+		double d;
+		memcpy(&d, &v, sizeof(d));
+		return d;
+	}
+	const char* read(size_t n) { return take(n); }
+	size_t remaining() const { return m_end - m_p; }
+
+private:
+	const char* take(size_t n) {
+		if (remaining() < n)
+			throw basic_bstream::failure("unexpected end of data");
+		const char* p = m_p;
+		m_p += n;
+		return p;
+	}
+
+	const char* m_p;
+	const char* m_end;
+};
+
+class Restorer
+{
+public:
+	Restorer(lua_State* L, RestoreBuffer& s) : L(L), s(s), m_strings(0) { }
+
+	// pushes the saved value onto the stack
+	void restore();
+
+private:
+	enum Step { Key, Value, Store };
 
-        // put it at the bottom of the stack
-        lua_insert(L, 1);
+	bool read();
+
+	lua_State* L;
+	RestoreBuffer& s;
+	std::vector<Step> m_frames;
+	uint32 m_strings;
+};
+
+// pushes the next value; a table is left open with a frame pushed to read
+// its contents, and read returns true
+bool Restorer::read()
+{
+	int8 type = s.read_int8();
+	switch (type)
+	{
+		case LUA_TNIL:
+			lua_pushnil(L);
+			break;
+		case LUA_TBOOLEAN:
+			lua_pushboolean(L, s.read_uint8() == 1);
+			break;
+		case LUA_TNUMBER:
+			lua_pushnumber(L, static_cast<lua_Number>(s.read_double()));
+			break;
+		case LUA_TSTRING:
+			{
+				uint32 length = s.read_uint32();
+				lua_pushlstring(L, s.read(length), length);
+
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, kStringsIndex, ++m_strings);
+			}
+			break;
+		case LUA_TTABLE:
+			{
+				if (!lua_checkstack(L, 4))
+				{
+					throw basic_bstream::failure("tables nested too deeply");
+				}
+
+				uint32 reference = s.read_uint32();
+				uint32 count = s.read_uint32();
+				if (count > s.remaining() / sizeof(double))
+				{
+					throw basic_bstream::failure("unexpected end of data");
+				}
+
+				lua_createtable(L, count, 0);
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, kReferencesIndex, reference);
+
+				for (uint32 i = 1; i <= count; ++i)
+				{
+					lua_pushnumber(L, static_cast<lua_Number>(s.read_double()));
+					lua_rawseti(L, -2, i);
+				}
+
+				m_frames.push_back(Key);
+			}
+			return true;
+		case LUA_TUSERDATA:
+			{
+				uint32 reference = s.read_uint32();
+
+				// the metatable name
+				if (read() || lua_type(L, -1) != LUA_TSTRING)
+				{
+					throw basic_bstream::failure("malformed userdata");
+				}
+
+				uint32 index = s.read_uint32();
+
+				// get the metatable
+				lua_rawget(L, LUA_REGISTRYINDEX);
+				// get the accessor we added
+				if (lua_istable(L, -1))
+					lua_getfield(L, -1, "__new");
+				else
+					lua_pushnil(L);
+				if (lua_isfunction(L, -1))
+				{
+					lua_pushnumber(L, static_cast<lua_Number>(index));
+					lua_call(L, 1, 1);
+				}
+
+				lua_remove(L, -2);
+
+				// add to the reference table
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, kReferencesIndex, reference);
+			}
+			break;
+		case SAVED_REFERENCE_PSEUDOTYPE:
+			lua_rawgeti(L, kReferencesIndex, s.read_uint32());
+			break;
+		case SAVED_STRING_REFERENCE_PSEUDOTYPE:
+			lua_rawgeti(L, kStringsIndex, s.read_uint32());
+			break;
+		default:
+			throw basic_bstream::failure("unknown type");
+	}
+
+	return false;
+}
+
+void Restorer::restore()
+{
+	read();
+
+	while (!m_frames.empty())
+	{
+		// stack: ... table [key [value]]
+		Step& step = m_frames.back();
+		switch (step)
+		{
+			case Key:
+				if (s.peek_int8() == LUA_TNIL)
+				{
+					// end of table
+					s.read_int8();
+					m_frames.pop_back();
+					break;
+				}
+
+				step = Value;
+				read();
+				break;
+			case Value:
+				step = Store;
+				read();
+				break;
+			case Store:
+				step = Key;
+				if (lua_isnil(L, -2))
+				{
+					// maybe an invalid userdata?
+					lua_pop(L, 2);
+				}
+				else
+				{
+					lua_rawset(L, -3);
+				}
+				break;
+		}
+	}
+}
+
+bool lua_restore(lua_State *L, const char* data, size_t size)
+{
+	// create the references and strings tables, and put them at the
+	// bottom of the stack
+	lua_newtable(L);
+	lua_insert(L, 1);
+	lua_newtable(L);
+	lua_insert(L, 2);
 
-	BIStreamBE s(sb);
 	try {
-		int16 version;
-		s >> version;
+		RestoreBuffer s(data, size);
+		int16 version = static_cast<int16>(s.read_uint16());
 		if (version > kVersion)
 		{
 			logWarning("failed to restore Lua data; saved data is newer version");
+			lua_settop(L, 0);
 			return false;
 		}
-
-		restore(L, s);
+		else if (version < 2)
+		{
+			io::stream_buffer<io::array_source> sb(data + 2, size - 2);
+			BIStreamBE bs(&sb);
+			restore_v1(L, bs);
+		}
+		else
+		{
+			Restorer(L, s).restore();
+		}
 	}
 	catch (const basic_bstream::failure& e)
 	{
@@ -301,8 +693,15 @@ bool lua_restore(lua_State *L, std::streambuf* sb)
 		lua_settop(L, 0);
 		return false;
 	}
-	
-	// remove the reference table
+
+	// remove the bookkeeping tables
+	lua_remove(L, 1);
 	lua_remove(L, 1);
 	return true;
 }
+
+bool lua_restore(lua_State *L, std::streambuf* sb)
+{
+	std::string data((std::istreambuf_iterator<char>(sb)), std::istreambuf_iterator<char>());
+	return lua_restore(L, data.data(), data.size());
+}
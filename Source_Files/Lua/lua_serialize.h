@@ -34,10 +34,14 @@ extern "C"
 #include "lualib.h"
 }
 
+#include <string>
+
 // saves object on top of the stack to s
 bool lua_save(lua_State *L, std::streambuf* sb);
+bool lua_save(lua_State *L, std::string& out);
 
 // restores object in s to top of the stack
 bool lua_restore(lua_State *L, std::streambuf* sb);
+bool lua_restore(lua_State *L, const char* data, size_t size);
 
 #endif
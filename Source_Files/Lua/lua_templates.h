@@ -59,6 +59,15 @@ extern void L_Set_Proper_Item_Accounting(lua_State* L, bool value);
 extern bool L_Get_Nonlocal_Overlays(lua_State* L);
 extern void L_Set_Nonlocal_Overlays(lua_State* L, bool value);
 
+// states with pooled, per-state accounted memory; the name shows up in the
+// profile report. Only states that don't affect the game (the HUD) may have
+// their collector stepped in spare frame time: that timing differs between
+// peers and between a game and its film, and __gc or weak tables would
+// turn it into an out of sync
+extern lua_State* L_New_State(bool collect_in_idle_time = false);
+extern void L_Close_State(lua_State* L);
+extern void L_Set_State_Name(lua_State* L, const char* name);
+
 // pushes a function that returns the parameterized function
 template<lua_CFunction f>
 int L_TableFunction(lua_State *L)
@@ -126,6 +135,12 @@ protected:
 
 	// special tables
 	static void _push_custom_fields_table(lua_State *L);
+
+	// _get and _set find the metatable and the get and set methods tables
+	// in upvalues 1-3; __index/__newindex handlers that fall through to
+	// them must be pushed with this
+	static void _push_dispatch_closure(lua_State *L, lua_CFunction f);
+	static void _check_instance(lua_State *L);
 };
 
 struct always_valid
@@ -139,6 +154,31 @@ std::function<bool (index_t)> L_Class<name, index_t>::Valid = always_valid();
 template<char *name, typename index_t>
 void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const luaL_Reg set[], const luaL_Reg metatable[])
 {
+	// register get methods
+	_push_get_methods_key(L);
+	lua_newtable(L);
+
+	// always want index
+	lua_pushcfunction(L, _index);
+	lua_setfield(L, -2, "index");
+
+	if (get)
+		luaL_setfuncs(L, get, 0);
+	lua_settable(L, LUA_REGISTRYINDEX);
+
+	// register set methods
+	_push_set_methods_key(L);
+	lua_newtable(L);
+
+	if (set)
+		luaL_setfuncs(L, set, 0);
+	lua_settable(L, LUA_REGISTRYINDEX);
+		
+	// register a table for instances
+	_push_instances_key(L);
+	lua_newtable(L);
+	lua_settable(L, LUA_REGISTRYINDEX);
+
 	// create the metatable itself
 	luaL_newmetatable(L, name);
 
@@ -148,11 +188,11 @@ void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const
 	lua_settable(L, LUA_REGISTRYINDEX);
 
 	// register metatable get
-	lua_pushcfunction(L, _get);
+	_push_dispatch_closure(L, _get);
 	lua_setfield(L, -2, "__index");
 
 	// register metatable set
-	lua_pushcfunction(L, _set);
+	_push_dispatch_closure(L, _set);
 	lua_setfield(L, -2, "__newindex");
 
 	// register metatable tostring
@@ -168,31 +208,6 @@ void L_Class<name, index_t>::Register(lua_State *L, const luaL_Reg get[], const
 	// clear the stack
 	lua_pop(L, 1);
 	
-	// register get methods
-	_push_get_methods_key(L);
-	lua_newtable(L);
-
-	// always want index
-	lua_pushcfunction(L, _index);
-	lua_setfield(L, -2, "index");
-
-	if (get)
-		luaL_setfuncs(L, get, 0);
-	lua_settable(L, LUA_REGISTRYINDEX);
-
-	// register set methods
-	_push_set_methods_key(L);
-	lua_newtable(L);
-
-	if (set)
-		luaL_setfuncs(L, set, 0);
-	lua_settable(L, LUA_REGISTRYINDEX);
-		
-	// register a table for instances
-	_push_instances_key(L);
-	lua_newtable(L);
-	lua_settable(L, LUA_REGISTRYINDEX);
-
 	// register is_
 	lua_pushcfunction(L, _is);
 	std::string is_name = "is_" + std::string(name);
@@ -243,12 +258,10 @@ instance_t *L_Class<name, index_t>::Push(lua_State *L, index_t index)
 		return 0;
 	}
 
-	// look it up in the index table
-	_push_instances_key(L);
-	lua_gettable(L, LUA_REGISTRYINDEX);
-
-	lua_pushnumber(L, index);
-	lua_gettable(L, -2);
+	// look it up in the index table; neither table has a metatable, so
+	// raw access is safe and skips the metamethod checks
+	lua_rawgetp(L, LUA_REGISTRYINDEX, (void *) (&name[3]));
+	lua_rawgeti(L, -1, index);
 
 	if (lua_isnil(L, -1)) 
 	{
@@ -258,9 +271,8 @@ instance_t *L_Class<name, index_t>::Push(lua_State *L, index_t index)
 		t = NewInstance<instance_t>(L, index);
 
 		// insert it into the instance table
-		lua_pushnumber(L, index);
-		lua_pushvalue(L, -2);
-		lua_settable(L, -4);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, index);
 
 	}
 	else
@@ -345,13 +357,41 @@ int L_Class<name, index_t>::_is(lua_State *L)
 	return 1;
 }
 
+template<char *name, typename index_t>
+void L_Class<name, index_t>::_push_dispatch_closure(lua_State *L, lua_CFunction f)
+{
+	luaL_getmetatable(L, name);
+	_push_get_methods_key(L);
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	_push_set_methods_key(L);
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	lua_pushcclosure(L, f, 3);
+}
+
+// luaL_checkudata() against the metatable upvalue, sparing the registry
+// lookup by name
+template<char *name, typename index_t>
+void L_Class<name, index_t>::_check_instance(lua_State *L)
+{
+	if (lua_type(L, 1) == LUA_TUSERDATA && lua_getmetatable(L, 1))
+	{
+		bool match = lua_rawequal(L, -1, lua_upvalueindex(1));
+		lua_pop(L, 1);
+		if (match)
+			return;
+	}
+
+	// raise the usual errors
+	luaL_checktype(L, 1, LUA_TUSERDATA);
+	luaL_checkudata(L, 1, name);
+}
+
 template<char *name, typename index_t>
 int L_Class<name, index_t>::_get(lua_State *L)
 {
 	if (lua_isstring(L, 2))
 	{
-		luaL_checktype(L, 1, LUA_TUSERDATA);
-		luaL_checkudata(L, 1, name);
+		_check_instance(L);
 		if (!Valid(Index(L, 1)) && strcmp(lua_tostring(L, 2), "valid") != 0 && strcmp(lua_tostring(L, 2), "index") != 0)
 			luaL_error(L, "invalid object");
 
@@ -376,27 +416,18 @@ int L_Class<name, index_t>::_get(lua_State *L)
 		}
 		else
 		{
-			// pop the get table
-			_push_get_methods_key(L);
-			lua_gettable(L, LUA_REGISTRYINDEX);
-
-			// get the function from that table
+			// get the function from the get table
 			lua_pushvalue(L, 2);
-			lua_gettable(L, -2);
-			lua_remove(L, -2);
+			lua_rawget(L, lua_upvalueindex(2));
 		
-			if (lua_isfunction(L, -1))
+			// the methods tables only hold plain C functions
+			lua_CFunction f = lua_tocfunction(L, -1);
+			if (f)
 			{
-				// execute the function with table as our argument
-				lua_pushvalue(L, 1);
-				if (lua_pcall(L, 1, 1, 0) == LUA_ERRRUN)
-				{
-					// report the error as being on this line
-					luaL_where(L, 1);
-					lua_pushvalue(L, -2);
-					lua_concat(L, 2);
-					lua_error(L);
-				}
+				// call it in place with table as its argument; its
+				// errors already report this line
+				lua_settop(L, 1);
+				return f(L);
 			}
 			else
 			{
@@ -432,8 +463,7 @@ int L_Class<name, index_t>::_new(lua_State *L)
 template<char *name, typename index_t>
 int L_Class<name, index_t>::_set(lua_State *L)
 {
-	luaL_checktype(L, 1, LUA_TUSERDATA);
-	luaL_checkudata(L, 1, name);
+	_check_instance(L);
 
 	if (lua_isstring(L, 2) && lua_tostring(L, 2)[0] == '_')
 	{
@@ -467,32 +497,20 @@ int L_Class<name, index_t>::_set(lua_State *L)
 	}
 	else
 	{
-		// pop the set table
-		_push_set_methods_key(L);
-		lua_gettable(L, LUA_REGISTRYINDEX);
-		
-		// get the function from that table
+		// get the function from the set table
 		lua_pushvalue(L, 2);
-		lua_gettable(L, -2);
+		lua_rawget(L, lua_upvalueindex(3));
 		
-		if (lua_isnil(L, -1))
+		lua_CFunction f = lua_tocfunction(L, -1);
+		if (!f)
 		{
 			luaL_error(L, "no such index");
 		}
 		
-		// execute the function with table, value as our arguments
-		lua_pushvalue(L, 1);
-		lua_pushvalue(L, 3);
-		if (lua_pcall(L, 2, 0, 0) == LUA_ERRRUN)
-		{
-			// report the error as being on this line
-			luaL_where(L, 1);
-			lua_pushvalue(L, -2);
-			lua_concat(L, 2);
-			lua_error(L);
-		}
-		
-		lua_pop(L, 1);
+		// call it in place with table, value as its arguments
+		lua_settop(L, 3);
+		lua_remove(L, 2);
+		f(L);
 	}
 
 	return 0;
@@ -799,7 +817,7 @@ void L_Container<name, T>::Register(lua_State *L, const luaL_Reg get[], const lu
 	L_Class<name>::Register(L, get, set, metatable);
 	luaL_getmetatable(L, name);
 	
-	lua_pushcfunction(L, _get_container);
+	L_Class<name>::_push_dispatch_closure(L, _get_container);
 	lua_setfield(L, -2, "__index");
 	
 	lua_pushcfunction(L, _call);
@@ -834,18 +852,25 @@ int L_Container<name, T>::_get_container(lua_State *L)
 	return L_Class<name>::_get(L);
 }
 
+// A single stateless iterator serves every loop: the container is the
+// invariant state and the element returned last is the control variable,
+// so a generic for allocates nothing to start or to step. Like ipairs'
+// iterator, calling it with no element starts from the beginning
 template<char *name, class T>
 int L_Container<name, T>::_iterator(lua_State *L)
 {
-	int32 index = static_cast<int32>(lua_tonumber(L, lua_upvalueindex(1)));
-	while (index < Length())
+	int32 index = 0;
+	if (lua_isnumber(L, 2))
+		index = static_cast<int32>(lua_tonumber(L, 2)) + 1;
+	else if (!lua_isnoneornil(L, 2))
+		index = static_cast<int32>(T::Index(L, 2)) + 1;
+	
+	int32 length = Length();
+	while (index < length)
 	{
 		if (T::Valid(index))
-			
 		{
 			T::Push(L, index);
-			lua_pushnumber(L, ++index);
-			lua_replace(L, lua_upvalueindex(1));
 			return 1;
 		}
 		else
@@ -861,9 +886,10 @@ int L_Container<name, T>::_iterator(lua_State *L)
 template<char *name, class T>
 int L_Container<name, T>::_call(lua_State *L)
 {
-	lua_pushnumber(L, 0);
-	lua_pushcclosure(L, _iterator, 1);
-	return 1;
+	lua_pushcfunction(L, _iterator);
+	lua_pushvalue(L, 1);
+	lua_pushnil(L);
+	return 3;
 }
 
 template<char *name, class T>
@@ -890,7 +916,7 @@ void L_EnumContainer<name, T>::Register(lua_State *L, const luaL_Reg methods[],
 	
 	luaL_getmetatable(L, name);
 
-	lua_pushcfunction(L, _get_enumcontainer);
+	L_Class<name>::_push_dispatch_closure(L, _get_enumcontainer);
 	lua_setfield(L, -2, "__index");
 
 	lua_pop(L, 1);
@@ -26,22 +26,40 @@
 
 #include "Logging.h"
 #include "cseries.h"
+#ifndef A1_NETWORK_STANDALONE_HUB
 #include "shell.h"
+#endif
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <fstream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 #include <time.h>	// apparently is in C std library, used here to print time/date log section started.
 #include <stdio.h>
+#include <string.h>
+#ifndef A1_NETWORK_STANDALONE_HUB
 #include "FileHandler.h"
 #include "InfoTree.h"
+#endif
 
 #ifndef NO_STD_NAMESPACE
 using std::vector;
 using std::string;
 #endif
 
-enum { kStringBufferSize = 1024 };
+enum {
+	kStringBufferSize = 1024,
+	kLogRecordSize = 1024,		// formatted records longer than this are truncated
+	kLogQueueSize = 512,		// records; must be a power of two
+	kRateLimitSlots = 256,		// source locations tracked for rate limiting (hashed)
+	kRateLimitBurst = 20,		// messages per source location per second
+	kRateLimitWindowMs = 1000,
+	kWriterPeriodMs = 50		// writer thread drains at least this often
+};
 
 static Logger*	sCurrentLogger	= NULL;
 static FILE*	sOutputFile	= NULL;
@@ -54,6 +72,205 @@ const char*	logDomain	= "global";
 static void InitializeLogging();
 
 
+// Formatted records go through a bounded multi-producer queue (Vyukov's design:
+// each cell carries a sequence number saying whose turn it is) to a writer
+// thread, so logging from the game loop or the network threads never waits on
+// disk.  Fatal messages are written synchronously, after draining the queue.
+// The standalone hub forks its workers and logs to unbuffered stderr, so it
+// keeps writing synchronously.
+#ifndef A1_NETWORK_STANDALONE_HUB
+#define ASYNC_LOGGING
+#endif
+
+struct LogRecord {
+	std::atomic<size_t>	sequence;
+	size_t	length;
+	char	text[kLogRecordSize];
+};
+
+static LogRecord	sLogQueue[kLogQueueSize];
+static std::atomic<size_t>	sEnqueuePosition(0);
+static size_t		sDequeuePosition = 0;		// guarded by sWriterMutex
+static std::atomic<size_t>	sDroppedRecords(0);
+
+static std::mutex	sWriterMutex;			// held while writing to sOutputFile
+#ifdef ASYNC_LOGGING
+static std::condition_variable	sWriterWakeup;
+static std::thread*	sWriterThread = NULL;
+static bool		sWriterQuit = false;		// guarded by sWriterMutex
+#endif
+
+static void
+write_record(const char* inText, size_t inLength) {
+	fwrite(inText, 1, inLength, sOutputFile);
+	if (sOutputFile != stderr)
+		fwrite(inText, 1, inLength, stderr);
+}
+
+static void
+initialize_log_queue() {
+	for(size_t i = 0; i < kLogQueueSize; i++)
+		sLogQueue[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+// Returns false if the queue is full
+static bool
+enqueue_record(const char* inText, size_t inLength) {
+	size_t thePosition = sEnqueuePosition.load(std::memory_order_relaxed);
+	LogRecord* theRecord;
+	for(;;) {
+		theRecord = &sLogQueue[thePosition & (kLogQueueSize - 1)];
+		size_t theSequence = theRecord->sequence.load(std::memory_order_acquire);
+		intptr_t theDifference = static_cast<intptr_t>(theSequence) - static_cast<intptr_t>(thePosition);
+		if(theDifference == 0) {
+			if(sEnqueuePosition.compare_exchange_weak(thePosition, thePosition + 1, std::memory_order_relaxed))
+				break;
+		}
+		else if(theDifference < 0)
+			return false;
+		else
+			thePosition = sEnqueuePosition.load(std::memory_order_relaxed);
+	}
+
+	theRecord->length = (inLength < kLogRecordSize) ? inLength : kLogRecordSize;
+	memcpy(theRecord->text, inText, theRecord->length);
+	if(theRecord->length == kLogRecordSize && inLength > kLogRecordSize)
+		theRecord->text[kLogRecordSize - 1] = '\n';
+	theRecord->sequence.store(thePosition + 1, std::memory_order_release);
+
+#ifdef ASYNC_LOGGING
+	// The writer polls; only nudge it when the queue is filling up.
+	if(((thePosition + 1) & (kLogQueueSize / 2 - 1)) == 0)
+		sWriterWakeup.notify_one();
+#endif
+	return true;
+}
+
+// Caller holds sWriterMutex
+static void
+drain_log_queue() {
+	bool wroteSomething = false;
+	for(;;) {
+		LogRecord& theRecord = sLogQueue[sDequeuePosition & (kLogQueueSize - 1)];
+		if(theRecord.sequence.load(std::memory_order_acquire) != sDequeuePosition + 1)
+			break;
+
+		write_record(theRecord.text, theRecord.length);
+		theRecord.sequence.store(sDequeuePosition + kLogQueueSize, std::memory_order_release);
+		sDequeuePosition++;
+		wroteSomething = true;
+	}
+
+	size_t theDroppedCount = sDroppedRecords.exchange(0);
+	if(theDroppedCount > 0) {
+		char theBuffer[64];
+		int theLength = snprintf(theBuffer, sizeof(theBuffer), "(%lu log messages dropped)\n", static_cast<unsigned long>(theDroppedCount));
+		write_record(theBuffer, theLength);
+		wroteSomething = true;
+	}
+
+	if(wroteSomething && sFlushOutput)
+		fflush(sOutputFile);
+}
+
+#ifdef ASYNC_LOGGING
+static void
+log_writer_thread() {
+	std::unique_lock<std::mutex> theLock(sWriterMutex);
+	while(!sWriterQuit) {
+		sWriterWakeup.wait_for(theLock, std::chrono::milliseconds(kWriterPeriodMs));
+		drain_log_queue();
+	}
+	drain_log_queue();
+	fflush(sOutputFile);
+}
+
+// Drains and stops the writer at exit; declared after the things it uses so it
+// is destroyed before them.
+static struct LogWriterShutdown {
+	~LogWriterShutdown() {
+		if(sWriterThread == NULL)
+			return;
+		{
+			std::lock_guard<std::mutex> theLock(sWriterMutex);
+			sWriterQuit = true;
+		}
+		sWriterWakeup.notify_one();
+		sWriterThread->join();
+		delete sWriterThread;
+		sWriterThread = NULL;
+	}
+} sLogWriterShutdown;
+#endif
+
+static void
+submit_record(const string& inRecord, bool inSynchronous) {
+#ifdef ASYNC_LOGGING
+	if(!inSynchronous && enqueue_record(inRecord.data(), inRecord.size()))
+		return;
+	if(!inSynchronous) {
+		sDroppedRecords.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+#endif
+	std::lock_guard<std::mutex> theLock(sWriterMutex);
+	drain_log_queue();
+	write_record(inRecord.data(), inRecord.size());
+	if(sFlushOutput || inSynchronous)
+		fflush(sOutputFile);
+}
+
+
+// Per-source-location rate limiting, so a message logged every frame can't flood
+// the queue.  Slots are hashed by location and may be shared; races only blur the
+// counts, which is fine for this purpose.
+struct RateLimitSlot {
+	std::atomic<const char*>	file;
+	std::atomic<int>	line;
+	std::atomic<int64_t>	windowStart;
+	std::atomic<uint32_t>	count;
+	std::atomic<uint32_t>	suppressed;
+};
+
+static RateLimitSlot	sRateLimits[kRateLimitSlots];
+
+static int64_t
+rate_limit_clock() {
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Returns true if the message should be dropped; otherwise outSuppressed is how
+// many messages from this location were dropped since the last one let through.
+static bool
+rate_limited(const char* inFile, int inLine, uint32_t& outSuppressed) {
+	outSuppressed = 0;
+	RateLimitSlot& theSlot = sRateLimits[(reinterpret_cast<uintptr_t>(inFile) / sizeof(void*) + inLine * 31) & (kRateLimitSlots - 1)];
+	int64_t theNow = rate_limit_clock();
+
+	if(theSlot.file.load(std::memory_order_relaxed) != inFile || theSlot.line.load(std::memory_order_relaxed) != inLine) {
+		theSlot.file.store(inFile, std::memory_order_relaxed);
+		theSlot.line.store(inLine, std::memory_order_relaxed);
+		theSlot.windowStart.store(theNow, std::memory_order_relaxed);
+		theSlot.count.store(1, std::memory_order_relaxed);
+		theSlot.suppressed.store(0, std::memory_order_relaxed);
+		return false;
+	}
+
+	if(theNow - theSlot.windowStart.load(std::memory_order_relaxed) >= kRateLimitWindowMs) {
+		theSlot.windowStart.store(theNow, std::memory_order_relaxed);
+		theSlot.count.store(1, std::memory_order_relaxed);
+		outSuppressed = theSlot.suppressed.exchange(0, std::memory_order_relaxed);
+		return false;
+	}
+
+	if(theSlot.count.fetch_add(1, std::memory_order_relaxed) >= kRateLimitBurst) {
+		theSlot.suppressed.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+
 Logger*
 GetCurrentLogger() {
     if(sCurrentLogger == NULL)
@@ -150,7 +367,13 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
     // Obviously eventually this will be settable more dynamically...
     // Also eventually some logged messages could be posted in a dialog in addition to appended to the file.
     if(sOutputFile != NULL && inLevel < sLoggingThreshhold) {
+        bool isFatal = (inLevel <= logFatalLevel);
+        uint32_t theSuppressedCount = 0;
+        if(!isFatal && rate_limited(inFile, inLine, theSuppressedCount))
+            return;
+
         char	stringBuffer[kStringBufferSize];
+        string	theRecord;
         size_t firstDepthToPrint = mMostRecentCommonStackDepth;
     /*
         // This was designed to give a little context when coming back from deep stacks, but it seems
@@ -160,33 +383,31 @@ TopLevelLogger::logMessageV(const char* inDomain, int inLevel, const char* inFil
             firstDepthToPrint--;
     */
         for(size_t depth = firstDepthToPrint; depth < mContextStack.size(); depth++) {
-            string	theString(depth * 2, ' ');
-    
-            theString += "while ";
-            theString += mContextStack[depth];
-            
-            fprintf(sOutputFile, "%s\n", theString.c_str());
-			fprintf(stderr, "%s\n", theString.c_str());
+            theRecord.append(depth * 2, ' ');
+            theRecord += "while ";
+            theRecord += mContextStack[depth];
+            theRecord += "\n";
         }
         
         vsnprintf(stringBuffer, kStringBufferSize, inMessage, inArgs);
     
-        string	theString(mContextStack.size() * 2, ' ');
+        theRecord.append(mContextStack.size() * 2, ' ');
         
-        theString += stringBuffer;
+        theRecord += stringBuffer;
+
+        if(theSuppressedCount > 0) {
+            snprintf(stringBuffer, kStringBufferSize, " [%u similar messages suppressed]", theSuppressedCount);
+            theRecord += stringBuffer;
+        }
         
         if(sShowLocations) {
             snprintf(stringBuffer, kStringBufferSize, " (%s:%d)\n", inFile, inLine);
-            theString += stringBuffer;
+            theRecord += stringBuffer;
         }
         else
-            theString += "\n";
-        
-        fprintf(sOutputFile, "%s", theString.c_str());
-		fprintf(stderr, "%s", theString.c_str());
+            theRecord += "\n";
         
-        if(sFlushOutput)
-                fflush(sOutputFile);
+        submit_record(theRecord, isFatal);
         
         mMostRecentCommonStackDepth = mContextStack.size();
         mMostRecentlyPrintedStackDepth = mContextStack.size();
@@ -197,6 +418,8 @@ void TopLevelLogger::flush()
 {
 	if (sOutputFile)
 	{
+		std::lock_guard<std::mutex> theLock(sWriterMutex);
+		drain_log_queue();
 		fflush(sOutputFile);
 	}
 }
@@ -209,6 +432,22 @@ void TopLevelLogger::flush()
 #endif
 #endif
 
+#ifdef A1_NETWORK_STANDALONE_HUB
+// Standalone hub runs as a service: log to stderr, and let the service
+// manager keep it.
+const char *loggingFileName()
+{
+	return "standard error";
+}
+
+static void
+InitializeLogging() {
+    assert(sOutputFile == NULL);
+    sOutputFile = stderr;
+    sCurrentLogger = new TopLevelLogger;
+    initialize_log_queue();
+}
+#else
 extern DirectorySpecifier log_dir;
 
 char g_loggingFileName[256] = "";
@@ -235,13 +474,17 @@ InitializeLogging() {
 #endif
 
     sCurrentLogger = new TopLevelLogger;
+    initialize_log_queue();
     if(sOutputFile != NULL)
     {
 	    time_t theTime = time(NULL);
 	    const char* theTimeString = ctime(&theTime);
 	    fprintf(sOutputFile, "\n-------------------- %s\n\n", theTimeString == NULL ? "(timestamp unavailable)" : theTimeString);
+
+	    sWriterThread = new std::thread(log_writer_thread);
     }
 }
+#endif
 
 
 // Currently these ignore the domain since domains are effectively not implemented.
@@ -263,7 +506,7 @@ setFlushLoggingOutput(const char* inDomain, bool inFlushOutput) {
 
         // Flush now for good measure
         if(sFlushOutput && sOutputFile != NULL)
-                fflush(sOutputFile);
+                GetCurrentLogger()->flush();
 }
 
 
@@ -272,6 +515,7 @@ void reset_mml_logging()
 	// no reset
 }
 
+#ifndef A1_NETWORK_STANDALONE_HUB
 void parse_mml_logging(const InfoTree& root)
 {
 	for (const InfoTree &dtree : root.children_named("logging_domain"))
@@ -291,3 +535,4 @@ void parse_mml_logging(const InfoTree& root)
 			setFlushLoggingOutput(domain.c_str(), flush);
 	}
 }
+#endif
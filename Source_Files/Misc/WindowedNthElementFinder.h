@@ -21,54 +21,116 @@
  *  Created by Woody Zenfell, III on Thu May 08 2003.
  *
  *  Finds the nth (0 is first) largest or nth smallest element from a window of recently inserted elements.
+ *
+ *  The window is kept as a histogram of counts over the range of values seen, so inserting (and
+ *  retiring the oldest element) is constant-time and a query walks the value range rather than the
+ *  window.  That suits the integral tick offsets the star protocol feeds it, whose range is a few
+ *  dozen ticks while the windows are hundreds of samples long.  Element types must be integral.
+ *
+ *  The samples come off the network, so the histogram can't be trusted to stay narrow: empty buckets
+ *  at either end are trimmed as elements retire, and while the window spans more than
+ *  kMaxHistogramSpan values it is kept in a sorted multiset instead.
+ *
+ *  It also keeps an exponentially weighted estimate of the jitter between consecutive samples
+ *  (the RFC 3550 interarrival estimator: J += (|D| - J) / 16), which callers can use to decide
+ *  whether a partly filled window is already trustworthy.
  */
 
 #ifndef WINDOWEDNTHELEMENTFINDER_H
 #define WINDOWEDNTHELEMENTFINDER_H
 
 #include "CircularQueue.h"
+#include <algorithm>
+#include <deque>
+#include <iterator>
 #include <set>
+#include <stdint.h>
+#include <type_traits>
 
 template <typename tElementType>
 class WindowedNthElementFinder {
 public:
-        WindowedNthElementFinder() : mQueue(0) {}
+        WindowedNthElementFinder() : mQueue(0) { clear_statistics(); }
         
-        explicit WindowedNthElementFinder(unsigned int inWindowSize) : mQueue(inWindowSize) {}
+        explicit WindowedNthElementFinder(unsigned int inWindowSize) : mQueue(inWindowSize) { clear_statistics(); }
 
 	void	reset() { reset(window_size()); }
-        void	reset(unsigned int inWindowSize) { mQueue.reset(inWindowSize);  mSortedElements.clear(); }
+        // The jitter estimate describes the link rather than the window, so it survives a reset;
+        // only the next difference is skipped, since callers reset when the samples shift.
+        void	reset(unsigned int inWindowSize) { mQueue.reset(inWindowSize);  mCounts.clear();  mSortedWindow.clear();  mUseSortedWindow = false;  mHaveSample = false; }
 
         void	insert(const tElementType& inNewElement)
         {
                 if(window_full())
                 {
-                        mSortedElements.erase(mSortedElements.find(mQueue.peek()));
+                        retire(mQueue.peek());
                         mQueue.dequeue();
                 }
-                mSortedElements.insert(inNewElement);
+
+                if(!mUseSortedWindow && !histogram_can_hold(inNewElement))
+                        use_sorted_window();
+
+                if(mUseSortedWindow)
+                {
+                        mSortedWindow.insert(inNewElement);
+                }
+                else if(mCounts.empty())
+                {
+                        mLowest = inNewElement;
+                        mCounts.resize(1, 0);
+                }
+                else if(inNewElement < mLowest)
+                {
+                        mCounts.insert(mCounts.begin(), mLowest - inNewElement, 0);
+                        mLowest = inNewElement;
+                }
+                else if(static_cast<size_t>(inNewElement - mLowest) >= mCounts.size())
+                {
+                        mCounts.resize(inNewElement - mLowest + 1, 0);
+                }
+
+                if(!mUseSortedWindow)
+                        ++mCounts[inNewElement - mLowest];
                 mQueue.enqueue(inNewElement);
+
+                if(mHaveSample)
+                {
+                        // an outlier only needs to read as "large"; don't let it overflow the estimate
+                        intmax_t theDifference = std::min<intmax_t>(span(std::min(inNewElement, mLastSample), std::max(inNewElement, mLastSample)), kMaxJitterDifference);
+                        mScaledJitter += static_cast<int>(theDifference) - ((mScaledJitter + 8) >> 4);
+                }
+                mLastSample = inNewElement;
+                mHaveSample = true;
         }
 
         // 0-based indexing (not 1-based as name might imply)
-        const tElementType&	nth_smallest_element(unsigned int n)
+        tElementType	nth_smallest_element(unsigned int n)
         {
                 assert(n < size());
-                typename std::multiset<tElementType>::const_iterator i = mSortedElements.begin();
-                for(unsigned int j = 0; j < n; ++j)
+                if(mUseSortedWindow)
+                        return *std::next(mSortedWindow.begin(), n);
+
+                size_t i = 0;
+                for(unsigned int theSeen = mCounts[0]; theSeen <= n; theSeen += mCounts[i])
                         ++i;
-                return *i;
+                return static_cast<tElementType>(mLowest + i);
         }
 
         // 0-based indexing (not 1-based as name might imply)
-        const tElementType&	nth_largest_element(unsigned int n)
+        tElementType	nth_largest_element(unsigned int n)
         {
                 assert(n < size());
-		typename std::multiset<tElementType>::const_reverse_iterator i = mSortedElements.rbegin();
-                for(unsigned int j = 0; j < n; ++j)
-                        ++i;
-                return *i;
+                if(mUseSortedWindow)
+                        return *std::next(mSortedWindow.rbegin(), n);
+
+                size_t i = mCounts.size() - 1;
+                for(unsigned int theSeen = mCounts[i]; theSeen <= n; theSeen += mCounts[i])
+                        --i;
+                return static_cast<tElementType>(mLowest + i);
         }
+
+        // Smoothed absolute difference between consecutive samples, in sixteenths of an element.
+        int	scaled_jitter()		{ return mScaledJitter; }
         
         bool	window_full()		{ return size() == window_size(); }
 
@@ -76,8 +138,76 @@ public:
         unsigned int window_size()	{ return mQueue.getTotalSpace(); }
 
 private:
+        static_assert(std::is_integral<tElementType>::value, "WindowedNthElementFinder needs an integral element type");
+
+        enum { kMaxHistogramSpan = 1024, kMaxJitterDifference = 1 << 20 };
+
+        void	clear_statistics() { mLowest = 0;  mUseSortedWindow = false;  mLastSample = 0;  mHaveSample = false;  mScaledJitter = 0; }
+
+        static intmax_t	span(tElementType inLow, tElementType inHigh) { return static_cast<intmax_t>(inHigh) - static_cast<intmax_t>(inLow); }
+
+        bool	histogram_can_hold(const tElementType& inElement)
+        {
+                if(mCounts.empty())
+                        return true;
+
+                tElementType theHighest = static_cast<tElementType>(mLowest + (mCounts.size() - 1));
+                return span(std::min(mLowest, inElement), std::max(theHighest, inElement)) < kMaxHistogramSpan;
+        }
+
+        void	retire(const tElementType& inOldElement)
+        {
+                if(mUseSortedWindow)
+                {
+                        mSortedWindow.erase(mSortedWindow.find(inOldElement));
+                        if(mSortedWindow.empty())
+                                mUseSortedWindow = false;
+                        else if(span(*mSortedWindow.begin(), *mSortedWindow.rbegin()) < kMaxHistogramSpan)
+                                use_histogram();
+                        return;
+                }
+
+                --mCounts[inOldElement - mLowest];
+
+                while(!mCounts.empty() && mCounts.back() == 0)
+                        mCounts.pop_back();
+
+                while(!mCounts.empty() && mCounts.front() == 0)
+                {
+                        mCounts.pop_front();
+                        ++mLowest;
+                }
+        }
+
+        void	use_sorted_window()
+        {
+                for(size_t i = 0; i < mCounts.size(); i++)
+                        for(unsigned int j = 0; j < mCounts[i]; j++)
+                                mSortedWindow.insert(mSortedWindow.end(), static_cast<tElementType>(mLowest + i));
+
+                mCounts.clear();
+                mUseSortedWindow = true;
+        }
+
+        void	use_histogram()
+        {
+                mLowest = *mSortedWindow.begin();
+                mCounts.assign(static_cast<size_t>(span(mLowest, *mSortedWindow.rbegin())) + 1, 0);
+                for(typename std::multiset<tElementType>::const_iterator i = mSortedWindow.begin(); i != mSortedWindow.end(); ++i)
+                        ++mCounts[*i - mLowest];
+
+                mSortedWindow.clear();
+                mUseSortedWindow = false;
+        }
+
         CircularQueue<tElementType>	mQueue;
-        std::multiset<tElementType>	mSortedElements;
+        std::deque<unsigned int>	mCounts;	// mCounts[i] is how many elements equal mLowest + i
+        std::multiset<tElementType>	mSortedWindow;	// the window instead, while it spans too many values
+        bool				mUseSortedWindow;
+        tElementType			mLowest;
+        tElementType			mLastSample;
+        bool				mHaveSample;
+        int				mScaledJitter;
 };
 
 #endif // WINDOWEDNTHELEMENTFINDER_H
@@ -312,6 +312,7 @@ static void display_credits(void);
 static void draw_button(short index, bool pressed);
 static void draw_powered_by_aleph_one();
 static void handle_replay(bool last_replay);
+static bool replaying_unattended(void);
 static bool begin_game(short user, bool cheat);
 static void start_game(short user, bool changing_level);
 // LP: "static" removed
@@ -371,7 +372,7 @@ void initialize_game_state(
 	  alert_user(expand_app_variables("Insecure Lua has been manually enabled. Malicious Lua scripts can use Insecure Lua to take over your computer. Unless you specifically trust every single Lua script that will be running, you should quit $appName$ IMMEDIATELY.").c_str());
 	}
 
-	if (!shell_options.editor && shell_options.replay_directory.empty())
+	if (!shell_options.editor && !replaying_unattended())
 	{
 		if (shell_options.skip_intro)
 		{
@@ -1002,8 +1003,19 @@ bool handle_open_replay(FileSpecifier& File)
 	bool success;
 	
 	force_system_colors();
+	if (!shell_options.export_movie.empty())
+		Movie::instance()->StartRecording(shell_options.export_movie);
 	success= begin_game(_replay_from_file, false);
-	if(!success) display_main_menu();
+	if(!success)
+	{
+		if (!shell_options.export_movie.empty())
+		{
+			Movie::instance()->StopRecording();
+			game_state.state = _quit_game;
+		}
+		else
+			display_main_menu();
+	}
 	return success;
 }
 
@@ -1926,7 +1938,7 @@ static void transfer_to_new_level(
 			finish_game(false);
 			show_cursor(); // for some reason, cursor stays hidden otherwise
 
-			if (shell_options.replay_directory.empty()) {
+			if (!replaying_unattended()) {
 				set_game_state(_begin_display_of_epilogue);
 			}
 
@@ -1966,6 +1978,13 @@ static void draw_button(
 	set_drawing_clip_rectangle(SHRT_MIN, SHRT_MIN, SHRT_MAX, SHRT_MAX);
 }
 					
+// Films played from the command line (a replay directory, or a movie export)
+// run straight through, with no menus, intermissions or postgame dialogs
+static bool replaying_unattended(void)
+{
+	return !shell_options.replay_directory.empty() || !shell_options.export_movie.empty();
+}
+
 static void handle_replay( /* This is gross. */
 	bool last_replay)
 {
@@ -2397,7 +2416,7 @@ static void finish_game(
 
 	if (game_state.user == _replay)
 	{
-		if (!shell_options.replay_directory.empty())
+		if (replaying_unattended())
 		{
 			game_state.state = _quit_game;
 			return_to_main_menu = false;
@@ -2415,7 +2434,7 @@ static void finish_game(
 	set_current_player_index(NONE);
 	
 	load_environment_from_preferences();
-	if ((game_state.user == _replay && shell_options.replay_directory.empty()) || game_state.user == _demo)
+	if ((game_state.user == _replay && !replaying_unattended()) || game_state.user == _demo)
 	{
 		Plugins::instance()->set_mode(Plugins::kMode_Menu);
 		load_film_profile(FILM_PROFILE_DEFAULT);
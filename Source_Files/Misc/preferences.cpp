@@ -3525,6 +3525,7 @@ InfoTree graphics_preferences_tree()
 	root.put_attr("movie_export_video_quality", graphics_preferences->movie_export_video_quality);
 	root.put_attr("movie_export_video_bitrate", graphics_preferences->movie_export_video_bitrate);
 	root.put_attr("movie_export_audio_quality", graphics_preferences->movie_export_audio_quality);
+	root.put_attr("movie_export_frame_queue", graphics_preferences->movie_export_frame_queue);
 	root.put_attr("scripted_effects_quality", graphics_preferences->ephemera_quality);
 	
 	root.add_color("void.color", graphics_preferences->OGL_Configure.VoidColor);
@@ -3865,6 +3866,8 @@ InfoTree network_preferences_tree()
 	root.put_attr("game_protocol", sNetworkGameProtocolNames[network_preferences->game_protocol]);
 	root.put_attr("use_netscript", network_preferences->use_netscript);
 	root.put_attr_path("netscript_file", network_preferences->netscript_file);
+	root.put_attr("use_remote_hub", network_preferences->use_remote_hub);
+	root.put_attr("remote_hub_address", network_preferences->remote_hub_address);
 	root.put_attr("cheat_flags", network_preferences->cheat_flags);
 	root.put_attr("advertise_on_metaserver", network_preferences->advertise_on_metaserver);
 	root.put_attr("attempt_upnp", network_preferences->attempt_upnp);
@@ -4003,6 +4006,7 @@ static void default_graphics_preferences(graphics_preferences_data *preferences)
 	preferences->movie_export_video_quality = 50;
 	preferences->movie_export_audio_quality = 50;
 	preferences->movie_export_video_bitrate = 0; // auto
+	preferences->movie_export_frame_queue = 4;
 
 	preferences->ephemera_quality = _ephemera_medium;
 }
@@ -4031,6 +4035,8 @@ static void default_network_preferences(network_preferences_data *preferences)
 #endif // !defined(DISABLE_NETWORKING)
 	preferences->use_netscript = false;
 	preferences->netscript_file[0] = '\0';
+	preferences->use_remote_hub = false;
+	obj_clear(preferences->remote_hub_address);
 	preferences->cheat_flags = _allow_tunnel_vision | _allow_crosshair | _allow_behindview | _allow_overlay_map;
 	preferences->advertise_on_metaserver = false;
 	preferences->attempt_upnp = false;
@@ -4476,6 +4482,7 @@ void parse_graphics_preferences(InfoTree root, std::string version)
 	root.read_attr_bounded<int16>("movie_export_video_quality", graphics_preferences->movie_export_video_quality, 0, 100);
 	root.read_attr_bounded<int16>("movie_export_audio_quality", graphics_preferences->movie_export_audio_quality, 0, 100);
 	root.read_attr("movie_export_video_bitrate", graphics_preferences->movie_export_video_bitrate);
+	root.read_attr_bounded<int16>("movie_export_frame_queue", graphics_preferences->movie_export_frame_queue, 1, 16);
 
 	root.read_attr("scripted_effects_quality", graphics_preferences->ephemera_quality);
 	
@@ -4852,6 +4859,8 @@ void parse_network_preferences(InfoTree root, std::string version)
 	
 	root.read_attr("use_netscript", network_preferences->use_netscript);
 	root.read_path("netscript_file", network_preferences->netscript_file);
+	root.read_attr("use_remote_hub", network_preferences->use_remote_hub);
+	root.read_cstr("remote_hub_address", network_preferences->remote_hub_address, 255);
 	root.read_attr("cheat_flags", network_preferences->cheat_flags);
 	root.read_attr("advertise_on_metaserver", network_preferences->advertise_on_metaserver);
 	root.read_attr("attempt_upnp", network_preferences->attempt_upnp);
@@ -98,6 +98,7 @@ struct graphics_preferences_data
 	int16 movie_export_video_quality;
 	int32 movie_export_video_bitrate; // 0 is automatic
     int16 movie_export_audio_quality;
+	int16 movie_export_frame_queue; // frames captured ahead of the encoder
 
 	int16 ephemera_quality;
 };
@@ -127,6 +128,8 @@ struct network_preferences_data
 	uint16 game_protocol; // _network_game_protocol_star, etc.
 	bool use_netscript;
 	char netscript_file[256];
+	bool use_remote_hub;	// star games: play through a standalone hub instead of hosting it
+	char remote_hub_address[256];	// "host" or "host:port"
 	uint16 cheat_flags;
 	bool advertise_on_metaserver;
 	bool attempt_upnp;
@@ -115,11 +115,25 @@ OSErr NetDDPClose(void);
 OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler);
 OSErr NetDDPCloseSocket(short ignored);
 
+#ifdef A1_NETWORK_STANDALONE_HUB
+// Waits up to inTimeout ms for packets and passes each to the packet handler
+void NetDDPWaitForPackets(uint32 inTimeout);
+#endif
+
 DDPFramePtr NetDDPNewFrame(void);
 void NetDDPDisposeFrame(DDPFramePtr frame);
 
 OSErr NetDDPSendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short socket);
 
+// Frames sent between these two go out together (where the platform allows), when
+// NetDDPEndFrameBatch() is called.  Caller must hold the mytm mutex.
+void NetDDPBeginFrameBatch(void);
+void NetDDPEndFrameBatch(void);
+
+// Hands any packets waiting for the mytm mutex to the packet handler; call with the
+// mutex held (e.g. from a tick task) to save the receiving thread a handoff.
+void NetDDPDispatchReceivedPackets(void);
+
 /* ---------- prototypes/NETWORK_ADSP.C */
 
 // jkvw: removed - we use TCPMess now
@@ -99,6 +99,10 @@ Feb 20, 2002 (Woody Zenfell):
 #include "Movie.h"
 #include "InfoTree.h"
 
+#include <algorithm>
+#include <vector>
+#include <zlib.h>
+
 /* ---------- constants */
 
 #define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
@@ -109,6 +113,14 @@ Feb 20, 2002 (Woody Zenfell):
 #define MAXIMUM_REPLAY_SPEED         5
 #define MINIMUM_REPLAY_SPEED        -5
 
+// Films with this bit set in the header version are indexed: each recording
+// chunk (RECORD_CHUNK_SIZE flags for every player) is stored as a block that
+// may be zlib-compressed, headed by the tick it starts at and its lengths, and
+// a tick index of the blocks follows the last one.
+// The bit is stripped before the version reaches get_recording_header_data().
+#define RECORDING_INDEXED_FILM_FLAG  0x4000
+#define FILM_INDEX_MAGIC            FOUR_CHARS_TO_INT('f', 'i', 'd', 'x')
+
 /* ---------- macros */
 
 #define INCREMENT_QUEUE_COUNTER(c) { (c)++; if ((c)>=MAXIMUM_QUEUE_SIZE) (c) = 0; }
@@ -131,6 +143,32 @@ static OpenedFile FilmFile;
 
 struct replay_private_data replay;
 
+enum /* film block compression */
+{
+	_film_block_uncompressed,
+	_film_block_zlib
+};
+
+struct film_index_entry
+{
+	int32 tick;
+	int32 offset;
+};
+
+// int32 tick, int16 compression, int32 raw length, int32 stored length
+const int SIZEOF_film_block_header = 14;
+const int SIZEOF_film_index_entry = 8;
+// uint32 magic, int32 index offset, int32 entry count
+const int SIZEOF_film_index_trailer = 12;
+
+static bool film_is_indexed;
+static std::vector<film_index_entry> film_index;
+// recording: the chunk being assembled; playback: the current decoded block
+static std::vector<uint8> film_block;
+static int32 film_block_offset;
+// the tick the next block starts at, for recording and for checking playback
+static int32 film_block_tick;
+
 #ifdef DEBUG
 ActionQueue *get_player_recording_queue(
 	short player_index)
@@ -145,7 +183,15 @@ ActionQueue *get_player_recording_queue(
 /* ---------- private prototypes */
 static void remove_input_controller(void);
 static void save_recording_queue_chunk(short player_index);
+static void save_recording_queue_chunks(void);
+static void write_film_block(void);
+static void write_film_index(void);
+static bool read_film_index(void);
+static void rebuild_film_index(void);
+static size_t find_film_block(int32 tick);
+static bool read_film_block(size_t block_index);
 static void read_recording_queue_chunks(void);
+static bool read_flags_from_memory(const uint8 *data, int32 size, int32& offset, int16& num_flags, uint32& action_flags);
 static short pull_flags_from_recording(short count);
 // LP modifications for object-oriented file handling; returns a test for end-of-file
 static bool vblFSRead(OpenedFile& File, int32 *count, void *dest, bool& HitEOF);
@@ -375,7 +421,7 @@ static void record_action_flags(
 /*********************************************************************************************
  *
  * Function: save_recording_queue_chunk
- * Purpose:  saves one chunk of the queue to the recording file, using run-length encoding.
+ * Purpose:  adds one chunk of the queue to the current film block, using run-length encoding.
  *
  *********************************************************************************************/
 void save_recording_queue_chunk(
@@ -440,14 +486,257 @@ void save_recording_queue_chunk(
 		num_flags_saved += RECORD_CHUNK_SIZE-max_flags;
 	}
 	
-	FilmFile.Write(count,buffer);
-	replay.header.length+= count;
+	film_block.insert(film_block.end(), buffer, buffer + count);
 		
 	vwarn(num_flags_saved == RECORD_CHUNK_SIZE,
 		csprintf(temporary, "bad recording: %d flags, max=%d, count = %u;dm #%p #%u", num_flags_saved, max_flags,
 			count, buffer, count));
 }
 
+static void save_recording_queue_chunks(
+	void)
+{
+	for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		save_recording_queue_chunk(player_index);
+	}
+	
+	write_film_block();
+}
+
+/*********************************************************************************************
+ *
+ * Function: write_film_block
+ * Purpose:  writes the chunks of every player as one block, compressed when that pays off,
+ *           and remembers where it went for the film index.
+ *
+ *********************************************************************************************/
+static void write_film_block(
+	void)
+{
+	int16 compression = _film_block_uncompressed;
+	int32 raw_length = static_cast<int32>(film_block.size());
+	
+	uLongf compressed_length = compressBound(raw_length);
+	std::vector<uint8> compressed(compressed_length);
+	if (compress2(compressed.data(), &compressed_length, film_block.data(), raw_length, Z_BEST_COMPRESSION) == Z_OK &&
+		compressed_length < static_cast<uLongf>(raw_length))
+	{
+		compression = _film_block_zlib;
+	}
+	
+	const uint8 *stored = (compression == _film_block_zlib) ? compressed.data() : film_block.data();
+	int32 stored_length = (compression == _film_block_zlib) ? static_cast<int32>(compressed_length) : raw_length;
+	
+	film_index_entry entry;
+	entry.tick = film_block_tick;
+	entry.offset = replay.header.length;
+	film_index.push_back(entry);
+	
+	uint8 BlockHeader[SIZEOF_film_block_header];
+	uint8 *S = BlockHeader;
+	ValueToStream(S, entry.tick);
+	ValueToStream(S, compression);
+	ValueToStream(S, raw_length);
+	ValueToStream(S, stored_length);
+	
+	FilmFile.Write(SIZEOF_film_block_header, BlockHeader);
+	FilmFile.Write(stored_length, const_cast<uint8 *>(stored));
+	replay.header.length += SIZEOF_film_block_header + stored_length;
+	film_block_tick += RECORD_CHUNK_SIZE;
+	
+	film_block.clear();
+}
+
+static void write_film_index(
+	void)
+{
+	int32 index_offset = replay.header.length;
+	int32 entry_count = static_cast<int32>(film_index.size());
+	
+	std::vector<uint8> buffer(entry_count * SIZEOF_film_index_entry + SIZEOF_film_index_trailer);
+	uint8 *S = buffer.data();
+	for (const auto& entry : film_index)
+	{
+		ValueToStream(S, entry.tick);
+		ValueToStream(S, entry.offset);
+	}
+	ValueToStream(S, uint32(FILM_INDEX_MAGIC));
+	ValueToStream(S, index_offset);
+	ValueToStream(S, entry_count);
+	assert(S - buffer.data() == static_cast<ptrdiff_t>(buffer.size()));
+	
+	FilmFile.Write(static_cast<int32>(buffer.size()), buffer.data());
+	replay.header.length += static_cast<int32>(buffer.size());
+}
+
+static bool read_film_index(
+	void)
+{
+	film_index.clear();
+	
+	int32 file_length;
+	if (!FilmFile.GetLength(file_length) || file_length < SIZEOF_recording_header + SIZEOF_film_index_trailer)
+		return false;
+	
+	uint8 Trailer[SIZEOF_film_index_trailer];
+	if (!FilmFile.SetPosition(file_length - SIZEOF_film_index_trailer) || !FilmFile.Read(SIZEOF_film_index_trailer, Trailer))
+		return false;
+	
+	uint32 magic;
+	int32 index_offset, entry_count;
+	uint8 *S = Trailer;
+	StreamToValue(S, magic);
+	StreamToValue(S, index_offset);
+	StreamToValue(S, entry_count);
+	
+	if (magic != FILM_INDEX_MAGIC || entry_count < 0 || index_offset < SIZEOF_recording_header ||
+		entry_count > (file_length - SIZEOF_film_index_trailer - index_offset) / SIZEOF_film_index_entry ||
+		index_offset + entry_count * SIZEOF_film_index_entry != file_length - SIZEOF_film_index_trailer)
+		return false;
+	
+	std::vector<uint8> buffer(entry_count * SIZEOF_film_index_entry);
+	if (!FilmFile.SetPosition(index_offset) || (entry_count && !FilmFile.Read(static_cast<int32>(buffer.size()), buffer.data())))
+		return false;
+	
+	film_index.resize(entry_count);
+	S = buffer.data();
+	for (auto& entry : film_index)
+	{
+		StreamToValue(S, entry.tick);
+		StreamToValue(S, entry.offset);
+	}
+	
+	return true;
+}
+
+/*********************************************************************************************
+ *
+ * Function: rebuild_film_index
+ * Purpose:  recovers the index of a film whose trailer is missing (say, one cut short by a
+ *           crash while recording) by walking the block headers; it stops at the first
+ *           block that is truncated or out of sequence.
+ *
+ *********************************************************************************************/
+static void rebuild_film_index(
+	void)
+{
+	film_index.clear();
+	
+	int32 file_length;
+	if (!FilmFile.GetLength(file_length))
+		return;
+	
+	film_index_entry entry;
+	entry.tick = 0;
+	entry.offset = SIZEOF_recording_header;
+	while (entry.offset <= file_length - SIZEOF_film_block_header)
+	{
+		uint8 BlockHeader[SIZEOF_film_block_header];
+		if (!FilmFile.SetPosition(entry.offset) || !FilmFile.Read(SIZEOF_film_block_header, BlockHeader))
+			break;
+		
+		int32 tick, raw_length, stored_length;
+		int16 compression;
+		uint8 *S = BlockHeader;
+		StreamToValue(S, tick);
+		StreamToValue(S, compression);
+		StreamToValue(S, raw_length);
+		StreamToValue(S, stored_length);
+		
+		if (tick != entry.tick || raw_length < 0 || stored_length < 0 ||
+			stored_length > file_length - entry.offset - SIZEOF_film_block_header)
+			break;
+		
+		film_index.push_back(entry);
+		entry.tick += RECORD_CHUNK_SIZE;
+		entry.offset += SIZEOF_film_block_header + stored_length;
+	}
+}
+
+/*********************************************************************************************
+ *
+ * Function: find_film_block
+ * Purpose:  looks up the block holding a tick in the film index.
+ * Returns:  the block's index, or film_index.size() if the film ends before that tick
+ *
+ *********************************************************************************************/
+static size_t find_film_block(
+	int32 tick)
+{
+	auto after = std::upper_bound(film_index.begin(), film_index.end(), tick,
+		[](int32 t, const film_index_entry& entry) { return t < entry.tick; });
+	if (after == film_index.begin() || tick >= (after - 1)->tick + RECORD_CHUNK_SIZE)
+		return film_index.size();
+	return static_cast<size_t>(after - film_index.begin()) - 1;
+}
+
+/*********************************************************************************************
+ *
+ * Function: read_film_block
+ * Purpose:  loads and decompresses one block of an indexed film; any block can be loaded
+ *           without reading the ones before it.
+ *
+ *********************************************************************************************/
+static bool read_film_block(
+	size_t block_index)
+{
+	film_block.clear();
+	film_block_offset = 0;
+	
+	if (block_index >= film_index.size())
+		return false;
+	
+	uint8 BlockHeader[SIZEOF_film_block_header];
+	if (!FilmFile.SetPosition(film_index[block_index].offset) || !FilmFile.Read(SIZEOF_film_block_header, BlockHeader))
+		return false;
+	
+	int32 tick, raw_length, stored_length;
+	int16 compression;
+	uint8 *S = BlockHeader;
+	StreamToValue(S, tick);
+	StreamToValue(S, compression);
+	StreamToValue(S, raw_length);
+	StreamToValue(S, stored_length);
+	
+	if (tick != film_index[block_index].tick || raw_length < 0 || stored_length < 0)
+	{
+		logError("film block at tick %d is damaged", film_index[block_index].tick);
+		return false;
+	}
+	
+	std::vector<uint8> stored(stored_length);
+	if (stored_length && !FilmFile.Read(stored_length, stored.data()))
+		return false;
+	
+	switch (compression)
+	{
+		case _film_block_uncompressed:
+			if (stored_length != raw_length)
+				return false;
+			film_block.swap(stored);
+			break;
+			
+		case _film_block_zlib:
+		{
+			film_block.resize(raw_length);
+			uLongf length = raw_length;
+			if (uncompress(film_block.data(), &length, stored.data(), stored_length) != Z_OK || length != static_cast<uLongf>(raw_length))
+			{
+				film_block.clear();
+				return false;
+			}
+			break;
+		}
+			
+		default:
+			logError("unknown film block compression %d", compression);
+			return false;
+	}
+	
+	return true;
+}
+
 /*********************************************************************************************
  *
  * Function: pull_flags_from_recording
@@ -527,7 +816,7 @@ void get_recording_header_data(
 	*number_of_players= replay.header.num_players;
 	*level_number= replay.header.level_number;
 	*map_checksum= replay.header.map_checksum;
-	*version= replay.header.version;
+	*version= replay.header.version & ~RECORDING_INDEXED_FILM_FLAG;
 	objlist_copy(starts, replay.header.starts, MAXIMUM_NUMBER_OF_PLAYERS);
 	obj_copy(*game_information, replay.header.game_information);
 }
@@ -559,7 +848,18 @@ bool setup_for_replay_from_file(
 		FilmFile.Read(SIZEOF_recording_header,Header);
 		unpack_recording_header(Header,&replay.header,1);
 		replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
-	
+		
+		film_is_indexed= (replay.header.version & RECORDING_INDEXED_FILM_FLAG) != 0;
+		film_block_tick= 0;
+		film_block.clear();
+		film_block_offset= 0;
+		
+		if (film_is_indexed && !read_film_index())
+		{
+			logWarning("film index is missing or damaged; rebuilding it from the blocks");
+			rebuild_film_index();
+		}
+		
 		/* Set to the mapfile this replay came from.. */
 		if(use_map_file(replay.header.map_checksum))
 		{
@@ -602,6 +902,13 @@ void start_recording(
 		if (FilmFileSpec.Open(FilmFile,true))
 		{
 			replay.game_is_being_recorded= true;
+			
+			// new films are always indexed
+			replay.header.version|= RECORDING_INDEXED_FILM_FLAG;
+			film_is_indexed= true;
+			film_index.clear();
+			film_block_tick= 0;
+			film_block.clear();
 	
 			// save a header containing information about the game.
 			byte Header[SIZEOF_recording_header];
@@ -618,14 +925,11 @@ void stop_recording(
 	{
 		replay.game_is_being_recorded = false;
 		
-		short player_index;
 		int32 total_length;
 
 		assert(replay.valid);
-		for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
-		{
-			save_recording_queue_chunk(player_index);
-		}
+		save_recording_queue_chunks();
+		write_film_index();
 
 		/* Rewrite the header, since it has the new length */
 		FilmFile.SetPosition(0);
@@ -670,6 +974,9 @@ void rewind_recording(
 		
 		// Use the packed length here!!!
 		replay.header.length= SIZEOF_recording_header;
+		film_index.clear();
+		film_block_tick= 0;
+		film_block.clear();
 	}
 }
 
@@ -700,10 +1007,7 @@ void check_recording_replaying(
 			success= FilmFile_Check.GetFreeSpace(freespace);
 			if (success && freespace>(RECORD_CHUNK_SIZE*sizeof(int16)*sizeof(uint32)*dynamic_world->player_count))
 			{
-				for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
-				{
-					save_recording_queue_chunk(player_index);
-				}
+				save_recording_queue_chunks();
 			}
 		}
 	}
@@ -757,6 +1061,8 @@ void stop_replay(
 			assert(replay.fsread_buffer);
 			delete []replay.fsread_buffer;
 		}
+		film_index.clear();
+		film_block.clear();
 #ifdef DEBUG_REPLAY
 		close_stream_file();
 #endif
@@ -776,29 +1082,38 @@ static void read_recording_queue_chunks(
 	int16 count, player_index, num_flags;
 	ActionQueue *queue;
 	
+	if (film_is_indexed)
+	{
+		// each block holds one chunk for every player
+		if (replay.have_read_last_chunk)
+			return;
+		
+		if (!read_film_block(find_film_block(film_block_tick)))
+		{
+			replay.have_read_last_chunk = true;
+			return;
+		}
+		film_block_tick += RECORD_CHUNK_SIZE;
+	}
+	
 	for (player_index = 0; player_index < dynamic_world->player_count; player_index++)
 	{
 		queue= get_player_recording_queue(player_index);
 		for (count = 0; count < RECORD_CHUNK_SIZE; )
 		{
-			if (replay.resource_data)
+			if (film_is_indexed)
 			{
-				bool hit_end= false;
+				bool hit_end = !read_flags_from_memory(film_block.data(), static_cast<int32>(film_block.size()), film_block_offset, num_flags, action_flags);
 				
-				if (replay.film_resource_offset >= replay.resource_data_size)
-				{
-					hit_end = true;
-				}
-				else
+				if (hit_end || num_flags == END_OF_RECORDING_INDICATOR)
 				{
-					uint8* S;
-					S = (uint8 *)(replay.resource_data + replay.film_resource_offset);
-					StreamToValue(S,num_flags);
-					replay.film_resource_offset += sizeof(num_flags);
-					S = (uint8 *)(replay.resource_data + replay.film_resource_offset);
-					StreamToValue(S,action_flags);
-					replay.film_resource_offset+= sizeof(action_flags);
+					replay.have_read_last_chunk= true;
+					break;
 				}
+			}
+			else if (replay.resource_data)
+			{
+				bool hit_end = !read_flags_from_memory(reinterpret_cast<uint8 *>(replay.resource_data), replay.resource_data_size, replay.film_resource_offset, num_flags, action_flags);
 				
 				if (hit_end || num_flags == END_OF_RECORDING_INDICATOR)
 				{
@@ -854,6 +1169,25 @@ static void read_recording_queue_chunks(
 	}
 }
 
+/* Reads one (run length, action flag) pair of a chunk held in memory */
+static bool read_flags_from_memory(
+	const uint8 *data,
+	int32 size,
+	int32& offset,
+	int16& num_flags,
+	uint32& action_flags)
+{
+	if (offset + int32(sizeof(num_flags) + sizeof(action_flags)) > size)
+		return false;
+	
+	uint8 *S = const_cast<uint8 *>(data + offset);
+	StreamToValue(S,num_flags);
+	StreamToValue(S,action_flags);
+	offset += sizeof(num_flags) + sizeof(action_flags);
+	
+	return true;
+}
+
 /* This is gross, (Alain wrote it, not me!) but I don't have time to clean it up */
 static bool vblFSRead(
 	OpenedFile& File,
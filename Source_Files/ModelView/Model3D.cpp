@@ -95,6 +95,7 @@ void Model3D::Clear()
 	Frames.clear();
 	SeqFrames.clear();
 	SeqFrmPointers.clear();
+	ClearPoseCache();
 	FindBoundingBox();
 }
 
@@ -700,6 +701,8 @@ bool Model3D::FindPositions_Neutral(bool UseModelTransform)
 	// Positions already there
 	if (VtxSrcIndices.empty()) return false;
 	
+	CurrentPose = -1;
+	
 	// Straight copy of the vertices:
 	
 	size_t NumVertices = VtxSrcIndices.size();
@@ -783,6 +786,8 @@ bool Model3D::FindPositions_Frame(bool UseModelTransform,
 	
 	if (InverseVSIndices.empty()) BuildInverseVSIndices();
 	
+	CurrentPose = -1;
+	
 	size_t NumVertices = VtxSrcIndices.size();
 	Positions.resize(3*NumVertices);
 	
@@ -933,6 +938,66 @@ GLshort Model3D::NumSeqFrames(GLshort SeqIndex)
 
 bool Model3D::FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
+{
+	// Quantize the crossfade, and drop the second frame if it won't be used,
+	// so that instances in the same pose have the same key
+	GLshort MixBucket = GLshort(PIN(MixFrac, 0, 1)*NUMBER_OF_POSE_MIX_BUCKETS + 0.5);
+	if (MixBucket == 0 || AddlFrameIndex == FrameIndex)
+	{
+		MixBucket = 0;
+		AddlFrameIndex = FrameIndex;
+	}
+	
+	PoseCacheClock++;
+	for (size_t ip=0; ip<PoseCache.size(); ip++)
+	{
+		PoseCacheEntry& Entry = PoseCache[ip];
+		if (Entry.UseModelTransform == UseModelTransform && Entry.SeqIndex == SeqIndex &&
+			Entry.FrameIndex == FrameIndex && Entry.AddlFrameIndex == AddlFrameIndex &&
+			Entry.MixBucket == MixBucket)
+		{
+			Entry.LastUsed = PoseCacheClock;
+			if (CurrentPose != int(ip))
+			{
+				Positions = Entry.Positions;
+				Normals = Entry.Normals;
+				CurrentPose = int(ip);
+			}
+			return true;
+		}
+	}
+	
+	if (!FindPositions_SequenceUncached(UseModelTransform, SeqIndex, FrameIndex,
+			GLfloat(MixBucket)/NUMBER_OF_POSE_MIX_BUCKETS, AddlFrameIndex))
+		return false;
+	
+	// Replace the least recently used pose
+	size_t Slot = PoseCache.size();
+	if (Slot >= POSE_CACHE_SIZE)
+	{
+		Slot = 0;
+		for (size_t ip=1; ip<PoseCache.size(); ip++)
+			if (PoseCache[ip].LastUsed < PoseCache[Slot].LastUsed) Slot = ip;
+	}
+	else
+		PoseCache.resize(Slot+1);
+	
+	PoseCacheEntry& Entry = PoseCache[Slot];
+	Entry.UseModelTransform = UseModelTransform;
+	Entry.SeqIndex = SeqIndex;
+	Entry.FrameIndex = FrameIndex;
+	Entry.AddlFrameIndex = AddlFrameIndex;
+	Entry.MixBucket = MixBucket;
+	Entry.LastUsed = PoseCacheClock;
+	Entry.Positions = Positions;
+	Entry.Normals = Normals;
+	CurrentPose = int(Slot);
+	
+	return true;
+}
+
+bool Model3D::FindPositions_SequenceUncached(bool UseModelTransform, GLshort SeqIndex,
+	GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex)
 {
 	// Bad inputs: do nothing and return false
 	
@@ -251,11 +251,38 @@ struct Model3D
 	GLshort NumSeqFrames(GLshort SeqIndex);
 	
 	// Returns whether or not the indices were in range.
+	// Sequence poses are cached per model, with the crossfade fraction rounded
+	// to one of NUMBER_OF_POSE_MIX_BUCKETS steps.
 	bool FindPositions_Sequence(bool UseModelTransform, GLshort SeqIndex,
 		GLshort FrameIndex, GLfloat MixFrac = 0, GLshort AddlFrameIndex = 0);
 	
+	// Recently found sequence poses, so that several instances of a model in the
+	// same pose (a room full of the same monster) cost one skinning pass a frame
+	enum
+	{
+		POSE_CACHE_SIZE = 4,
+		NUMBER_OF_POSE_MIX_BUCKETS = 64
+	};
+	struct PoseCacheEntry
+	{
+		bool UseModelTransform;
+		GLshort SeqIndex, FrameIndex, AddlFrameIndex, MixBucket;
+		uint32 LastUsed;
+		vector<GLfloat> Positions, Normals;
+	};
+	vector<PoseCacheEntry> PoseCache;
+	uint32 PoseCacheClock;
+	// Which pose-cache entry the position and normal arrays now hold; -1 if none
+	int CurrentPose;
+	
+	void ClearPoseCache() {PoseCache.clear(); CurrentPose = -1;}
+	
 	// Constructor
-	Model3D() {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+	Model3D(): PoseCacheClock(0), CurrentPose(-1) {FindBoundingBox(); TransformPos.Identity(); TransformNorm.Identity();}
+
+private:
+	bool FindPositions_SequenceUncached(bool UseModelTransform, GLshort SeqIndex,
+		GLshort FrameIndex, GLfloat MixFrac, GLshort AddlFrameIndex);
 };
 
 #endif
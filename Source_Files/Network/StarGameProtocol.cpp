@@ -125,7 +125,9 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, size_t
                 theConnectedPlayerStatus[i] = ((sTopology->players[i].identifier != NONE) && !sTopology->players[i].net_dead);
         }
 
-        if(inLocalPlayerIndex == inServerPlayerIndex)
+	const NetAddrBlock* theRemoteHubAddress = NetGetRemoteHubAddress();
+
+        if(inLocalPlayerIndex == inServerPlayerIndex && theRemoteHubAddress == NULL)
         {
 		sHubIsLocal = true;
 		
@@ -139,8 +141,9 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, size_t
 	else
 		sHubIsLocal = false;
 
-        spoke_initialize(sTopology->players[inServerPlayerIndex].ddpAddress, inSmallestGameTick, sTopology->player_count,
-                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal);
+	// With a standalone hub, the gatherer is just another spoke.
+        spoke_initialize(theRemoteHubAddress ? *theRemoteHubAddress : sTopology->players[inServerPlayerIndex].ddpAddress, inSmallestGameTick, sTopology->player_count,
+                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal, NetGetRemoteHubSession());
 
         *sNetStatePtr = netActive;
 
@@ -183,6 +183,11 @@ static byte *deferred_script_data = NULL;
 static size_t deferred_script_length = 0;
 static bool do_netscript;
 
+// star games only: the hub isn't the gatherer's (see NetSetRemoteHub())
+static bool use_remote_hub = false;
+static NetAddrBlock remote_hub_address;
+static uint32 remote_hub_session = 0;	// new for each level, so the hub can tell games apart
+
 static CommunicationsChannelFactory *server = NULL;
 
 typedef std::map<int, Client *> client_map_t;
@@ -479,6 +484,19 @@ bool Client::capabilities_indicate_player_is_gatherable(bool warn_joiner)
 		}
 	}
 
+	if (use_remote_hub && network_preferences->game_protocol == _network_game_protocol_star)
+	{
+		if (capabilities[Capabilities::kRemoteHub] < Capabilities::kRemoteHubVersion)
+		{
+			if (warn_joiner)
+			{
+				ServerWarningMessage serverWarningMessage(expand_app_variables("The gatherer is using a standalone hub, which needs a newer version of $appName$. You will not appear in the list of available players."), ServerWarningMessage::kJoinerUngatherable);
+				channel->enqueueOutgoingMessage(serverWarningMessage);
+			}
+			return false;
+		}
+	}
+
 	if (topology->game_data.net_game_type == _game_of_rugby)
 	{
 		if (capabilities[Capabilities::kRugby] == 0)
@@ -902,6 +920,21 @@ static void handleNetworkStatsMessage(NetworkStatsMessage *statsMessage, Communi
 	}
 }
 
+static bool handlerRemoteHubReceived = false;
+static NetAddrBlock handlerRemoteHubAddress;
+static uint32 handlerRemoteHubSession = 0;
+
+static void handleRemoteHubMessage(RemoteHubMessage *remoteHubMessage, CommunicationsChannel *)
+{
+	if (netState == netStartingUp || netState == netDown) {
+		handlerRemoteHubAddress = remoteHubMessage->address();
+		handlerRemoteHubSession = remoteHubMessage->session();
+		handlerRemoteHubReceived = true;
+	} else {
+		logAnomaly("unexpected remote hub message received (netState is %i)", netState);
+	}
+}
+
 static byte *handlerPhysicsBuffer = NULL;
 static size_t handlerPhysicsLength = 0;
 
@@ -1034,6 +1067,7 @@ static TypedMessageHandlerFunction<ServerWarningMessage> serverWarningMessageHan
 static TypedMessageHandlerFunction<ClientInfoMessage> clientInfoMessageHandler(&handleClientInfoMessage);
 static TypedMessageHandlerFunction<NetworkStatsMessage> networkStatsMessageHandler(&handleNetworkStatsMessage);
 static TypedMessageHandlerFunction<GameSessionMessage> gameSessionMessageHandler(&handleGameSessionMessage);
+static TypedMessageHandlerFunction<RemoteHubMessage> remoteHubMessageHandler(&handleRemoteHubMessage);
 static TypedMessageHandlerFunction<Message> unexpectedMessageHandler(&handleUnexpectedMessage);
 
 void NetSetGatherCallbacks(GatherCallbacks *gc) {
@@ -1173,6 +1207,7 @@ bool NetEnter(void)
 		inflater->learnPrototype(ClientInfoMessage());
 		inflater->learnPrototype(NetworkStatsMessage());
 		inflater->learnPrototype(GameSessionMessage());
+		inflater->learnPrototype(RemoteHubMessage());
 	}
   
 	if (!joinDispatcher) {
@@ -1194,6 +1229,7 @@ bool NetEnter(void)
 		joinDispatcher->setHandlerForType(&topologyMessageHandler, TopologyMessage::kType);
 		joinDispatcher->setHandlerForType(&networkStatsMessageHandler, NetworkStatsMessage::kType);
 		joinDispatcher->setHandlerForType(&gameSessionMessageHandler, GameSessionMessage::kType);
+		joinDispatcher->setHandlerForType(&remoteHubMessageHandler, RemoteHubMessage::kType);
 	}
 
 	my_capabilities.clear();
@@ -1201,6 +1237,7 @@ bool NetEnter(void)
 	my_capabilities[Capabilities::kGameworldM1] = Capabilities::kGameworldM1Version;
 	if (network_preferences->game_protocol == _network_game_protocol_star) {
 		my_capabilities[Capabilities::kStar] = Capabilities::kStarVersion;
+		my_capabilities[Capabilities::kRemoteHub] = Capabilities::kRemoteHubVersion;
 	} else {
 		my_capabilities[Capabilities::kRing] = Capabilities::kRingVersion;
 	}
@@ -1957,6 +1994,44 @@ void SetNetscriptStatus (bool status)
         do_netscript = status;
 }
 
+bool NetSetRemoteHub (const char* address)
+{
+	use_remote_hub = false;
+	if (address == NULL || address[0] == '\0')
+		return true;
+
+	std::string host = address;
+	uint16 port = DEFAULT_GAME_PORT;
+	std::string::size_type colon = host.rfind(':');
+	if (colon != std::string::npos)
+	{
+		int requested_port = atoi(host.c_str() + colon + 1);
+		if (requested_port <= 0 || requested_port > 65535)
+			return false;
+		port = static_cast<uint16>(requested_port);
+		host.resize(colon);
+	}
+
+	if (SDLNet_ResolveHost(&remote_hub_address, host.c_str(), port) < 0 || remote_hub_address.host == INADDR_NONE)
+	{
+		logWarning("could not resolve remote hub address %s", address);
+		return false;
+	}
+
+	use_remote_hub = true;
+	return true;
+}
+
+const NetAddrBlock* NetGetRemoteHubAddress()
+{
+	return use_remote_hub ? &remote_hub_address : NULL;
+}
+
+uint32 NetGetRemoteHubSession()
+{
+	return use_remote_hub ? remote_hub_session : 0;
+}
+
 // ZZZ this "ought" to distribute to all players simultaneously (by interleaving send calls)
 // in case the server bandwidth is much greater than the others' bandwidths.  But that would
 // take a fair amount of reworking of the streaming system, which only groks talking with one
@@ -2068,6 +2143,17 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 		}
 	}
 
+	if (use_remote_hub && sCurrentGameProtocol == static_cast<NetworkGameProtocol*>(&sStarGameProtocol))
+	{
+		// never 0, which means "no session"
+		do {
+			remote_hub_session = (static_cast<uint32>(rand()) << 16) ^ static_cast<uint32>(rand()) ^ machine_tick_count();
+		} while (remote_hub_session == 0);
+
+		RemoteHubMessage remoteHubMessage(remote_hub_address, remote_hub_session);
+		std::for_each(channels.begin(), channels.end(), std::bind(&CommunicationsChannel::enqueueOutgoingMessage, std::placeholders::_1, remoteHubMessage));
+	}
+
 	{
 		EndGameDataMessage endGameDataMessage;
 		std::for_each(channels.begin(), channels.end(), std::bind(&CommunicationsChannel::enqueueOutgoingMessage, std::placeholders::_1, endGameDataMessage));
@@ -2139,6 +2225,12 @@ byte *NetReceiveGameData(bool do_physics)
     } else {
       do_netscript = false;
     }
+
+    // without the message, the gatherer is the hub as usual
+    use_remote_hub = handlerRemoteHubReceived;
+    remote_hub_address = handlerRemoteHubAddress;
+    remote_hub_session = handlerRemoteHubSession;
+    handlerRemoteHubReceived = false;
     
     draw_progress_bar(10, 10);
     close_progress_dialog();
@@ -2161,6 +2253,7 @@ byte *NetReceiveGameData(bool do_physics)
       handlerLuaBuffer = NULL;
       handlerLuaLength = 0;
     }
+    handlerRemoteHubReceived = false;
     
     alert_user(infoError, strNETWORK_ERRORS, netErrMapDistribFailed, 1);
   }
@@ -2196,7 +2289,8 @@ void NetProcessMessagesInGame() {
 		connection_to_server->dispatchIncomingMessages();
 	} else {
 		// update stats
-		if (sCurrentGameProtocol == static_cast<NetworkGameProtocol*>(&sStarGameProtocol) && last_network_stats_send + network_stats_send_period < machine_tick_count())
+		// a standalone hub keeps its stats to itself
+		if (sCurrentGameProtocol == static_cast<NetworkGameProtocol*>(&sStarGameProtocol) && !use_remote_hub && last_network_stats_send + network_stats_send_period < machine_tick_count())
 		{
 			std::vector<NetworkStats> stats(topology->player_count);
 			for (int playerIndex = 0; playerIndex < topology->player_count; ++playerIndex)
@@ -2534,10 +2628,14 @@ const NetworkStats& NetGetStats(int player_index)
 				return sInvalidStats;
 			}
 		}
-		else
+		else if (!use_remote_hub)
 		{
 			return hub_stats(player_index);
 		}
+		else
+		{
+			return sInvalidStats;
+		}
 	}
 	else
 	{
@@ -270,6 +270,11 @@ byte* NetReceiveGameData(bool do_physics);
 void DeferredScriptSend (byte* data, size_t length);
 void SetNetscriptStatus (bool status);
 
+// Gatherer: in star games, play through the standalone hub at address ("host"
+// or "host:port") instead of running the hub; NULL or "" runs it as usual.
+// Returns false, and runs the hub, if the address can't be resolved.
+bool NetSetRemoteHub (const char* address);
+
 void display_net_game_stats(void);
 
 // ZZZ change: caller specifies int16 ID for distribution type.  Unknown types (when received) are
@@ -46,6 +46,7 @@ class Capabilities : public capabilities_t
   static const int kZippedDataVersion = 1; // map, lua, physics
   static const int kNetworkStatsVersion = 1; // latency, jitter, errors
   static const int kRugbyVersion = 1; // sane score limit
+  static const int kRemoteHubVersion = 2; // hub address and session sent with game data
 
   static const string kGameworld;    // the PRNG, physics, etc.
   static const string kGameworldM1;  // like gameworld, but for Marathon 1 compatibility
@@ -57,6 +58,8 @@ class Capabilities : public capabilities_t
   static const string kZippedData;   // can receive zipped data
   static const string kNetworkStats; // can receive network stats
   static const string kRugby;        // rugby version
+  static const string kRemoteHub;    // can play through a hub the gatherer
+                                     // isn't running
   
   uint32& operator[](const string& k) { 
     assert(k.length() < kMaxKeySize);
@@ -1179,6 +1179,11 @@ bool SetupNetgameDialog::SetupNetworkGameByRunning (
 	FilePref scriptPref (active_network_preferences->netscript_file);
 	binders.insert<FileSpecifier> (m_scriptWidget, &scriptPref);
 
+	BoolPref useRemoteHubPref (active_network_preferences->use_remote_hub);
+	binders.insert<bool> (m_useRemoteHubWidget, &useRemoteHubPref);
+	CStringPref remoteHubPref (active_network_preferences->remote_hub_address, 255);
+	binders.insert<std::string> (m_remoteHubWidget, &remoteHubPref);
+
 #ifdef HAVE_MINIUPNPC
 	BoolPref useUpnpPref (active_network_preferences->attempt_upnp);
 	binders.insert<bool> (m_useUpnpWidget, &useUpnpPref);
@@ -1295,6 +1300,12 @@ bool SetupNetgameDialog::SetupNetworkGameByRunning (
 	
 		game_information->cheat_flags = active_network_preferences->cheat_flags;
 
+		// informationIsAcceptable () already checked that the hub resolves
+		if (active_network_preferences->game_protocol == _network_game_protocol_star && active_network_preferences->use_remote_hub)
+			NetSetRemoteHub (active_network_preferences->remote_hub_address);
+		else
+			NetSetRemoteHub (NULL);
+
 		outAdvertiseGameOnMetaserver = active_network_preferences->advertise_on_metaserver;
 		outUpnpPortForward = active_network_preferences->attempt_upnp;
 
@@ -1471,6 +1482,12 @@ bool SetupNetgameDialog::informationIsAcceptable ()
 		short index = 0;
 		information_is_acceptable = get_indexed_entry_point(&ep, &index, get_entry_point_flags_for_game_type(m_old_game_type));
 	}
+
+	if (information_is_acceptable)
+		if (m_useRemoteHubWidget->get_value ())
+		{
+			information_is_acceptable = NetSetRemoteHub (m_remoteHubWidget->get_text ().c_str ());
+		}
 		
 	return (information_is_acceptable);
 }
@@ -2780,6 +2797,16 @@ public:
 #endif
 		use_netscript_w->add_dependent_widget(choose_script_w);
 
+		network_table->add_row(new w_spacer(), true);
+		w_enabling_toggle* use_remote_hub_w = new w_enabling_toggle (network_preferences->use_remote_hub);
+		network_table->dual_add(use_remote_hub_w, m_dialog);
+		network_table->dual_add(use_remote_hub_w->label("Use Standalone Hub"), m_dialog);
+
+		w_text_entry* remote_hub_w = new w_text_entry (255, "");
+		network_table->add(new w_spacer(), true);
+		network_table->dual_add(remote_hub_w, m_dialog);
+		use_remote_hub_w->add_dependent_widget(remote_hub_w);
+
 		left_placer->add(new w_spacer(), true);
 		table_placer *options_table = new table_placer(2, get_theme_space(ITEM_WIDGET));
 		options_table->col_flags(1, placeable::kAlignLeft);
@@ -2905,6 +2932,9 @@ public:
 	
 		m_useScriptWidget = new ToggleWidget (use_netscript_w);
 		m_scriptWidget = new FileChooserWidget (choose_script_w);
+
+		m_useRemoteHubWidget = new ToggleWidget (use_remote_hub_w);
+		m_remoteHubWidget = new EditTextWidget (remote_hub_w);
 	
 		m_liveCarnageWidget = new ToggleWidget (live_w);
 		m_motionSensorWidget = new ToggleWidget (sensor_w);
@@ -419,6 +419,9 @@ protected:
 	
 	ToggleWidget*		m_useScriptWidget;
 	FileChooserWidget*	m_scriptWidget;
+
+	ToggleWidget*		m_useRemoteHubWidget;
+	EditTextWidget*		m_remoteHubWidget;
 	
 	ToggleWidget*		m_liveCarnageWidget;
 	ToggleWidget*		m_motionSensorWidget;
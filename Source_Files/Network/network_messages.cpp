@@ -270,6 +270,20 @@ bool NetworkStatsMessage::reallyInflateFrom(AIStream& inputStream) {
 	return true;
 }
 
+void RemoteHubMessage::reallyDeflateTo(AOStream& outputStream) const {
+	// already in network byte order, like the topology's addresses
+	outputStream.write((byte *) &mAddress.host, 4);
+	outputStream.write((byte *) &mAddress.port, 2);
+	outputStream << mSession;
+}
+
+bool RemoteHubMessage::reallyInflateFrom(AIStream& inputStream) {
+	inputStream.read((byte *) &mAddress.host, 4);
+	inputStream.read((byte *) &mAddress.port, 2);
+	inputStream >> mSession;
+	return true;
+}
+
 void ServerWarningMessage::reallyDeflateTo(AOStream& outputStream) const {
   outputStream << (uint16) mReason;
   write_string(outputStream, mString.c_str());
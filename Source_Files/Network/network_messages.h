@@ -52,7 +52,8 @@ enum {
   kZIPPED_PHYSICS_MESSAGE,
   kZIPPED_LUA_MESSAGE,
   kNETWORK_STATS_MESSAGE,
-  kGAME_SESSION_MESSAGE
+  kGAME_SESSION_MESSAGE,
+  kREMOTE_HUB_MESSAGE
 };
 
 template <MessageTypeID tMessageType, typename tValueType>
@@ -359,6 +360,33 @@ protected:
 	bool reallyInflateFrom(AIStream& inputStream);
 };
 
+// Sent with the game data when the gatherer plays through a standalone hub
+class RemoteHubMessage : public SmallMessageHelper
+{
+public:
+	enum { kType = kREMOTE_HUB_MESSAGE };
+
+	RemoteHubMessage() : SmallMessageHelper(), mSession(0) { obj_clear(mAddress); }
+	RemoteHubMessage(const NetAddrBlock& address, uint32 session) : SmallMessageHelper(), mAddress(address), mSession(session) { }
+
+	RemoteHubMessage* clone() const {
+		return new RemoteHubMessage(*this);
+	}
+
+	MessageTypeID type() const { return kType; }
+
+	const NetAddrBlock& address() const { return mAddress; }
+	uint32 session() const { return mSession; }
+
+protected:
+	void reallyDeflateTo(AOStream& outputStream) const;
+	bool reallyInflateFrom(AIStream& inputStream);
+
+private:
+	NetAddrBlock mAddress;
+	uint32 mSession;
+};
+
 class ServerWarningMessage : public SmallMessageHelper
 {
 public:
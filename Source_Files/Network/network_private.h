@@ -298,6 +298,11 @@ class Message;
 
 const NetDistributionInfo* NetGetDistributionInfoForType(int16 inType);
 
+// The standalone hub this game plays through, or NULL if the gatherer is the hub
+const NetAddrBlock* NetGetRemoteHubAddress();
+// Tags this level's packets to and from the standalone hub; 0 without one
+uint32 NetGetRemoteHubSession();
+
 struct ClientChatInfo
 {
 	std::string name;
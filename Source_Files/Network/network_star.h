@@ -44,6 +44,7 @@ enum {
         kEndOfMessagesMessageType = 0x454d,	// 'EM'
         kTimingAdjustmentMessageType = 0x5441,	// 'TA'
         kPlayerNetDeadMessageType = 0x4e44,	// 'ND'
+	kPlayerStatusMessageType = 0x5053,	// 'PS' (V2 only: timing adjustment and netdead players together)
 	kSpokeToHubLossyByteStreamMessageType = 0x534c,	// 'SL'
 	kHubToSpokeLossyByteStreamMessageType = 0x484c, // 'HL'
 
@@ -51,6 +52,10 @@ enum {
 	kSpokeToHubGameDataPacketV1Magic = 0x5331, // 'S1'
 	kHubToSpokeGameDataPacketV1Magic = 0x4831, // 'H1'
 	kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic = 0x4631, // 'F1'
+	// V2 packets are laid out as V1, except the action_flags section (see write_action_flags())
+	kSpokeToHubGameDataPacketV2Magic = 0x5332, // 'S2'
+	kHubToSpokeGameDataPacketV2Magic = 0x4832, // 'H2'
+	kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic = 0x4632, // 'F2'
 	kPingRequestPacket = 0x5051, // 'PQ'
 	kPingResponsePacket = 0x5052, // 'PR'
 
@@ -58,6 +63,23 @@ enum {
         kActionFlagsSerializedLength = 4,	// bytes for each serialized action_flags_t (should be elsewhere)
 	
 	kStarPacketHeaderSize = 4, // 2 bytes for packet magic, 2 for CRC
+
+	// Feature bits a spoke may append to its identification packet.  The hub answers a
+	// spoke that can read V2 packets with V2 packets; a spoke that gets one may send V2.
+	kSpokeFeatureV2GameData = 0x0001,
+
+	// After the feature bits, a spoke appends the game's player count (uint16), first
+	// real tick (int32) and connected-players bitmask (uint32) for a standalone hub.
+	kSpokeIdentificationGameShapeSize = 2 + 4 + 4,
+
+	// Then, for a standalone hub, the level's session (uint32, never 0).  A hub that was
+	// told one puts it right after the header of every game data packet it sends, and
+	// spokes drop packets from any other session, so a level never hears the last one.
+	kSpokeIdentificationSessionSize = 4,
+
+	kRawActionFlagsEncoding = 0,
+	kDeltaActionFlagsEncoding = 1,
+	kMaxExpandedActionFlagsSize = 4 * ddpMaxData,	// decoded V2 flags section, in V1 layout
 };
 
 typedef uint32 action_flags_t;	// (should be elsewhere)
@@ -66,15 +88,33 @@ typedef WritableTickBasedCircularQueue<action_flags_t> WritableTickBasedActionQu
 
 
 class InfoTree;
+class AIStream;
+class AOStream;
+
+// V2 action_flags section: an encoding byte, then either raw flags (as in V1) or, if smaller,
+// each flags value XORed with the one inStride values earlier (0 for the first inStride),
+// written as varints with runs of unchanged flags collapsed.
+extern void write_action_flags(AOStream& ps, const action_flags_t* inFlags, size_t inCount, size_t inStride);
+// Reads the rest of ps as a V2 action_flags section into outBuffer in V1 layout; returns
+// the number of bytes written.  Throws AStream::failure on malformed or oversized input.
+extern size_t read_action_flags(AIStream& ps, uint8* outBuffer, size_t inBufferSize);
 
 extern void hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, size_t inLocalPlayerIndex);
 extern void hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick);
 extern void hub_received_network_packet(DDPPacketBufferPtr inPacket);
 extern void DefaultHubPreferences();
+#ifndef A1_NETWORK_STANDALONE_HUB
 extern InfoTree HubPreferencesTree();
 extern void HubParsePreferencesTree(InfoTree prefs, std::string version);
+#else
+// Standalone hub drives the hub from its own event loop: call once per tick.
+// Returns false once the game is over (everyone has left or gone netdead).
+extern bool hub_standalone_tick();
+// Call before hub_initialize(); 0 sends untagged packets, as an in-game hub does.
+extern void hub_standalone_set_session(uint32 inSession);
+#endif
 
-extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal);
+extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inSession = 0);
 extern void spoke_cleanup(bool inGraceful);
 extern void spoke_received_network_packet(DDPPacketBufferPtr inPacket);
 extern int32 spoke_get_net_time();
@@ -54,7 +54,9 @@
 #include "Logging.h"
 #include "WindowedNthElementFinder.h"
 #include "CircularByteBuffer.h"
+#ifndef A1_NETWORK_STANDALONE_HUB
 #include "InfoTree.h"
+#endif
 
 #include <vector>
 #include <map>
@@ -66,7 +68,10 @@
 #include "crc.h"
 #include "player.h" // for masking out action flags triggers :(
 
+// Standalone hub has no local data directory to write timing logs into
+#ifndef A1_NETWORK_STANDALONE_HUB
 #define DEBUG_TIMING_ADJUSTMENTS
+#endif
 
 #ifdef DEBUG_TIMING_ADJUSTMENTS
 #include "FileHandler.h"
@@ -155,7 +160,12 @@ enum {
 
 	kLatencyBufferSize = TICKS_PER_SECOND * 5, // store 5 seconds of ping counts
 	kDisplayLatencyWindow = TICKS_PER_SECOND * 1, // display last second's ping
-	kJitterUpdateInterval = TICKS_PER_SECOND * 1 / 2
+	kJitterUpdateInterval = TICKS_PER_SECOND * 1 / 2,
+
+	// A player whose arrival offsets are this steady (in sixteenths of a tick; see
+	// WindowedNthElementFinder) gets a timing decision once a quarter of the window is in.
+	kSteadyArrivalScaledJitter = 2 * 16,
+	kMinimumEarlyTimingSamples = TICKS_PER_SECOND / 2
 };
 
 
@@ -210,6 +220,7 @@ static int32 sLastRealUpdate;
 struct NetworkPlayer_hub {
         NetAddrBlock	mAddress;		// network address of player
 	bool		mAddressKnown;		// did player tell us his address yet?
+	bool		mV2GameData;		// does player read V2 game data packets?
         bool		mConnected;		// is player still connected?
         int32		mLastNetworkTickHeard;	// our sNetworkTicker last time we got a packet from them
         int32		mSmallestUnacknowledgedTick;
@@ -335,6 +346,9 @@ static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
 
 static myTMTaskPtr	sHubTickTask = NULL;
 static bool		sHubActive = false;	// used to enable the packet handler
+#ifdef A1_NETWORK_STANDALONE_HUB
+static uint32		sSession = 0;	// see kSpokeIdentificationSessionSize
+#endif
 static bool		sHubInitialized = false;
 
 
@@ -342,7 +356,7 @@ static bool		sHubInitialized = false;
 static void hub_check_for_completion();
 static void player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick);
 static bool player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick);
-static void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex);
+static void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex, bool inV2);
 static void hub_received_identification_packet(AIStream& ps, NetAddrBlock address);
 static void hub_received_ping_request(AIStream& ps, NetAddrBlock address);
 static void hub_received_ping_response(AIStream& ps, NetAddrBlock address);
@@ -468,7 +482,8 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 	sReferencePlayerIndex = sLocalPlayerIndex;
 
 #ifdef A1_NETWORK_STANDALONE_HUB
-	// There is no local player on standalone hub.
+	// There is no local player on standalone hub; the caller's index names
+	// the player we measure timing against until they drop.
 	sLocalPlayerIndex = (size_t)NONE;
 #endif
 
@@ -522,6 +537,7 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 
                 thePlayer.mLastNetworkTickHeard = 0;
 		thePlayer.mLastRecoverySend = 0;
+		thePlayer.mV2GameData = false;
                 thePlayer.mSmallestUnacknowledgedTick = theFirstTick;
 		thePlayer.mSmallestUnheardTick = theFirstTick;
 		thePlayer.mNthElementFinder.reset(sHubPreferences.mPregameWindowSize);
@@ -553,7 +569,9 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 
         sHubActive = true;
 
+#ifndef A1_NETWORK_STANDALONE_HUB
         sHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick);
+#endif
 
 	sHubInitialized = true;
 }
@@ -675,7 +693,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 
 		if (thePacketCRC != calculate_data_crc_ccitt(inPacket->datagramData, inPacket->datagramSize))
 		{
-			if (thePacketMagic == kSpokeToHubGameDataPacketV1Magic)
+			if (thePacketMagic == kSpokeToHubGameDataPacketV1Magic || thePacketMagic == kSpokeToHubGameDataPacketV2Magic)
 			{
 				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
 				if (theEntry != sAddressToPlayerIndex.end())
@@ -690,6 +708,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
                 switch(thePacketMagic)
                 {
                         case kSpokeToHubGameDataPacketV1Magic:
+                        case kSpokeToHubGameDataPacketV2Magic:
 			{
 				// Find sender
 				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
@@ -700,7 +719,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 				
 				if (getNetworkPlayer(theSenderIndex).mConnected)
 				{
-					hub_received_game_data_packet_v1(ps, theSenderIndex);
+					hub_received_game_data_packet_v1(ps, theSenderIndex, thePacketMagic == kSpokeToHubGameDataPacketV2Magic);
 				}
 				else
 				{
@@ -740,6 +759,14 @@ hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
 {
 	int16 theSenderIndex;
 	ps >> theSenderIndex;
+
+	if (theSenderIndex < 0 || static_cast<size_t>(theSenderIndex) >= sNetworkPlayers.size())
+		return;
+
+	// Older spokes don't send feature bits
+	uint16 theFeatures = 0;
+	if (ps.tellg() < ps.maxg())
+		ps >> theFeatures;
 	
 	if (!sNetworkPlayers[theSenderIndex].mAddressKnown) {
 		sAddressToPlayerIndex[address] = theSenderIndex;
@@ -747,6 +774,9 @@ hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
 		sNetworkPlayers[theSenderIndex].mAddress = address;
 	}
 
+	if (memcmp(&sNetworkPlayers[theSenderIndex].mAddress, &address, sizeof(address)) == 0)
+		sNetworkPlayers[theSenderIndex].mV2GameData = (theFeatures & kSpokeFeatureV2GameData) != 0;
+
 } // hub_received_idetification_packet()
 
 
@@ -805,11 +835,24 @@ hub_received_ping_response(AIStream& ps, NetAddrBlock address)
 } // hub_received_ping_response()
 
 
+// A full window always decides; on a steady link a quarter window is enough, so timing
+// converges (and latency drops) sooner without risking more stalls on a jittery one.
+static bool
+timing_window_ready(WindowedNthElementFinder<int32>& inFinder)
+{
+	if(inFinder.window_full())
+		return true;
+
+	return inFinder.size() >= std::max<unsigned int>(inFinder.window_size() / 4, kMinimumEarlyTimingSamples)
+		&& inFinder.scaled_jitter() <= kSteadyArrivalScaledJitter;
+}
+
+
 // I suppose to be safer, this should check the entire packet before acting on any of it.
 // As it stands, a malformed packet could have have a well-formed prefix of it interpreted
 // before the remainder is discarded.
 static void
-hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
+hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex, bool inV2)
 {
         // Process the piggybacked acknowledgement
         int32	theSmallestUnacknowledgedTick;
@@ -839,8 +882,13 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         int32	theStartTick;
         ps >> theStartTick;
 
+	// V2 flags are expanded to the V1 layout and read from there
+	uint8 theExpandedFlags[kMaxExpandedActionFlagsSize];
+	AIStreamBE theExpandedStream(theExpandedFlags, inV2 ? read_action_flags(ps, theExpandedFlags, sizeof(theExpandedFlags)) : 0);
+	AIStream& fs = inV2 ? static_cast<AIStream&>(theExpandedStream) : ps;
+
         // Make sure there's an integral number of action_flags
-        int	theRemainingDataLength = ps.maxg() - ps.tellg();
+        int	theRemainingDataLength = fs.maxg() - fs.tellg();
         if(theRemainingDataLength % kActionFlagsSerializedLength != 0)
                 return;
 
@@ -868,7 +916,7 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 //        int	theRedundantActionFlagsCount = std::min(theQueue.getWriteTick() - theStartTick, theActionFlagsCount);
 	int     theRedundantActionFlagsCount = std::min(theLateQueue.getWriteTick() - theStartTick, theActionFlagsCount);
 	int	theRedundantDataLength = theRedundantActionFlagsCount * kActionFlagsSerializedLength;
-	ps.ignore(theRedundantDataLength);
+	fs.ignore(theRedundantDataLength);
 
 	assert(theQueue.getWriteTick() >= theLateQueue.getWriteTick());
 	// Enqueue late flags
@@ -876,7 +924,7 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 	for (int i = 0; i < theLateActionFlagsCount; i++)
 	{
 		action_flags_t theActionFlags;
-		ps >> theActionFlags;
+		fs >> theActionFlags;
 		// we consume these faster than we enqueue them (hopefully)
 		// so, not checking for capacity though we probably should
 		theLateQueue.enqueue(theActionFlags);
@@ -893,7 +941,7 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         for(int i = 0; i < theEnqueueableFlagsCount; i++)
         {
                 action_flags_t theActionFlags;
-                ps >> theActionFlags;
+                fs >> theActionFlags;
                 theQueue.enqueue(theActionFlags);
 		theLateQueue.enqueue(theActionFlags);
 		sLastFlagsReceived[inSenderIndex] = theActionFlags;
@@ -915,9 +963,10 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         if(thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick && static_cast<int32>(thePlayer.mNthElementFinder.window_size()) != sHubPreferences.mInGameWindowSize)
 		thePlayer.mNthElementFinder.reset(sHubPreferences.mInGameWindowSize);
 
-	if(thePlayer.mOutstandingTimingAdjustment == 0 && thePlayer.mNthElementFinder.window_full())
+	if(thePlayer.mOutstandingTimingAdjustment == 0 && timing_window_ready(thePlayer.mNthElementFinder))
 	{
-		thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element((thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick) ? sHubPreferences.mInGameNthElement : sHubPreferences.mPregameNthElement);
+		int32 theNthElement = (thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick) ? sHubPreferences.mInGameNthElement : sHubPreferences.mPregameNthElement;
+		thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element(theNthElement * thePlayer.mNthElementFinder.size() / thePlayer.mNthElementFinder.window_size());
 
 		if(thePlayer.mOutstandingTimingAdjustment != 0)
 		{
@@ -969,10 +1018,8 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 				}
 				dout << std::endl;
 			}
-
-		}
-		
 #endif
+		}
 	}
 	
         // Do any needed post-processing
@@ -1070,7 +1117,7 @@ static bool make_up_flags_for_first_incomplete_tick()
 		return false;
 
 	// never make up flags for ourself
-	if (getFlagsQueue(sLocalPlayerIndex).getWriteTick() == sSmallestIncompleteTick)
+	if (sLocalPlayerIndex != (size_t)NONE && getFlagsQueue(sLocalPlayerIndex).getWriteTick() == sSmallestIncompleteTick)
 		return false;
 
 	// check to make sure everyone we want to make up flags for is in the lagging players bitmask
@@ -1281,6 +1328,21 @@ make_player_netdead(int inPlayerIndex)
 		thePlayer.mConnected = false;
 		sConnectedPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
 		sAddressToPlayerIndex.erase(thePlayer.mAddress);
+
+#ifdef A1_NETWORK_STANDALONE_HUB
+		// measure timing against someone who is still around
+		if (inPlayerIndex == sReferencePlayerIndex)
+		{
+			for (size_t i = 0; i < sNetworkPlayers.size(); i++)
+			{
+				if (sNetworkPlayers[i].mConnected)
+				{
+					sReferencePlayerIndex = i;
+					break;
+				}
+			}
+		}
+#endif
 	}
 
 	// We save this off because player_provided... call below may change it.
@@ -1300,6 +1362,9 @@ static int add_squares(int x, int y) { return x + y * y; }
 static bool
 hub_tick()
 {
+	// Pick up packets that arrived since last tick, while we hold the mutex anyway
+	NetDDPDispatchReceivedPackets();
+
         sNetworkTicker++;
 
 	logContextNMT("performing hub_tick %d", sNetworkTicker);
@@ -1435,6 +1500,21 @@ hub_tick()
         return true;
 }
 
+#ifdef A1_NETWORK_STANDALONE_HUB
+bool
+hub_standalone_tick()
+{
+	hub_tick();
+	return sHubActive && sConnectedPlayersBitmask != 0;
+}
+
+void
+hub_standalone_set_session(uint32 inSession)
+{
+	sSession = inSession;
+}
+#endif
+
 #ifndef INT8_MAX
 #define INT8_MAX 127
 #endif
@@ -1442,6 +1522,12 @@ hub_tick()
 #define INT8_MIN -128
 #endif
 
+enum {
+	kMaxV2FlagsCount = kMaxExpandedActionFlagsSize / kActionFlagsSerializedLength
+};
+
+static action_flags_t sV2FlagsScratch[kMaxV2FlagsCount];
+
 static void
 send_packets()
 {
@@ -1465,6 +1551,9 @@ send_packets()
 	{
 		sFlagSendTimeQueue.enqueue(sNetworkTicker);
 	}
+
+	// one sendmmsg() for all spokes, where available
+	NetDDPBeginFrameBatch();
 		
         for(size_t i = 0; i < sNetworkPlayers.size(); i++)
         {
@@ -1475,10 +1564,41 @@ send_packets()
                         AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
 
                         try {
+#ifdef A1_NETWORK_STANDALONE_HUB
+				if(sSession != 0)
+					ps << sSession;
+#endif
+
                                 // acknowledgement
                                 ps << getFlagsQueue(i).getWriteTick();
         
                                 // Messages
+				if(thePlayer.mV2GameData)
+				{
+					// Timing adjustment and netdead players in one message
+					uint8 theNetDeadCount = 0;
+					for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+					{
+						if(thePlayer.mSmallestUnacknowledgedTick <= sNetworkPlayers[j].mNetDeadTick)
+							theNetDeadCount++;
+					}
+
+					if(thePlayer.mOutstandingTimingAdjustment != 0 || theNetDeadCount > 0)
+					{
+						int8 adjustment = PIN(thePlayer.mOutstandingTimingAdjustment, INT8_MIN, INT8_MAX);
+						ps << (uint16)kPlayerStatusMessageType
+						   << adjustment
+						   << theNetDeadCount;
+
+						for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+						{
+							if(thePlayer.mSmallestUnacknowledgedTick <= sNetworkPlayers[j].mNetDeadTick)
+								ps << (uint8)j << sNetworkPlayers[j].mNetDeadTick;
+						}
+					}
+				}
+				else
+				{
                                 // Timing adjustment?
                                 if(thePlayer.mOutstandingTimingAdjustment != 0)
                                 {
@@ -1497,6 +1617,7 @@ send_packets()
                                                         << sNetworkPlayers[j].mNetDeadTick;
                                         }
                                 }
+				}
 
 				// Lossy streaming data?
 				if(haveLossyData && ((theDescriptor.mDestinations & (((uint32)1) << i)) != 0))
@@ -1601,6 +1722,9 @@ send_packets()
         
                                 // Now, encode the flags in tick-major order (this is much easier to decode
                                 // at the other end)
+				// V2 collects them first, so they can be delta coded per player.
+				size_t theV2FlagsCount = 0;
+				size_t theV2Stride = 0;
                                 for(int32 tick = startTick; tick < endTick; tick++)
                                 {
                                         for(size_t j = 0; j < sNetworkPlayers.size(); j++)
@@ -1612,12 +1736,26 @@ send_packets()
                                                                 ps << tick;
                                                                 haveSentStartTick = true;
                                                         }
-                                                        ps << getFlagsQueue(j).peek(tick);
+							if(!thePlayer.mV2GameData)
+								ps << getFlagsQueue(j).peek(tick);
+							else if(theV2FlagsCount < kMaxV2FlagsCount)
+								sV2FlagsScratch[theV2FlagsCount++] = getFlagsQueue(j).peek(tick);
+							else
+								throw AStream::failure("too many action_flags for one packet");
                                                 }
                                         }
+
+					if(tick == startTick)
+						theV2Stride = theV2FlagsCount;
                                 }
+
+				if(thePlayer.mV2GameData && haveSentStartTick)
+					write_action_flags(ps, sV2FlagsScratch, theV2FlagsCount, std::max<size_t>(theV2Stride, 1));
 				
-				hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
+				if(thePlayer.mV2GameData)
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic : kHubToSpokeGameDataPacketV2Magic);
+				else
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
 
 				// blank out the CRC field before calculating
 				sOutgoingFrame->data[2] = 0;
@@ -1650,9 +1788,157 @@ send_packets()
 		sOutgoingLossyByteStreamData.dequeue(theDescriptor.mLength);
 		sOutgoingLossyByteStreamDescriptors.dequeue();
 	}
-	
+
+	NetDDPEndFrameBatch();
 } // send_packets()
 
+
+// V2 action_flags coding.  Tokens are varints: odd n is one flags value XORed with its
+// predecessor (n >> 1), even n is a run of (n >> 1) + 1 unchanged values.
+static bool
+put_varint(uint8* ioBuffer, size_t inBufferSize, size_t& ioSize, uint64_t inValue)
+{
+	do
+	{
+		if(ioSize >= inBufferSize)
+			return false;
+
+		uint8 theByte = inValue & 0x7f;
+		inValue >>= 7;
+		ioBuffer[ioSize++] = theByte | (inValue ? 0x80 : 0);
+	} while(inValue);
+
+	return true;
+}
+
+static uint64_t
+get_varint(AIStream& ps)
+{
+	uint64_t theValue = 0;
+	for(int theShift = 0; theShift < 64; theShift += 7)
+	{
+		uint8 theByte;
+		ps >> theByte;
+		theValue |= static_cast<uint64_t>(theByte & 0x7f) << theShift;
+		if(!(theByte & 0x80))
+			return theValue;
+	}
+
+	throw AStream::failure("varint too long");
+}
+
+// Returns the encoded size, or 0 if it doesn't fit in inBufferSize
+static size_t
+encode_delta_action_flags(const action_flags_t* inFlags, size_t inCount, size_t inStride, uint8* outBuffer, size_t inBufferSize)
+{
+	size_t theSize = 0;
+	if(!put_varint(outBuffer, inBufferSize, theSize, inStride))
+		return 0;
+
+	size_t theRun = 0;
+	for(size_t i = 0; i < inCount; i++)
+	{
+		action_flags_t theDelta = inFlags[i] ^ ((i >= inStride) ? inFlags[i - inStride] : 0);
+		if(theDelta == 0)
+		{
+			theRun++;
+			continue;
+		}
+
+		if(theRun > 0 && !put_varint(outBuffer, inBufferSize, theSize, static_cast<uint64_t>(theRun - 1) << 1))
+			return 0;
+		theRun = 0;
+
+		if(!put_varint(outBuffer, inBufferSize, theSize, (static_cast<uint64_t>(theDelta) << 1) | 1))
+			return 0;
+	}
+
+	if(theRun > 0 && !put_varint(outBuffer, inBufferSize, theSize, static_cast<uint64_t>(theRun - 1) << 1))
+		return 0;
+
+	return theSize;
+}
+
+void
+write_action_flags(AOStream& ps, const action_flags_t* inFlags, size_t inCount, size_t inStride)
+{
+	assert(inStride > 0);
+
+	size_t theRawSize = inCount * kActionFlagsSerializedLength;
+
+	uint8 theDelta[ddpMaxData];
+	size_t theDeltaSize = 0;
+	if(theRawSize <= kMaxExpandedActionFlagsSize)
+		theDeltaSize = encode_delta_action_flags(inFlags, inCount, inStride, theDelta, sizeof(theDelta));
+
+	if(theDeltaSize > 0 && theDeltaSize < theRawSize)
+	{
+		ps << (uint8)kDeltaActionFlagsEncoding;
+		ps.write(theDelta, theDeltaSize);
+	}
+	else
+	{
+		ps << (uint8)kRawActionFlagsEncoding;
+		for(size_t i = 0; i < inCount; i++)
+			ps << inFlags[i];
+	}
+}
+
+size_t
+read_action_flags(AIStream& ps, uint8* outBuffer, size_t inBufferSize)
+{
+	uint8 theEncoding;
+	ps >> theEncoding;
+
+	size_t theRemaining = ps.maxg() - ps.tellg();
+	if(theEncoding == kRawActionFlagsEncoding)
+	{
+		if(theRemaining > inBufferSize)
+			throw AStream::failure("too many action_flags");
+
+		ps.read(outBuffer, theRemaining);
+		return theRemaining;
+	}
+
+	if(theEncoding != kDeltaActionFlagsEncoding)
+		throw AStream::failure("unknown action_flags encoding");
+
+	size_t theMaxCount = inBufferSize / kActionFlagsSerializedLength;
+	uint64_t theStride = get_varint(ps);
+	if(theStride == 0 || theStride > theMaxCount)
+		throw AStream::failure("bad action_flags stride");
+
+	size_t theCount = 0;
+	while(ps.tellg() < ps.maxg())
+	{
+		uint64_t theToken = get_varint(ps);
+		uint64_t theRepeat = (theToken & 1) ? 1 : (theToken >> 1) + 1;
+		if((theToken & 1) && (theToken >> 1) > 0xffffffff)
+			throw AStream::failure("bad action_flags delta");
+		if(theRepeat > theMaxCount - theCount)
+			throw AStream::failure("too many action_flags");
+
+		action_flags_t theDelta = (theToken & 1) ? static_cast<action_flags_t>(theToken >> 1) : 0;
+		for(uint64_t r = 0; r < theRepeat; r++, theCount++)
+		{
+			action_flags_t theFlags = theDelta;
+			if(theCount >= theStride)
+			{
+				AIStreamBE theBase(outBuffer, inBufferSize, (theCount - theStride) * kActionFlagsSerializedLength);
+				action_flags_t theBaseFlags;
+				theBase >> theBaseFlags;
+				theFlags ^= theBaseFlags;
+			}
+
+			AOStreamBE theOutput(outBuffer, inBufferSize, theCount * kActionFlagsSerializedLength);
+			theOutput << theFlags;
+		}
+	}
+
+	return theCount * kActionFlagsSerializedLength;
+}
+
+
 const NetworkStats& hub_stats(int player_index)
 {
 	return getNetworkPlayer(player_index).mStats;
@@ -1713,6 +1999,7 @@ static const int32 sDefaultHubPreferences[kNumAttributes] = {
 };
 
 
+#ifndef A1_NETWORK_STANDALONE_HUB
 void HubParsePreferencesTree(InfoTree prefs, std::string version)
 {
 	for (size_t i = 0; i < kNumAttributes; ++i)
@@ -1771,6 +2058,7 @@ InfoTree HubPreferencesTree()
 	
 	return root;
 }
+#endif // A1_NETWORK_STANDALONE_HUB
 
 
 
@@ -62,7 +62,9 @@ enum {
 	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2,
 	kLossyByteStreamDataBufferSize = 1280,
 	kTypicalLossyByteStreamChunkSize = 56,
-	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize
+	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize,
+	// latency this steady (sixteenths of a tick) lets us trust a quarter-full timing window
+	kSteadyLatencyScaledJitter = 2 * 16
 };
 
 struct SpokePreferences
@@ -116,6 +118,7 @@ static DDPFramePtr sOutgoingFrame = NULL;
 static DDPPacketBuffer sLocalOutgoingBuffer;
 static bool sNeedToSendLocalOutgoingBuffer = false;
 static bool sHubIsLocal = false;
+static bool sHubSendsV2GameData = false;	// then we may send V2 game data too
 static NetAddrBlock sHubAddress;
 static size_t sLocalPlayerIndex;
 static int32 sSmallestUnreceivedTick;
@@ -124,6 +127,7 @@ static bool sTimingMeasurementValid;
 static int32 sTimingMeasurement;
 static bool sHeardFromHub = false;
 static bool sWorldUpdate = false;
+static uint32 sSession = 0;	// standalone hub only; see kSpokeIdentificationSessionSize
 
 static vector<int32> sDisplayLatencyBuffer; // stores the last 30 latency calculations, in ticks
 static uint32 sDisplayLatencyCount = 0;
@@ -149,13 +153,14 @@ static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
 
 
 static void spoke_became_disconnected();
-static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags);
+static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool inV2);
 static void spoke_received_ping_request(AIStream& ps, NetAddrBlock address);
 static void spoke_received_ping_response(AIStream& ps, NetAddrBlock address);
 static void process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+static void handle_player_status_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
 static void process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType);
 static bool spoke_tick();
@@ -209,7 +214,7 @@ check_send_packet_to_hub()
 
 
 void
-spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal)
+spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inSession)
 {
         assert(inNumberOfPlayers >= 1);
         assert(inLocalPlayerIndex < inNumberOfPlayers);
@@ -217,7 +222,9 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
         assert(inPlayerConnected[inLocalPlayerIndex]);
 
         sHubIsLocal = inHubIsLocal;
+	sHubSendsV2GameData = false;
         sHubAddress = inHubAddress;
+	sSession = inSession;
 
         sLocalPlayerIndex = inLocalPlayerIndex;
 
@@ -267,6 +274,7 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
         sMessageTypeToMessageHandler[kEndOfMessagesMessageType] = handle_end_of_messages_message;
         sMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = handle_timing_adjustment_message;
         sMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = handle_player_net_dead_message;
+	sMessageTypeToMessageHandler[kPlayerStatusMessageType] = handle_player_status_message;
 	sMessageTypeToMessageHandler[kHubToSpokeLossyByteStreamMessageType] = handle_lossy_byte_stream_message;
 
         sNeedToSendLocalOutgoingBuffer = false;
@@ -448,11 +456,21 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
                 switch(thePacketMagic)
                 {
 		case kHubToSpokeGameDataPacketV1Magic:
-			spoke_received_game_data_packet_v1(ps, false);
+			spoke_received_game_data_packet_v1(ps, false, false);
 			break;
 
 		case kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic:
-			spoke_received_game_data_packet_v1(ps, true);
+			spoke_received_game_data_packet_v1(ps, true, false);
+			break;
+
+		case kHubToSpokeGameDataPacketV2Magic:
+			sHubSendsV2GameData = true;
+			spoke_received_game_data_packet_v1(ps, false, true);
+			break;
+
+		case kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic:
+			sHubSendsV2GameData = true;
+			spoke_received_game_data_packet_v1(ps, true, true);
 			break;
 		
 		case kPingRequestPacket:
@@ -478,8 +496,17 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 
 
 static void
-spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
+spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool inV2)
 {
+	// a standalone hub may still be serving the last level for a moment
+	if(sSession != 0)
+	{
+		uint32 theSession;
+		ps >> theSession;
+		if(theSession != sSession)
+			return;
+	}
+
 	sHeardFromHub = true;
 
         IncomingGameDataPacketProcessingContext context;
@@ -583,6 +610,11 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         int32 theSmallestUnreadTick;
         ps >> theSmallestUnreadTick;
 
+	// V2 flags are expanded to the V1 layout and read from there
+	uint8 theExpandedFlags[kMaxExpandedActionFlagsSize];
+	AIStreamBE theExpandedStream(theExpandedFlags, inV2 ? read_action_flags(ps, theExpandedFlags, sizeof(theExpandedFlags)) : 0);
+	AIStream& fs = inV2 ? static_cast<AIStream&>(theExpandedStream) : ps;
+
         // Can't accept packets that skip ticks
         if(theSmallestUnreadTick > sSmallestUnreceivedTick)
 	{
@@ -624,7 +656,7 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         // The body of this loop is a bit more convoluted than you might
         // expect, because the same loop is used to skip already-seen action_flags
         // and to enqueue new ones.
-	while(ps.tellg() < ps.maxg())
+	while(fs.tellg() < fs.maxg())
         {
                 // If we've no room to enqueue stuff, no point in finishing reading the packet.
                 if(theSmallestQueueSpace <= 0)
@@ -683,7 +715,7 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                                 // We should have a flag for this player for this tick!
 				try 
 				{
-					ps >> theFlags;
+					fs >> theFlags;
 				}
 				catch (const AStream::failure& f)
 				{
@@ -720,9 +752,11 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 
 			sNthElementFinder.insert(theLatencyMeasurement);
 			// We capture these values here so we don't have to take a lock in GetNetTime.
-			sTimingMeasurementValid = sNthElementFinder.window_full();
+			// On a steady link a quarter window is representative enough to start adjusting.
+			sTimingMeasurementValid = sNthElementFinder.window_full()
+				|| (sNthElementFinder.size() >= sNthElementFinder.window_size() / 4 && sNthElementFinder.scaled_jitter() <= kSteadyLatencyScaledJitter);
 			if(sTimingMeasurementValid)
-				sTimingMeasurement = sNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement);
+				sTimingMeasurement = sNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement * sNthElementFinder.size() / sNthElementFinder.window_size());
 
 			// update the latency display
 			sDisplayLatencyTicks -= sDisplayLatencyBuffer[sDisplayLatencyCount % sDisplayLatencyBuffer.size()];
@@ -855,6 +889,46 @@ handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingC
 
 
 
+static void
+handle_player_status_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+{
+	int8 theAdjustment;
+	uint8 theNetDeadCount;
+
+	ps >> theAdjustment >> theNetDeadCount;
+
+	// A zero adjustment means the same as no timing adjustment message
+	if(theAdjustment != 0)
+	{
+		if(theAdjustment != sRequestedTimingAdjustment)
+		{
+			sOutstandingTimingAdjustment = theAdjustment;
+			sRequestedTimingAdjustment = theAdjustment;
+			logTraceNMT("new timing adjustment message; requested: %d outstanding: %d", sRequestedTimingAdjustment, sOutstandingTimingAdjustment);
+		}
+
+		context.mGotTimingAdjustmentMessage = true;
+	}
+
+	for(int i = 0; i < theNetDeadCount; i++)
+	{
+		uint8 thePlayerIndex;
+		int32 theTick;
+
+		ps >> thePlayerIndex >> theTick;
+
+		if(thePlayerIndex >= sNetworkPlayers.size())
+			continue;
+
+		sNetworkPlayers[thePlayerIndex].mConnected = false;
+		sNetworkPlayers[thePlayerIndex].mNetDeadTick = theTick;
+
+		logDumpNMT("netDead in status message: player %d in tick %d", thePlayerIndex, theTick);
+	}
+}
+
+
+
 static void
 handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
@@ -904,6 +978,9 @@ static bool
 spoke_tick()
 {
 	logContextNMT("processing spoke_tick %d", sNetworkTicker);
+
+	// Pick up packets that arrived since last tick, while we hold the mutex anyway
+	NetDDPDispatchReceivedPackets();
 	
         sNetworkTicker++;
 
@@ -1041,7 +1118,7 @@ send_packet()
                 AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
         
                 // Packet type
-                hdr << (uint16)kSpokeToHubGameDataPacketV1Magic;
+                hdr << (uint16)(sHubSendsV2GameData ? kSpokeToHubGameDataPacketV2Magic : kSpokeToHubGameDataPacketV1Magic);
 
                 // Acknowledgement
                 ps << sSmallestUnreceivedTick;
@@ -1082,8 +1159,20 @@ send_packet()
                 if(sOutgoingFlags.size() > 0)
                 {
                         ps << sOutgoingFlags.getReadTick();
+			if(sHubSendsV2GameData)
+			{
+				// Only our own flags, so each is coded against the previous tick's
+				action_flags_t theFlags[kMaxExpandedActionFlagsSize / kActionFlagsSerializedLength];
+				size_t theCount = 0;
+				for(int32 tick = sOutgoingFlags.getReadTick(); tick < sOutgoingFlags.getWriteTick() && theCount < sizeof(theFlags) / sizeof(theFlags[0]); tick++)
+					theFlags[theCount++] = sOutgoingFlags.peek(tick);
+				write_action_flags(ps, theFlags, theCount, 1);
+			}
+			else
+			{
                         for(int32 tick = sOutgoingFlags.getReadTick(); tick < sOutgoingFlags.getWriteTick(); tick++)
                                 ps << sOutgoingFlags.peek(tick);
+			}
                 }
 
 		logDumpNMT("preparing to send packet: ACK %d, flags [%d,%d)", sSmallestUnreceivedTick, sOutgoingFlags.getReadTick(), sOutgoingFlags.getWriteTick());
@@ -1124,6 +1213,20 @@ send_identification_packet()
                 // ID
                 ps << (uint16)sLocalPlayerIndex;
 
+		// What we can read (older hubs ignore this)
+		ps << (uint16)kSpokeFeatureV2GameData;
+
+		// The game's shape, for a standalone hub that hasn't been told (others ignore it)
+		uint32 theConnectedPlayers = 0;
+		for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+			if(sNetworkPlayers[i].mConnected)
+				theConnectedPlayers |= (((uint32)1) << i);
+
+		ps << (uint16)sNetworkPlayers.size();
+		ps << sSmallestRealGameTick;
+		ps << theConnectedPlayers;
+		ps << sSession;
+
 		// blank out the CRC field before calculating
 		sOutgoingFrame->data[2] = 0;
 		sOutgoingFrame->data[3] = 0;
@@ -27,6 +27,9 @@
  *  Sept-Nov 2001 (Woody Zenfell): a few additions to implement socket-listening thread.
  *
  *  May 18, 2003 (Woody Zenfell): now uses passed-in port number for local socket.
+ *
+ *  Where recvmmsg()/sendmmsg() are available we use our own socket and move packets in
+ *  batches; received packets go through a lock-free queue to whoever holds the mytm mutex.
  */
 
 #if !defined(DISABLE_NETWORKING)
@@ -40,18 +43,36 @@
 #include "thread_priority_sdl.h"
 #include "mytm.h" // mytm_mutex stuff
 
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define BATCHED_UDP_IO
+#endif
+
+#ifdef BATCHED_UDP_IO
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
 // Global variables (most comments and "sSomething" variables are ZZZ)
+#ifndef BATCHED_UDP_IO
 // Storage for incoming packet data
 static UDPpacket*		sUDPPacketBuffer	= NULL;
 
 // Storage for the DDP packet we pass back to the handler proc
 static DDPPacketBuffer		ddpPacketBuffer;
+#endif
 
 // Keep track of our one sending/receiving socket
 static UDPsocket 		sSocket			= NULL;
 
+#ifndef BATCHED_UDP_IO
 // Keep track of the socket-set the receiving thread uses (so we don't have to allocate/free it in that thread)
 static	SDLNet_SocketSet	sSocketSet		= NULL;
+#endif
 
 // Keep track of the function to call when we receive data
 static PacketHandlerProcPtr	sPacketHandler		= NULL;
@@ -62,7 +83,167 @@ static SDL_Thread*		sReceivingThread	= NULL;
 // See if the receiving thread should exit
 static volatile bool		sKeepListening		= false;
 
+#ifdef BATCHED_UDP_IO
+enum {
+	kUDPBatchSize		= 32,	// packets per recvmmsg()/sendmmsg() call
+	kReceiveQueueSize	= 128	// must be a power of two
+};
+
+// Our own socket; SDL_net does not expose its descriptor
+static int			sBatchSocket		= -1;
+
+// Single-producer (receiving thread), single-consumer (holder of the mytm mutex) queue.
+// Packets are received straight into the free slots and handed to the packet handler
+// from there.
+static DDPPacketBuffer		sReceiveQueue[kReceiveQueueSize];
+static std::atomic<uint32>	sReceiveQueueWrite(0);
+static std::atomic<uint32>	sReceiveQueueRead(0);
+
+// Frames collected between NetDDPBeginFrameBatch() and NetDDPEndFrameBatch()
+static struct mmsghdr		sSendMessages[kUDPBatchSize];
+static struct iovec		sSendVectors[kUDPBatchSize];
+static struct sockaddr_in	sSendAddresses[kUDPBatchSize];
+static byte			sSendData[kUDPBatchSize][ddpMaxData];
+static int			sSendCount		= 0;
+static bool			sBatchingSends		= false;
+#endif
+
+
+#ifndef BATCHED_UDP_IO
+// Hands the packet in sUDPPacketBuffer to the registered packet handler.
+static void
+dispatch_received_packet() {
+    ddpPacketBuffer.protocolType	= kPROTOCOL_TYPE;
+    ddpPacketBuffer.sourceAddress	= sUDPPacketBuffer->address;
+    ddpPacketBuffer.datagramSize	= sUDPPacketBuffer->len;
+    
+    // Hope the other guy is done using whatever's in there!
+    // (As I recall, all uses happen in sPacketHandler and its progeny, so we should be fine.)
+    memcpy(ddpPacketBuffer.datagramData, sUDPPacketBuffer->data, sUDPPacketBuffer->len);
+    
+    sPacketHandler(&ddpPacketBuffer);
+}
+#endif
+
+#ifdef BATCHED_UDP_IO
+// NetAddrBlock already holds host and port in network byte order
+static void
+make_sockaddr(const NetAddrBlock& inAddress, struct sockaddr_in& outAddress) {
+    memset(&outAddress, 0, sizeof(outAddress));
+    outAddress.sin_family	= AF_INET;
+    outAddress.sin_addr.s_addr	= inAddress.host;
+    outAddress.sin_port		= inAddress.port;
+}
+
+static bool
+receive_queue_is_empty() {
+    return sReceiveQueueRead.load(std::memory_order_acquire) == sReceiveQueueWrite.load(std::memory_order_acquire);
+}
+
+static bool
+receive_queue_is_full() {
+    return sReceiveQueueWrite.load(std::memory_order_acquire) - sReceiveQueueRead.load(std::memory_order_acquire) == kReceiveQueueSize;
+}
+
+// Producer side: reads whatever is waiting on the socket (without blocking) into free
+// queue slots.  Returns the number of packets received.
+static int
+receive_packet_batch() {
+    uint32 theWrite = sReceiveQueueWrite.load(std::memory_order_relaxed);
+    uint32 theFree = kReceiveQueueSize - (theWrite - sReceiveQueueRead.load(std::memory_order_acquire));
+    int theCount = std::min<uint32>(theFree, kUDPBatchSize);
+    if(theCount == 0)
+        return 0;
+
+    struct mmsghdr theMessages[kUDPBatchSize];
+    struct iovec theVectors[kUDPBatchSize];
+    struct sockaddr_in theAddresses[kUDPBatchSize];
+    memset(theMessages, 0, sizeof(theMessages[0]) * theCount);
+    for(int i = 0; i < theCount; i++) {
+        DDPPacketBuffer& thePacket = sReceiveQueue[(theWrite + i) % kReceiveQueueSize];
+        theVectors[i].iov_base			= thePacket.datagramData;
+        theVectors[i].iov_len			= ddpMaxData;
+        theMessages[i].msg_hdr.msg_iov		= &theVectors[i];
+        theMessages[i].msg_hdr.msg_iovlen	= 1;
+        theMessages[i].msg_hdr.msg_name		= &theAddresses[i];
+        theMessages[i].msg_hdr.msg_namelen	= sizeof(theAddresses[i]);
+    }
+
+    int theReceived = recvmmsg(sBatchSocket, theMessages, theCount, MSG_DONTWAIT, NULL);
+    if(theReceived <= 0)
+        return 0;
 
+    for(int i = 0; i < theReceived; i++) {
+        DDPPacketBuffer& thePacket = sReceiveQueue[(theWrite + i) % kReceiveQueueSize];
+        thePacket.protocolType		= kPROTOCOL_TYPE;
+        thePacket.sourceAddress.host	= theAddresses[i].sin_addr.s_addr;
+        thePacket.sourceAddress.port	= theAddresses[i].sin_port;
+        thePacket.datagramSize		= theMessages[i].msg_len;
+    }
+
+    sReceiveQueueWrite.store(theWrite + theReceived, std::memory_order_release);
+    return theReceived;
+}
+
+// Consumer side: caller must hold the mytm mutex (or be the standalone hub's only thread).
+static void
+dispatch_queued_packets() {
+    uint32 theRead = sReceiveQueueRead.load(std::memory_order_relaxed);
+    uint32 theWrite = sReceiveQueueWrite.load(std::memory_order_acquire);
+    while(theRead != theWrite) {
+        sPacketHandler(&sReceiveQueue[theRead % kReceiveQueueSize]);
+        sReceiveQueueRead.store(++theRead, std::memory_order_release);
+    }
+}
+
+static void
+flush_send_batch() {
+    int theSent = 0;
+    while(theSent < sSendCount) {
+        int theResult = sendmmsg(sBatchSocket, &sSendMessages[theSent], sSendCount - theSent, 0);
+        if(theResult < 0) {
+            // The first frame in what's left could not be sent (EINTR aside); drop it,
+            // as a single NetDDPSendFrame() would, and carry on with the rest.
+            if(errno != EINTR)
+                theSent++;
+        }
+        else
+            theSent += theResult;
+    }
+    sSendCount = 0;
+}
+#endif
+
+#ifndef A1_NETWORK_STANDALONE_HUB
+#ifdef BATCHED_UDP_IO
+// The listening thread receives packets in batches, then hands each batch over with a
+// single mutex acquisition.  If a tick task has the mutex, we don't wait for it: the
+// tick task empties the queue itself (see NetDDPDispatchReceivedPackets()), and in case
+// it doesn't we look again shortly.  Only a full queue makes us wait.
+static int
+receive_thread_function(void*) {
+    while(sKeepListening) {
+        struct pollfd thePoll = { sBatchSocket, POLLIN, 0 };
+        int theResult = poll(&thePoll, 1, receive_queue_is_empty() ? 1000 : 1);
+        
+        if(!sKeepListening)
+            break;
+        
+        if(theResult > 0)
+            receive_packet_batch();
+        
+        if(receive_queue_is_empty())
+            continue;
+        
+        if(receive_queue_is_full() ? take_mytm_mutex() : try_take_mytm_mutex()) {
+            dispatch_queued_packets();
+            release_mytm_mutex();
+        }
+    }
+    
+    return 0;
+}
+#else
 // ZZZ: the socket listening thread loops in this function.  It calls the registered
 // packet handler when it gets something.
 static int
@@ -78,16 +259,7 @@ receive_thread_function(void*) {
             theResult = SDLNet_UDP_Recv(sSocket, sUDPPacketBuffer);
             if(theResult > 0) {
                 if(take_mytm_mutex()) {
-                    ddpPacketBuffer.protocolType	= kPROTOCOL_TYPE;
-                    ddpPacketBuffer.sourceAddress	= sUDPPacketBuffer->address;
-                    ddpPacketBuffer.datagramSize	= sUDPPacketBuffer->len;
-                    
-                    // Hope the other guy is done using whatever's in there!
-                    // (As I recall, all uses happen in sPacketHandler and its progeny, so we should be fine.)
-                    memcpy(ddpPacketBuffer.datagramData, sUDPPacketBuffer->data, sUDPPacketBuffer->len);
-                    
-                    sPacketHandler(&ddpPacketBuffer);
-                    
+                    dispatch_received_packet();
                     release_mytm_mutex();
                 }
                 else
@@ -98,6 +270,37 @@ receive_thread_function(void*) {
     
     return 0;
 }
+#endif // BATCHED_UDP_IO
+#else
+// Standalone hub has no receiving thread: its event loop waits here, and
+// the packet handler runs on the calling thread.
+void
+NetDDPWaitForPackets(uint32 inTimeout) {
+#ifdef BATCHED_UDP_IO
+    struct pollfd thePoll = { sBatchSocket, POLLIN, 0 };
+    if(poll(&thePoll, 1, inTimeout) <= 0)
+        return;
+    
+    // Bounded, so a flood can't starve the tick
+    for(int i = 0; i < kReceiveQueueSize / kUDPBatchSize && receive_packet_batch() > 0; i++)
+        dispatch_queued_packets();
+#else
+    if(SDLNet_CheckSockets(sSocketSet, inTimeout) <= 0)
+        return;
+    
+    while(SDLNet_UDP_Recv(sSocket, sUDPPacketBuffer) > 0)
+        dispatch_received_packet();
+#endif
+}
+#endif
+
+void
+NetDDPDispatchReceivedPackets() {
+#ifdef BATCHED_UDP_IO
+    if(sBatchSocket >= 0)
+        dispatch_queued_packets();
+#endif
+}
 
 
 /*
@@ -129,6 +332,32 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
 //fdprintf("NetDDPOpenSocket\n");
 	assert(packetHandler);
 
+#ifdef BATCHED_UDP_IO
+	assert(sBatchSocket < 0);
+	sBatchSocket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sBatchSocket < 0)
+		return -1;
+
+	// SDLNet_UDP_Open() allows broadcast too
+	int theBroadcast = 1;
+	setsockopt(sBatchSocket, SOL_SOCKET, SO_BROADCAST, &theBroadcast, sizeof(theBroadcast));
+
+	struct sockaddr_in theAddress;
+	memset(&theAddress, 0, sizeof(theAddress));
+	theAddress.sin_family = AF_INET;
+	theAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+	theAddress.sin_port = *ioPortNumber;
+	if (bind(sBatchSocket, (struct sockaddr*) &theAddress, sizeof(theAddress)) < 0) {
+		close(sBatchSocket);
+		sBatchSocket = -1;
+		return -1;
+	}
+
+	sReceiveQueueRead.store(0);
+	sReceiveQueueWrite.store(0);
+	sSendCount = 0;
+	sBatchingSends = false;
+#else
 	// Allocate packet buffer (this is Christian's part)
 	assert(!sUDPPacketBuffer);
 	sUDPPacketBuffer = SDLNet_AllocPacket(ddpMaxData);
@@ -149,16 +378,19 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
         // Set up socket set
         sSocketSet = SDLNet_AllocSocketSet(1);
         SDLNet_UDP_AddSocket(sSocketSet, sSocket);
+#endif
         
         // Set up receiver
         sKeepListening		= true;
         sPacketHandler		= packetHandler;
+#ifndef A1_NETWORK_STANDALONE_HUB
         sReceivingThread	= SDL_CreateThread(receive_thread_function, "NetDDPOpenSocket_ReceivingThread", NULL);
 
         // Set receiving thread priority very high
         bool	theResult = BoostThreadPriority(sReceivingThread);
         if(theResult == false)
             fdprintf("warning: BoostThreadPriority() failed; network performance may suffer\n");
+#endif
         
         //PORTGUESS but we should generally keep port in network order, I think?
 	// We really ought to return the "real" port we bound to in *ioPortNumber...
@@ -182,6 +414,12 @@ OSErr NetDDPCloseSocket(short portNumber)
             sReceivingThread	= NULL;
         }
 
+#ifdef BATCHED_UDP_IO
+	if (sBatchSocket >= 0) {
+		close(sBatchSocket);
+		sBatchSocket = -1;
+	}
+#else
         if(sSocketSet) {
             SDLNet_FreeSocketSet(sSocketSet);
             sSocketSet = NULL;
@@ -195,6 +433,7 @@ OSErr NetDDPCloseSocket(short portNumber)
 		SDLNet_UDP_Close(sSocket);
 		sSocket = NULL;
 	}
+#endif
 	return 0;
 }
 
@@ -236,11 +475,54 @@ OSErr NetDDPSendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolTy
 //fdprintf("NetDDPSendFrame\n");
 	assert(frame->data_size <= ddpMaxData);
 
+#ifdef BATCHED_UDP_IO
+	if (sBatchingSends) {
+		if (sSendCount == kUDPBatchSize)
+			flush_send_batch();
+
+		int i = sSendCount++;
+		memcpy(sSendData[i], frame->data, frame->data_size);
+		make_sockaddr(*address, sSendAddresses[i]);
+		sSendVectors[i].iov_base = sSendData[i];
+		sSendVectors[i].iov_len = frame->data_size;
+		memset(&sSendMessages[i], 0, sizeof(sSendMessages[i]));
+		sSendMessages[i].msg_hdr.msg_iov = &sSendVectors[i];
+		sSendMessages[i].msg_hdr.msg_iovlen = 1;
+		sSendMessages[i].msg_hdr.msg_name = &sSendAddresses[i];
+		sSendMessages[i].msg_hdr.msg_namelen = sizeof(sSendAddresses[i]);
+		return 0;
+	}
+
+	struct sockaddr_in theAddress;
+	make_sockaddr(*address, theAddress);
+	return sendto(sBatchSocket, frame->data, frame->data_size, 0, (struct sockaddr*) &theAddress, sizeof(theAddress)) == frame->data_size ? 0 : -1;
+#else
 	sUDPPacketBuffer->channel = -1;
 	memcpy(sUDPPacketBuffer->data, frame->data, frame->data_size);
 	sUDPPacketBuffer->len = frame->data_size;
 	sUDPPacketBuffer->address = *address;
 	return SDLNet_UDP_Send(sSocket, -1, sUDPPacketBuffer) ? 0 : -1;
+#endif
+}
+
+
+/*
+ *  Send several frames at once
+ */
+
+void NetDDPBeginFrameBatch(void)
+{
+#ifdef BATCHED_UDP_IO
+	sBatchingSends = true;
+#endif
+}
+
+void NetDDPEndFrameBatch(void)
+{
+#ifdef BATCHED_UDP_IO
+	flush_send_batch();
+	sBatchingSends = false;
+#endif
 }
 
 #endif // !defined(DISABLE_NETWORKING)
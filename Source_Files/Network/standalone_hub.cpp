@@ -0,0 +1,439 @@
+/*
+ *  standalone_hub.cpp
+
+	Copyright (C) 2003 and beyond by Woody Zenfell, III
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  Headless star hub: runs only the hub half of the star protocol, with no
+ *	local player, no game world and no UI (build with A1_NETWORK_STANDALONE_HUB).
+ *
+ *  The hub code keeps its state in file statics, so each game gets its own
+ *	process.  Each worker serves games on its port back to back; with --games N
+ *	the parent forks one worker per port, starting at --port, and restarts any
+ *	worker that dies.
+ *
+ *  A worker learns each game's size and first tick from the first spoke to
+ *	identify itself (gatherers that play through a standalone hub send them);
+ *	--players and --start-tick only cover spokes too old to say.  Each level
+ *	of a network game has its own session id, and the first spoke to
+ *	identify with a new one ends the game in progress and starts the next.
+ *
+ *  Workers have no receive thread and no timer thread: the event loop below
+ *	waits on the socket until the next tick is due and calls the packet
+ *	handler and hub_tick() from the one thread, so nothing needs the mytm mutex
+ *	except what hub_cleanup() takes itself.
+ */
+
+#include "cseries.h"
+#include "network.h"
+#include "network_star.h"
+#include "mytm.h"
+#include "AStream.h"
+#include "crc.h"
+#include "Logging.h"
+
+#include <SDL2/SDL_net.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <vector>
+
+enum {
+	kHubTickPeriod = 1000 / TICKS_PER_SECOND,
+	// if we fall this far behind (stopped process, suspended VM), skip ahead rather than burst
+	kMaxCatchUpTicks = TICKS_PER_SECOND
+};
+
+static volatile sig_atomic_t sQuit = 0;
+
+static const struct hub_options* sOptions = NULL;
+static uint16 sPort = 0;
+static bool sGameStarted = false;
+static uint32 sSession = 0;
+static uint32 sPreviousSession = 0;	// so its stragglers can't restart it
+
+static void
+handle_quit_signal(int)
+{
+	sQuit = 1;
+}
+
+
+// The hub pulls in a few CSeries routines whose usual homes drag in the UI.
+void
+_alephone_assert(const char *file, int32 line, const char *what)
+{
+	fprintf(stderr, "%s:%d: %s\n", file, line, what);
+	abort();
+}
+
+void
+_alephone_warn(const char *file, int32 line, const char *what)
+{
+	logWarning("%s:%d: %s", file, line, what);
+}
+
+void
+fdprintf(const char *format, ...)
+{
+	va_list list;
+	va_start(list, format);
+	vfprintf(stderr, format, list);
+	va_end(list);
+	fputc('\n', stderr);
+}
+
+
+struct hub_options
+{
+	uint16 port;
+	int games;
+	size_t players;
+	int32 start_tick;
+};
+
+static void
+usage(const char *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --port P        first UDP port to serve on (default %d)\n"
+		"  --games N       number of games to run, one port each (default 1)\n"
+		"  --players M     players per game, for spokes that don't say (default 8)\n"
+		"  --start-tick T  first real game tick, for spokes that don't say (default 0)\n"
+		"  --help          show this message\n",
+		name, DEFAULT_GAME_PORT);
+}
+
+static bool
+parse_options(int argc, char **argv, hub_options& options)
+{
+	options.port = DEFAULT_GAME_PORT;
+	options.games = 1;
+	options.players = 8;
+	options.start_tick = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+			return false;
+
+		if (value == NULL)
+		{
+			fprintf(stderr, "%s: missing value for %s\n", argv[0], arg);
+			return false;
+		}
+
+		long n = strtol(value, NULL, 10);
+		if (strcmp(arg, "--port") == 0 && n > 0 && n < 65536)
+			options.port = static_cast<uint16>(n);
+		else if (strcmp(arg, "--games") == 0 && n > 0 && n < 65536)
+			options.games = static_cast<int>(n);
+		else if (strcmp(arg, "--players") == 0 && n > 0 && n <= MAXIMUM_NUMBER_OF_NETWORK_PLAYERS)
+			options.players = static_cast<size_t>(n);
+		else if (strcmp(arg, "--start-tick") == 0 && n >= 0)
+			options.start_tick = static_cast<int32>(n);
+		else
+		{
+			fprintf(stderr, "%s: bad option %s %s\n", argv[0], arg, value);
+			return false;
+		}
+		i++;
+	}
+
+	if (options.port + options.games - 1 > 65535)
+	{
+		fprintf(stderr, "%s: not enough ports above %d for %d games\n", argv[0], options.port, options.games);
+		return false;
+	}
+
+	return true;
+}
+
+
+// What a spoke's identification says about its game
+struct game_shape
+{
+	int16 sender_index;
+	size_t player_count;
+	int32 start_tick;
+	uint32 connected_players;
+	uint32 session;	// 0 from spokes too old to say
+};
+
+// Reads inPacket as a spoke's identification; false if it is anything else.
+static bool
+read_identification(DDPPacketBufferPtr inPacket, game_shape& outShape)
+{
+	// the hub blanks the CRC field in place, so check a copy
+	DDPPacketBuffer thePacket = *inPacket;
+	AIStreamBE ps(thePacket.datagramData, thePacket.datagramSize);
+
+	try {
+		uint16 thePacketMagic;
+		ps >> thePacketMagic;
+		if (thePacketMagic != kSpokeToHubIdentification)
+			return false;
+
+		uint16 thePacketCRC;
+		ps >> thePacketCRC;
+
+		thePacket.datagramData[2] = 0;
+		thePacket.datagramData[3] = 0;
+		if (thePacketCRC != calculate_data_crc_ccitt(thePacket.datagramData, thePacket.datagramSize))
+			return false;
+
+		ps >> outShape.sender_index;
+
+		uint16 theFeatures = 0;
+		if (ps.tellg() < ps.maxg())
+			ps >> theFeatures;
+
+		outShape.player_count = sOptions->players;
+		outShape.start_tick = sOptions->start_tick;
+		outShape.connected_players = (((uint32)1) << outShape.player_count) - 1;
+		outShape.session = 0;
+		if (ps.maxg() - ps.tellg() >= static_cast<uint32>(kSpokeIdentificationGameShapeSize))
+		{
+			uint16 theGamePlayerCount;
+			ps >> theGamePlayerCount;
+			ps >> outShape.start_tick;
+			ps >> outShape.connected_players;
+			outShape.player_count = theGamePlayerCount;
+
+			if (ps.maxg() - ps.tellg() >= static_cast<uint32>(kSpokeIdentificationSessionSize))
+				ps >> outShape.session;
+		}
+	}
+	catch (...)
+	{
+		// not an identification we understand
+		return false;
+	}
+
+	if (outShape.player_count == 0 || outShape.player_count > MAXIMUM_NUMBER_OF_NETWORK_PLAYERS)
+		return false;
+
+	return outShape.sender_index >= 0 && static_cast<size_t>(outShape.sender_index) < outShape.player_count &&
+		(outShape.connected_players & (((uint32)1) << outShape.sender_index));
+}
+
+static void
+start_game(const game_shape& inShape)
+{
+	// Addresses are learned from the spokes' identification packets; a
+	// non-NULL entry only says the player is expected.
+	std::vector<NetAddrBlock> theAddresses(inShape.player_count);
+	std::vector<const NetAddrBlock*> theAddressPointers(inShape.player_count);
+	for (size_t i = 0; i < inShape.player_count; i++)
+	{
+		memset(&theAddresses[i], 0, sizeof(NetAddrBlock));
+		theAddressPointers[i] = (inShape.connected_players & (((uint32)1) << i)) ? &theAddresses[i] : NULL;
+	}
+
+	logNote("hub on port %d starting a %d-player game at tick %d", sPort, (int)inShape.player_count, (int)inShape.start_tick);
+	hub_standalone_set_session(inShape.session);
+	hub_initialize(inShape.start_tick, inShape.player_count, &theAddressPointers[0], inShape.sender_index);
+	sSession = inShape.session;
+	sGameStarted = true;
+}
+
+static void
+standalone_received_network_packet(DDPPacketBufferPtr inPacket)
+{
+	game_shape theShape;
+	if (read_identification(inPacket, theShape))
+	{
+		// A spoke that has moved on to the next level ends the game in
+		// progress; its teammates follow it as they identify.  Late
+		// identifications from the game just ended are not a new game.
+		if (sGameStarted && theShape.session != sSession && theShape.session != 0 && theShape.session != sPreviousSession)
+		{
+			logNote("hub on port %d ending its game for the next level", sPort);
+			hub_cleanup(false, 0);
+			sPreviousSession = sSession;
+			sGameStarted = false;
+		}
+
+		if (!sGameStarted && (theShape.session == 0 || theShape.session != sPreviousSession))
+			start_game(theShape);
+	}
+
+	// before the game starts the hub only answers pings
+	hub_received_network_packet(inPacket);
+}
+
+// Runs one game on inPort; returns false if the socket could not be opened.
+static bool
+run_game(uint16 inPort, const hub_options& options)
+{
+	sOptions = &options;
+	sPort = inPort;
+	sGameStarted = false;
+
+	short thePort = SDL_SwapBE16(inPort);
+	if (NetDDPOpenSocket(&thePort, standalone_received_network_packet) != noErr)
+	{
+		logError("could not open UDP port %d", inPort);
+		return false;
+	}
+
+	logNote("hub on port %d waiting for players", inPort);
+
+	uint32 theNextTick = machine_tick_count();
+	bool theGameIsRunning = true;
+	while (theGameIsRunning && !sQuit)
+	{
+		uint32 theNow = machine_tick_count();
+		if (!sGameStarted)
+		{
+			NetDDPWaitForPackets(kHubTickPeriod);
+			theNextTick = machine_tick_count();
+		}
+		else if (static_cast<int32>(theNow - theNextTick) >= 0)
+		{
+			theGameIsRunning = hub_standalone_tick();
+			theNextTick += kHubTickPeriod;
+
+			if (static_cast<int32>(theNow - theNextTick) > kMaxCatchUpTicks * kHubTickPeriod)
+				theNextTick = theNow + kHubTickPeriod;
+		}
+		else
+		{
+			NetDDPWaitForPackets(theNextTick - theNow);
+		}
+	}
+
+	if (sGameStarted)
+	{
+		hub_cleanup(false, 0);
+		sPreviousSession = sSession;
+	}
+	NetDDPCloseSocket(0);
+
+	logNote("hub on port %d finished", inPort);
+	return true;
+}
+
+static int
+run_worker(uint16 inPort, const hub_options& options)
+{
+	if (SDLNet_Init() < 0)
+	{
+		logFatal("SDLNet_Init failed: %s", SDLNet_GetError());
+		return 1;
+	}
+
+	mytm_initialize();
+	DefaultHubPreferences();
+
+	int theResult = 0;
+	while (!sQuit)
+	{
+		if (!run_game(inPort, options))
+		{
+			theResult = 1;
+			break;
+		}
+	}
+
+	SDLNet_Quit();
+	return theResult;
+}
+
+static pid_t
+spawn_worker(uint16 inPort, const hub_options& options)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+		_exit(run_worker(inPort, options));
+
+	if (pid < 0)
+		logError("could not fork hub for port %d", inPort);
+
+	return pid;
+}
+
+int
+main(int argc, char **argv)
+{
+	hub_options options;
+	if (!parse_options(argc, argv, options))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_quit_signal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (options.games == 1)
+		return run_worker(options.port, options);
+
+	std::vector<pid_t> theWorkers(options.games, -1);
+	for (int i = 0; i < options.games; i++)
+		theWorkers[i] = spawn_worker(options.port + i, options);
+
+	while (!sQuit)
+	{
+		int status;
+		pid_t pid = waitpid(-1, &status, 0);
+		if (pid < 0)
+		{
+			// interrupted by a signal, or nothing left to wait for
+			if (errno == ECHILD)
+				break;
+			continue;
+		}
+
+		for (int i = 0; i < options.games; i++)
+		{
+			if (theWorkers[i] != pid)
+				continue;
+
+			theWorkers[i] = -1;
+			// a worker that exits on its own could not open its port; don't spin on it
+			if (!sQuit && !(WIFEXITED(status) && WEXITSTATUS(status) != 0))
+				theWorkers[i] = spawn_worker(options.port + i, options);
+		}
+	}
+
+	for (int i = 0; i < options.games; i++)
+		if (theWorkers[i] > 0)
+			kill(theWorkers[i], SIGTERM);
+
+	while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+		;
+
+	return 0;
+}
@@ -338,12 +338,21 @@ void FontSpecifier::OGL_Reset(bool IsStarting)
 // Alters the modelview matrix so that the next characters will be drawn at the proper place.
 // One can surround it with glPushMatrix() and glPopMatrix() to remember the original.
 void FontSpecifier::OGL_Render(const char *Text)
+{
+	if (!OGL_BeginRender())
+		return;
+	
+	OGL_RenderRun(Text);
+	OGL_EndRender();
+}
+
+bool FontSpecifier::OGL_BeginRender()
 {
 	// Bug out if no texture to render
 	if (!OGL_Texture)
 	{
         OGL_Reset(true);
-        if (!OGL_Texture) return;
+        if (!OGL_Texture) return false;
 	}
 	
 	glPushAttrib(GL_ENABLE_BIT);
@@ -354,14 +363,21 @@ void FontSpecifier::OGL_Render(const char *Text)
 	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
 
 	glBindTexture(GL_TEXTURE_2D,TxtrID);
-	
+	return true;
+}
+
+void FontSpecifier::OGL_RenderRun(const char *Text)
+{
 	size_t Len = MIN(strlen(Text),255);
 	for (size_t k=0; k<Len; k++)
 	{
 		unsigned char c = Text[k];
 		glCallList(DispList+c);
 	}
-	
+}
+
+void FontSpecifier::OGL_EndRender()
+{
 	glPopAttrib();
 }
 
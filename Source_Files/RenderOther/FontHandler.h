@@ -92,6 +92,13 @@ public:
 	// One can surround it with glPushMatrix() and glPopMatrix() to remember the original.
 	void OGL_Render(const char *Text);
 
+	// Renders several strings with a single texture bind: if OGL_BeginRender()
+	// returns true, call OGL_RenderRun() for each string (same conventions as
+	// OGL_Render()) and then OGL_EndRender().
+	bool OGL_BeginRender();
+	void OGL_RenderRun(const char *Text);
+	void OGL_EndRender();
+
 	// Renders text a la _draw_screen_text() (see screen_drawing.h), with
 	// alignment and wrapping. Modelview matrix is unaffected.
 	void OGL_DrawText(const char *Text, const screen_rectangle &r, short flags);
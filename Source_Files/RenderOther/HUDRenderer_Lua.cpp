@@ -37,9 +37,17 @@ HUD_RENDERER_LUA.CPP
 #endif
 
 #include <math.h>
+#include <algorithm>
 
 extern bool MotionSensorActive;
 
+// how many batches back a new draw command may be moved to join one that
+// uses the same state
+static const int MAX_BATCH_SEARCH = 16;
+
+// text runs not drawn for this many frames are released
+static const int TEXT_RUN_LIFETIME = 120;
+
 
 // Rendering object
 static HUD_Lua_Class HUD_Lua;
@@ -103,8 +111,12 @@ void HUD_Lua_Class::start_draw(void)
 	alephone::Screen *scr = alephone::Screen::instance();
 	scr->bound_screen();
     m_wr = scr->window_rect();
-	m_opengl = (get_screen_mode()->acceleration != _no_acceleration);
+	bool opengl = (get_screen_mode()->acceleration != _no_acceleration);
+	if (opengl != m_opengl)
+		release_text_runs(true);
+	m_opengl = opengl;
 	m_masking_mode = _mask_disabled;
+	++m_frame;
 	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
@@ -150,8 +162,12 @@ void HUD_Lua_Class::start_draw(void)
 
 void HUD_Lua_Class::end_draw(void)
 {
+	flush();
 	m_drawing = false;
 	
+	if (m_frame % TEXT_RUN_LIFETIME == 0)
+		release_text_runs(false);
+	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -162,7 +178,7 @@ void HUD_Lua_Class::end_draw(void)
 #endif
 }
 
-void HUD_Lua_Class::apply_clip(void)
+SDL_Rect HUD_Lua_Class::clip_rect(void)
 {
 	alephone::Screen *scr = alephone::Screen::instance();
 	
@@ -171,11 +187,21 @@ void HUD_Lua_Class::apply_clip(void)
     r.y = m_wr.y + scr->lua_clip_rect.y;
     r.w = MIN(scr->lua_clip_rect.w, m_wr.w - scr->lua_clip_rect.x);
     r.h = MIN(scr->lua_clip_rect.h, m_wr.h - scr->lua_clip_rect.y);
+	return r;
+}
+
+void HUD_Lua_Class::apply_clip(void)
+{
+	apply_clip(clip_rect());
+}
+
+void HUD_Lua_Class::apply_clip(const SDL_Rect& r)
+{
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
 		glEnable(GL_SCISSOR_TEST);
-		scr->scissor_screen_to_rect(r);
+		alephone::Screen::instance()->scissor_screen_to_rect(r);
 	}
 	else
 #endif
@@ -197,6 +223,8 @@ void HUD_Lua_Class::set_masking_mode(short masking_mode)
 		masking_mode >= NUMBER_OF_LUA_MASKING_MODES)
 		return;
 	
+	flush();
+	
 	if (m_masking_mode == _mask_drawing)
 		end_drawing_mask();
 	else if (m_masking_mode == _mask_erasing)
@@ -218,6 +246,8 @@ void HUD_Lua_Class::clear_mask(void)
 	if (!m_drawing)
 		return;
 	
+	flush();
+	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -287,27 +317,21 @@ void HUD_Lua_Class::fill_rect(float x, float y, float w, float h,
 	if (!w || !h)
 		return;
 	
-	apply_clip();
-#ifdef HAVE_OPENGL
-	if (m_opengl)
-	{
-		glColor4f(r, g, b, a);
-		OGL_RenderRect(x, y, w, h);
-	}
-	else
-#endif
-	if (m_surface)
-	{
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.w = static_cast<Uint16>(w);
-		rect.h = static_cast<Uint16>(h);
-		SDL_FillRect(m_surface, &rect,
-								 SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255)));
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		SDL_SetClipRect(MainScreenSurface(), NULL);
-	}
+	draw_command command;
+	command.type = _command_fill_rect;
+	command.x = x;
+	command.y = y;
+	command.w = w;
+	command.h = h;
+	command.r = r;
+	command.g = g;
+	command.b = b;
+	command.a = a;
+	command.t = 0;
+	command.font = NULL;
+	command.run = NULL;
+	command.text = 0;
+	record(command);
 }	
 
 void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
@@ -316,46 +340,22 @@ void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
 {
 	if (!m_drawing)
 		return;
-		
-	apply_clip();
-#ifdef HAVE_OPENGL
-	if (m_opengl)
-	{
-		glColor4f(r, g, b, a);
-		OGL_RenderFrame(x, y, w, h, t);
-	}
-	else
-#endif
-	if (m_surface)
-	{
-		Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255));
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(w);
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.h = static_cast<Uint16>(t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(w);
-		rect.y = static_cast<Sint16>(y + h - t) + m_wr.y;
-		rect.h = static_cast<Uint16>(t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.w = static_cast<Uint16>(t);
-		rect.y = static_cast<Sint16>(y + t) + m_wr.y;
-		rect.h = static_cast<Uint16>(h - t - t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		rect.x = static_cast<Sint16>(x + w - t) + m_wr.x;
-		rect.w = static_cast<Uint16>(t);
-		rect.y = static_cast<Sint16>(y + t) + m_wr.y;
-		rect.h = static_cast<Uint16>(h - t - t);
-		SDL_FillRect(m_surface, &rect, color);
-		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-		SDL_SetClipRect(MainScreenSurface(), NULL);
-	}
+	
+	draw_command command;
+	command.type = _command_frame_rect;
+	command.x = x;
+	command.y = y;
+	command.w = w;
+	command.h = h;
+	command.r = r;
+	command.g = g;
+	command.b = b;
+	command.a = a;
+	command.t = t;
+	command.font = NULL;
+	command.run = NULL;
+	command.text = 0;
+	record(command);
 }	
 
 void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
@@ -369,73 +369,345 @@ void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
 	if (!text || !strlen(text))
 		return;
 	
-	apply_clip();
+	// software mode draws text unscaled
+	float s = m_opengl ? scale : 1.0;
+	
+	draw_command command;
+	command.type = _command_text;
+	command.run = find_text_run(font, text);
+	command.x = x;
+	command.y = y;
+	command.w = (command.run->width + 1) * s;
+	command.h = (std::max<int>(font->LineSpacing, font->Height + font->Descent) + 1) * s;
+	command.r = r;
+	command.g = g;
+	command.b = b;
+	command.a = a;
+	command.t = scale;
+	command.font = font;
+	command.text = m_text.size();
+	m_text.append(text, strlen(text) + 1);
+	record(command);
+}
+
+// Adds a command to the draw list. Commands are grouped into batches that
+// share a clip rect and, for text, a font; a command may join an earlier
+// batch as long as it does not overlap anything drawn after that batch.
+void HUD_Lua_Class::record(draw_command& command)
+{
+	command.clip = clip_rect();
+	
+	bool text = (command.type == _command_text);
+	float left = std::min(command.x, command.x + command.w) - 1;
+	float right = std::max(command.x, command.x + command.w) + 1;
+	float top = std::min(command.y, command.y + command.h) - 1;
+	float bottom = std::max(command.y, command.y + command.h) + 1;
+	
+	int batch = -1;
+	int stop = std::max(0, static_cast<int>(m_batches.size()) - MAX_BATCH_SEARCH);
+	for (int i = static_cast<int>(m_batches.size()) - 1; i >= stop; --i)
+	{
+		const draw_batch& b = m_batches[i];
+		if (b.text == text && b.font == command.font &&
+			b.clip.x == command.clip.x && b.clip.y == command.clip.y &&
+			b.clip.w == command.clip.w && b.clip.h == command.clip.h)
+		{
+			batch = i;
+			break;
+		}
+		
+		if (b.left < right && left < b.right && b.top < bottom && top < b.bottom)
+			break;
+	}
+	
+	if (batch < 0)
+	{
+		draw_batch b;
+		b.text = text;
+		b.font = command.font;
+		b.clip = command.clip;
+		b.left = left;
+		b.right = right;
+		b.top = top;
+		b.bottom = bottom;
+		m_batches.push_back(b);
+		batch = m_batches.size() - 1;
+	}
+	else
+	{
+		draw_batch& b = m_batches[batch];
+		b.left = std::min(b.left, left);
+		b.right = std::max(b.right, right);
+		b.top = std::min(b.top, top);
+		b.bottom = std::max(b.bottom, bottom);
+	}
+	
+	command.batch = batch;
+	m_commands.push_back(command);
+}
+
+// Submits the draw list, one batch at a time
+void HUD_Lua_Class::flush(void)
+{
+	if (m_commands.empty())
+		return;
+	
+	m_order.resize(m_commands.size());
+	for (size_t i = 0; i < m_order.size(); ++i)
+		m_order[i] = i;
+	std::stable_sort(m_order.begin(), m_order.end(), [this](size_t a, size_t b) {
+		return m_commands[a].batch < m_commands[b].batch;
+	});
+	
+	size_t begin = 0;
+	while (begin < m_order.size())
+	{
+		const draw_batch& batch = m_batches[m_commands[m_order[begin]].batch];
+		size_t end = begin + 1;
+		while (end < m_order.size() && m_commands[m_order[end]].batch == m_commands[m_order[begin]].batch)
+			++end;
+		
+		apply_clip(batch.clip);
+		if (batch.text)
+			flush_text(begin, end);
+		else
+			flush_rects(begin, end);
+		begin = end;
+	}
+	
+	if (!m_opengl && m_surface)
+		SDL_SetClipRect(MainScreenSurface(), NULL);
+	
+	m_commands.clear();
+	m_batches.clear();
+	m_text.clear();
+}
+
+#ifdef HAVE_OPENGL
+static std::vector<GLfloat> rect_vertices;
+static std::vector<GLfloat> rect_colors;
+
+static void add_rect_vertex(float x, float y, const float color[4])
+{
+	rect_vertices.push_back(x);
+	rect_vertices.push_back(y);
+	rect_colors.insert(rect_colors.end(), color, color + 4);
+}
+#endif
+
+static void fill_surface_rect(SDL_Surface *surface, int x, int y, int w, int h, Uint32 color)
+{
+	SDL_Rect rect;
+	rect.x = static_cast<Sint16>(x);
+	rect.y = static_cast<Sint16>(y);
+	rect.w = static_cast<Uint16>(w);
+	rect.h = static_cast<Uint16>(h);
+	SDL_FillRect(surface, &rect, color);
+	SDL_BlitSurface(surface, &rect, MainScreenSurface(), &rect);
+}
+
+void HUD_Lua_Class::flush_rects(size_t begin, size_t end)
+{
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		glTranslatef(x, y + (font->Height * scale), 0);
-        glScalef(scale, scale, 1.0);
-		glColor4f(r, g, b, a);
-		font->OGL_Render(text);
+		rect_vertices.clear();
+		rect_colors.clear();
+		for (size_t i = begin; i < end; ++i)
+		{
+			const draw_command& c = m_commands[m_order[i]];
+			const float color[4] = { c.r, c.g, c.b, c.a };
+			float x = c.x, y = c.y, w = c.w, h = c.h, t = c.t;
+			if (c.type == _command_fill_rect)
+			{
+				GLfloat v[8] = { x, y, x + w, y, x + w, y + h, x, y + h };
+				const int tris[6] = { 0, 1, 2, 0, 2, 3 };
+				for (int k = 0; k < 6; ++k)
+					add_rect_vertex(v[tris[k] * 2], v[tris[k] * 2 + 1], color);
+			}
+			else
+			{
+				// same strip as OGL_RenderFrame(), as separate triangles
+				GLfloat v[20] = {
+					x,         y,
+					x + t,     y + t,
+					x,         y + h,
+					x + t,     y + h - t,
+					x + w,     y + h,
+					x + w - t, y + h - t,
+					x + w,     y,
+					x + w - t, y + t,
+					x,         y,
+					x + t,     y + t
+				};
+				for (int k = 0; k < 8; ++k)
+				{
+					add_rect_vertex(v[k * 2], v[k * 2 + 1], color);
+					add_rect_vertex(v[k * 2 + 2], v[k * 2 + 3], color);
+					add_rect_vertex(v[k * 2 + 4], v[k * 2 + 5], color);
+				}
+			}
+		}
+		
+		glDisable(GL_TEXTURE_2D);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		glEnableClientState(GL_COLOR_ARRAY);
+		
+		glVertexPointer(2, GL_FLOAT, 0, &rect_vertices[0]);
+		glColorPointer(4, GL_FLOAT, 0, &rect_colors[0]);
+		glDrawArrays(GL_TRIANGLES, 0, rect_vertices.size() / 2);
+		
+		glDisableClientState(GL_COLOR_ARRAY);
+		glEnable(GL_TEXTURE_2D);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
 		glColor4f(1, 1, 1, 1);
-		glPopMatrix();
 	}
 	else
 #endif
 	if (m_surface)
 	{
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.w = font->TextWidth(text);
-		rect.h = font->LineSpacing;
-        
-        // FIXME: draw_text doesn't support full RGBA transfer for proper scaling,
-        // so draw blended but unscaled text instead
-#if 0
-        if (scale < 0.99 || scale > 1.01)
-        {
-            SDL_Surface *s2 = SDL_CreateRGBSurface(SDL_SWSURFACE, rect.w, rect.h, m_surface->format->BitsPerPixel, m_surface->format->Rmask, m_surface->format->Gmask, m_surface->format->Bmask, m_surface->format->Amask);
-            
-            font->Info->draw_text(s2, text, strlen(text),
-                                  0, font->Height,
-                                  SDL_MapRGBA(m_surface->format,
-                                              static_cast<unsigned char>(r * 255),
-                                              static_cast<unsigned char>(g * 255),
-                                              static_cast<unsigned char>(b * 255),
-                                              static_cast<unsigned char>(a * 255)),
-                                  font->Style);
-            
-            SDL_Rect srcrect;
-            srcrect.x = 0;
-            srcrect.y = 0;
-            srcrect.w = ceilf(rect.w * scale);
-            srcrect.h = ceilf(rect.h * scale);
-            SDL_Surface *s3 = rescale_surface(s2, srcrect.w, srcrect.h);
-            SDL_FreeSurface(s2);
-            
-            rect.w = srcrect.w;
-            rect.h = srcrect.h;
-            SDL_BlitSurface(s3, &srcrect, MainScreenSurface(), &rect);
-            SDL_FreeSurface(s3);
-        }
-        else
+		for (size_t i = begin; i < end; ++i)
+		{
+			const draw_command& c = m_commands[m_order[i]];
+			Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(c.r * 255), static_cast<unsigned char>(c.g * 255), static_cast<unsigned char>(c.b * 255), static_cast<unsigned char>(c.a * 255));
+			int x = static_cast<Sint16>(c.x) + m_wr.x;
+			int y = static_cast<Sint16>(c.y) + m_wr.y;
+			if (c.type == _command_fill_rect)
+			{
+				fill_surface_rect(m_surface, x, y, c.w, c.h, color);
+			}
+			else
+			{
+				fill_surface_rect(m_surface, x, y, c.w, c.t, color);
+				fill_surface_rect(m_surface, x, static_cast<Sint16>(c.y + c.h - c.t) + m_wr.y, c.w, c.t, color);
+				fill_surface_rect(m_surface, x, static_cast<Sint16>(c.y + c.t) + m_wr.y, c.t, c.h - c.t - c.t, color);
+				fill_surface_rect(m_surface, static_cast<Sint16>(c.x + c.w - c.t) + m_wr.x, static_cast<Sint16>(c.y + c.t) + m_wr.y, c.t, c.h - c.t - c.t, color);
+			}
+		}
+	}
+}
+
+void HUD_Lua_Class::flush_text(size_t begin, size_t end)
+{
+	FontSpecifier *font = m_commands[m_order[begin]].font;
+	
+#ifdef HAVE_OPENGL
+	if (m_opengl)
+	{
+		if (!font->OGL_BeginRender())
+			return;
+		
+		glMatrixMode(GL_MODELVIEW);
+		for (size_t i = begin; i < end; ++i)
+		{
+			const draw_command& c = m_commands[m_order[i]];
+			glPushMatrix();
+			glTranslatef(c.x, c.y + (font->Height * c.t), 0);
+			glScalef(c.t, c.t, 1.0);
+			glColor4f(c.r, c.g, c.b, c.a);
+			font->OGL_RenderRun(&m_text[c.text]);
+			glPopMatrix();
+		}
+		
+		font->OGL_EndRender();
+		glColor4f(1, 1, 1, 1);
+	}
+	else
 #endif
-        {
-            SDL_BlitSurface(MainScreenSurface(), &rect, m_surface, &rect);
-            font->Info->draw_text(m_surface, text, strlen(text),
-                                  rect.x, rect.y + font->Height,
-                                  SDL_MapRGBA(m_surface->format,
-                                              static_cast<unsigned char>(r * 255),
-                                              static_cast<unsigned char>(g * 255),
-                                              static_cast<unsigned char>(b * 255),
-                                              static_cast<unsigned char>(a * 255)),
-                                  font->Style);
-            SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-			SDL_SetClipRect(MainScreenSurface(), NULL);
-        }
+	if (m_surface)
+	{
+		// FIXME: draw_text doesn't support full RGBA transfer for proper
+		// scaling, so draw blended but unscaled text instead
+		for (size_t i = begin; i < end; ++i)
+		{
+			const draw_command& c = m_commands[m_order[i]];
+			text_run *run = c.run;
+			if (!run->surface)
+			{
+				// render once in white, and tint when blitting
+				SDL_PixelFormat *fmt = m_surface->format;
+				int w = run->width + 1;
+				int h = std::max<int>(font->LineSpacing, font->Height + font->Descent) + 1;
+				run->surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32, fmt->Rmask, fmt->Gmask, fmt->Bmask, fmt->Amask);
+				if (!run->surface)
+					continue;
+				
+				SDL_FillRect(run->surface, NULL, SDL_MapRGBA(run->surface->format, 0xff, 0xff, 0xff, 0));
+				const char *text = &m_text[c.text];
+				font->Info->draw_text(run->surface, text, strlen(text),
+									  0, font->Height,
+									  SDL_MapRGBA(run->surface->format, 0xff, 0xff, 0xff, 0xff),
+									  font->Style);
+				SDL_SetSurfaceBlendMode(run->surface, SDL_BLENDMODE_BLEND);
+			}
+			
+			SDL_Rect rect;
+			rect.x = static_cast<Sint16>(c.x) + m_wr.x;
+			rect.y = static_cast<Sint16>(c.y) + m_wr.y;
+			rect.w = run->surface->w;
+			rect.h = run->surface->h;
+			SDL_SetSurfaceColorMod(run->surface,
+								   static_cast<unsigned char>(c.r * 255),
+								   static_cast<unsigned char>(c.g * 255),
+								   static_cast<unsigned char>(c.b * 255));
+			SDL_SetSurfaceAlphaMod(run->surface, static_cast<unsigned char>(c.a * 255));
+			SDL_BlitSurface(run->surface, NULL, MainScreenSurface(), &rect);
+		}
+	}
+}
+
+HUD_Lua_Class::text_run *HUD_Lua_Class::find_text_run(FontSpecifier *font, const char *text)
+{
+	text_run_map::iterator it = m_text_runs.find(std::make_pair(font, std::string(text)));
+	if (it == m_text_runs.end())
+	{
+		text_run run;
+		run.width = font->TextWidth(text);
+		if (!m_opengl)
+			run.width = std::max<int>(run.width, font->Info->text_width(text, font->Style));
+		run.surface = NULL;
+		it = m_text_runs.insert(std::make_pair(std::make_pair(font, std::string(text)), run)).first;
+	}
+	
+	it->second.last_used = m_frame;
+	return &it->second;
+}
+
+void HUD_Lua_Class::release_text_runs(bool all)
+{
+	text_run_map::iterator it = m_text_runs.begin();
+	while (it != m_text_runs.end())
+	{
+		if (all || m_frame - it->second.last_used > TEXT_RUN_LIFETIME)
+		{
+			if (it->second.surface)
+				SDL_FreeSurface(it->second.surface);
+			it = m_text_runs.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+void HUD_Lua_Class::forget_font(FontSpecifier *font)
+{
+	for (size_t i = 0; i < m_commands.size(); ++i)
+	{
+		if (m_commands[i].font == font)
+		{
+			flush();
+			break;
+		}
+	}
+	
+	text_run_map::iterator it = m_text_runs.lower_bound(std::make_pair(font, std::string()));
+	while (it != m_text_runs.end() && it->first.first == font)
+	{
+		if (it->second.surface)
+			SDL_FreeSurface(it->second.surface);
+		it = m_text_runs.erase(it);
 	}
 }
 
@@ -444,6 +716,9 @@ void HUD_Lua_Class::draw_image(Image_Blitter *image, float x, float y)
 	if (!m_drawing)
 		return;
 	
+	// images and shapes can change between draws, so they are not recorded
+	flush();
+	
 	Image_Rect r{ x, y, image->crop_rect.w, image->crop_rect.h };
 	
 	if (!r.w || !r.h)
@@ -464,6 +739,8 @@ void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
 	if (!m_drawing)
 		return;
 	
+	flush();
+	
 	Image_Rect r;
 	r.x = x;
 	r.y = y;
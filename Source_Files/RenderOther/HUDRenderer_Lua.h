@@ -24,7 +24,10 @@ HUD_RENDERER_LUA.H
 
 #include "HUDRenderer.h"
 
+#include <map>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 struct blip_info {
 	short mtype;
@@ -49,7 +52,7 @@ class Shape_Blitter;
 class HUD_Lua_Class : public HUD_Class
 {
 public:
-	HUD_Lua_Class() : m_drawing(false) {}
+	HUD_Lua_Class() : m_drawing(false), m_opengl(false), m_surface(NULL), m_frame(0) {}
 	~HUD_Lua_Class() {}
 
 	void update_motion_sensor(short time_elapsed);
@@ -79,7 +82,43 @@ public:
 	void draw_image(Image_Blitter *image, float x, float y);
 	void draw_shape(Shape_Blitter *shape, float x, float y);
 	
+	// drops cached text for a font that is about to be deleted
+	void forget_font(FontSpecifier *font);
+	
 protected:
+	// a string as last measured or rendered in a font, kept across frames
+	struct text_run {
+		int width;
+		SDL_Surface *surface;	// white text on transparent; software only
+		int last_used;
+	};
+	typedef std::map<std::pair<FontSpecifier *, std::string>, text_run> text_run_map;
+	
+	// rects and text are recorded here while the Lua draw callback runs and
+	// submitted in batches; anything else flushes the list first
+	enum {
+		_command_fill_rect,
+		_command_frame_rect,
+		_command_text
+	};
+	struct draw_command {
+		short type;
+		float x, y, w, h;	// bounds, in HUD coordinates
+		float r, g, b, a;
+		float t;		// frame thickness, or text scale
+		FontSpecifier *font;
+		text_run *run;
+		size_t text;		// offset into m_text
+		SDL_Rect clip;
+		int batch;
+	};
+	struct draw_batch {
+		bool text;
+		FontSpecifier *font;
+		SDL_Rect clip;
+		float left, top, right, bottom;
+	};
+	
 	std::vector<blip_info> m_blips;
 	bool m_drawing;
 	bool m_opengl;
@@ -87,6 +126,23 @@ protected:
 	SDL_Rect m_wr;
 	short m_masking_mode;
 	
+	std::vector<draw_command> m_commands;
+	std::vector<draw_batch> m_batches;
+	std::vector<size_t> m_order;
+	std::string m_text;
+	text_run_map m_text_runs;
+	int m_frame;
+	
+	void apply_clip(const SDL_Rect& r);
+	SDL_Rect clip_rect(void);
+	
+	void record(draw_command& command);
+	void flush(void);
+	void flush_rects(size_t begin, size_t end);
+	void flush_text(size_t begin, size_t end);
+	text_run *find_text_run(FontSpecifier *font, const char *text);
+	void release_text_runs(bool all);
+	
 	void start_using_mask(void);
 	void end_using_mask(void);
 	void start_drawing_mask(bool erase);
@@ -87,85 +87,14 @@ void OverheadMapClass::Render(overhead_map_data& Control)
 	begin_polygons();
 	
 	/* shade all visible polygons */
-	for (i=0;i<dynamic_world->polygon_count;++i)
+	for (size_t k=0;k<automap_polygon_list.size();++k)
 	{
-		struct polygon_data *polygon= get_polygon_data(i);
-		if (POLYGON_IS_IN_AUTOMAP(i) && TEST_STATE_FLAG(i, _polygon_on_automap)
-			&&(polygon->floor_transfer_mode!=_xfer_landscape||polygon->ceiling_transfer_mode!=_xfer_landscape))
+		automap_polygon& entry= automap_polygon_list[k];
+		
+		if (polygon_is_on_screen(entry.index))
 		{
-			
-			if (!POLYGON_IS_DETACHED(polygon))
-			{
-				short color;
-				
-				switch (polygon->type)
-				{
-					case _polygon_is_platform:
-						color= PLATFORM_IS_SECRET(get_platform_data(polygon->permutation)) ?
-							_polygon_color : _polygon_platform_color;
-						if (PLATFORM_IS_FLOODED(get_platform_data(polygon->permutation)))
-						{
-							short adj_index = find_flooding_polygon(i);
-							if (adj_index != NONE)
-							{
-								switch (get_polygon_data(adj_index)->type)
-								{
-									case _polygon_is_minor_ouch:
-										color = _polygon_minor_ouch_color;
-										break;
-									case _polygon_is_major_ouch:
-										color = _polygon_major_ouch_color;
-										break;
-								}
-							}
-						}
-						break;
-					
-					case _polygon_is_minor_ouch:
-						color = _polygon_minor_ouch_color;
-						break;
-					
-					case _polygon_is_major_ouch:
-						color = _polygon_major_ouch_color;
-						break;
-                        
-					case _polygon_is_teleporter:
-						color = _polygon_teleporter_color;
-						break;
-                        
-				case _polygon_is_hill:
-					color = _polygon_hill_color;
-					break;
-					
-					default:
-						color= _polygon_color;
-						break;
-				}
-
-				if (polygon->media_index!=NONE)
-				{
-					struct media_data *media= get_media_data(polygon->media_index);
-					
-					// LP change: idiot-proofing
-					if (media)
-					{
-						if (media->height>=polygon->floor_height)
-						{
-							switch (media->type)
-							{
-								case _media_water: color= _polygon_water_color; break;
-								case _media_lava: color= _polygon_lava_color; break;
-								case _media_goo: color= _polygon_goo_color; break;
-								// LP change: separated sewage and JjaroGoo
-								case _media_sewage: color= _polygon_sewage_color; break;
-								case _media_jjaro: color = _polygon_jjaro_color; break;
-							}
-						}
-					}
-				}
-				
-				draw_polygon(polygon->vertex_count, polygon->endpoint_indexes, color, scale);
-			}
+			struct polygon_data *polygon= get_polygon_data(entry.index);
+			draw_polygon(polygon->vertex_count, polygon->endpoint_indexes, entry.color, scale);
 		}
 	}
 
@@ -176,44 +105,15 @@ void OverheadMapClass::Render(overhead_map_data& Control)
 	begin_lines();
 	
 	/* draw all visible lines */
-	for (i=0;i<dynamic_world->line_count;++i)
+	for (size_t k=0;k<automap_line_list.size();++k)
 	{
-		short line_color= NONE;
-		struct line_data *line= get_line_data(i);
+		automap_line& entry= automap_line_list[k];
+		struct line_data *line= get_line_data(entry.index);
 		
-		if (LINE_IS_IN_AUTOMAP(i))
+		if ((line->clockwise_polygon_owner!=NONE && polygon_is_on_screen(line->clockwise_polygon_owner)) ||
+			(line->counterclockwise_polygon_owner!=NONE && polygon_is_on_screen(line->counterclockwise_polygon_owner)))
 		{
-			if ((line->clockwise_polygon_owner!=NONE && TEST_STATE_FLAG(line->clockwise_polygon_owner, _polygon_on_automap)) ||
-				(line->counterclockwise_polygon_owner!=NONE && TEST_STATE_FLAG(line->counterclockwise_polygon_owner, _polygon_on_automap)))
-			{
-				struct polygon_data *clockwise_polygon= line->clockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->clockwise_polygon_owner);
-				struct polygon_data *counterclockwise_polygon= line->counterclockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->counterclockwise_polygon_owner);
-
-				if (LINE_IS_SOLID(line) || LINE_IS_VARIABLE_ELEVATION(line))
-				{
-					if (LINE_IS_LANDSCAPED(line))
-					{
-						if ((!clockwise_polygon||clockwise_polygon->floor_transfer_mode!=_xfer_landscape) &&
-							(!counterclockwise_polygon||counterclockwise_polygon->floor_transfer_mode!=_xfer_landscape))
-						{
-							line_color= _elevation_line_color;
-						}
-					}
-					else
-					{
-						line_color= _solid_line_color;
-					}
-				}
-				else
-				{
-					if (clockwise_polygon->floor_height!=counterclockwise_polygon->floor_height)
-					{
-						line_color= LINE_IS_LANDSCAPED(line) ? NONE : static_cast<short>(_elevation_line_color);
-					}
-				}
-			}
-			
-			if (line_color!=NONE) draw_line(i, line_color, scale);
+			draw_line(entry.index, entry.color, scale);
 		}
 	}
 
@@ -229,7 +129,7 @@ void OverheadMapClass::Render(overhead_map_data& Control)
 		while ((annotation= get_next_map_annotation(&i))!=NULL)
 		{
 			if (POLYGON_IS_IN_AUTOMAP(annotation->polygon_index) &&
-				TEST_STATE_FLAG(annotation->polygon_index, _polygon_on_automap))
+				polygon_is_on_screen(annotation->polygon_index))
 			{
 				location.x= xoff + WORLD_TO_SCREEN(annotation->location.x, x0, scale);
 				location.y= yoff + WORLD_TO_SCREEN(annotation->location.y, y0, scale);
@@ -398,11 +298,14 @@ void OverheadMapClass::transform_endpoints_for_overhead_map(
 	world_distance x0= Control.origin.x, y0= Control.origin.y;
 	int xoff= Control.left + Control.half_width, yoff = Control.top + Control.half_height;
 	short scale= Control.scale;
-	short i;
 
-	/* transform all our endpoints into screen space, remembering which ones are visible */
-	for (i=0;i<dynamic_world->endpoint_count;++i)
+	if (automap_is_stale()) rebuild_automap();
+
+	/* transform the endpoints we may draw or cull with into screen space, remembering which
+		ones are visible; polygons are checked against them lazily by polygon_is_on_screen() */
+	for (size_t k=0;k<automap_endpoint_list.size();++k)
 	{
+		short i= automap_endpoint_list[k];
 		struct endpoint_data *endpoint= get_endpoint_data(i);
 		
 		endpoint->transformed.x= xoff + WORLD_TO_SCREEN(endpoint->vertex.x, x0, scale);
@@ -416,23 +319,256 @@ void OverheadMapClass::transform_endpoints_for_overhead_map(
 			SET_STATE_FLAG(i, _endpoint_on_automap, true);
 		}
 	}
+}
+
+
+bool OverheadMapClass::polygon_is_on_screen(
+	short polygon_index)
+{
+	if (TEST_STATE_FLAG(polygon_index, _polygon_on_automap)) return true;
+	
+	/* a polygon is visible if any of its endpoints are */
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	for (short j=0;j<polygon->vertex_count;++j)
+	{
+		if (TEST_STATE_FLAG(polygon->endpoint_indexes[j], _endpoint_on_automap))
+		{
+			SET_STATE_FLAG(polygon_index, _polygon_on_automap, true);
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+/* --------- the retained automap */
+
+// Bumped by InvalidateOverheadMapGeometry(); compared against each renderer's copy
+static int32 automap_geometry_generation= 0;
+
+void InvalidateOverheadMapGeometry()
+{
+	++automap_geometry_generation;
+}
+
 
-	/* sweep the polygon array, determining which polygons are visible based on their
-		endpoints */
-	for (i=0;i<dynamic_world->polygon_count;++i)
+bool OverheadMapClass::automap_is_stale()
+{
+	bool stale= automap_generation_seen!=automap_geometry_generation;
+	
+	size_t line_bytes= (dynamic_world->line_count+7)/8;
+	size_t polygon_bytes= (dynamic_world->polygon_count+7)/8;
+	if (automap_bits_seen.size()!=line_bytes+polygon_bytes ||
+		memcmp(automap_bits_seen.data(), automap_lines, line_bytes)!=0 ||
+		memcmp(automap_bits_seen.data()+line_bytes, automap_polygons, polygon_bytes)!=0)
+	{
+		stale= true;
+	}
+	
+	/* moving platforms change floor heights (and so line and media colors); rising
+		and falling media change polygon colors */
+	automap_motion_now.clear();
+	for (size_t i=0;i<MAXIMUM_PLATFORMS_PER_MAP && i<static_cast<size_t>(dynamic_world->platform_count);++i)
+	{
+		struct platform_data *platform= platforms + i;
+		automap_motion_now.push_back(platform->floor_height);
+		automap_motion_now.push_back(platform->ceiling_height);
+		automap_motion_now.push_back(static_cast<int32>(platform->static_flags));
+		automap_motion_now.push_back(platform->dynamic_flags);
+	}
+	for (size_t i=0;i<MAXIMUM_MEDIAS_PER_MAP;++i)
+	{
+		struct media_data *media= medias + i;
+		automap_motion_now.push_back(SLOT_IS_USED(media) ? media->height : INT32_MIN);
+		automap_motion_now.push_back(media->type);
+	}
+	if (automap_motion_now!=automap_motion_seen)
 	{
+		automap_motion_seen.swap(automap_motion_now);
+		stale= true;
+	}
+	
+	return stale;
+}
+
+
+void OverheadMapClass::rebuild_automap()
+{
+	automap_generation_seen= automap_geometry_generation;
+	
+	size_t line_bytes= (dynamic_world->line_count+7)/8;
+	size_t polygon_bytes= (dynamic_world->polygon_count+7)/8;
+	automap_bits_seen.resize(line_bytes+polygon_bytes);
+	memcpy(automap_bits_seen.data(), automap_lines, line_bytes);
+	memcpy(automap_bits_seen.data()+line_bytes, automap_polygons, polygon_bytes);
+	
+	automap_polygon_list.clear();
+	automap_line_list.clear();
+	automap_endpoint_list.clear();
+	
+	// Endpoints of every polygon the culling may look at: automap polygons and the owners of automap lines
+	std::vector<bool> polygon_needed(dynamic_world->polygon_count, false);
+	
+	for (short i=0;i<dynamic_world->polygon_count;++i)
+	{
+		if (!POLYGON_IS_IN_AUTOMAP(i)) continue;
+		polygon_needed[i]= true;
+		
+		short color= classify_polygon(i);
+		if (color!=NONE)
+		{
+			automap_polygon entry= {i, color};
+			automap_polygon_list.push_back(entry);
+		}
+	}
+	
+	for (short i=0;i<dynamic_world->line_count;++i)
+	{
+		if (!LINE_IS_IN_AUTOMAP(i)) continue;
+		
+		struct line_data *line= get_line_data(i);
+		if (line->clockwise_polygon_owner!=NONE) polygon_needed[line->clockwise_polygon_owner]= true;
+		if (line->counterclockwise_polygon_owner!=NONE) polygon_needed[line->counterclockwise_polygon_owner]= true;
+		
+		short color= classify_line(i);
+		if (color!=NONE)
+		{
+			automap_line entry= {i, color};
+			automap_line_list.push_back(entry);
+		}
+	}
+	
+	std::vector<bool> endpoint_needed(dynamic_world->endpoint_count, false);
+	for (short i=0;i<dynamic_world->polygon_count;++i)
+	{
+		if (!polygon_needed[i]) continue;
+		
 		struct polygon_data *polygon= get_polygon_data(i);
-		short j;
+		for (short j=0;j<polygon->vertex_count;++j)
+			endpoint_needed[polygon->endpoint_indexes[j]]= true;
+	}
+	for (short i=0;i<dynamic_world->endpoint_count;++i)
+	{
+		if (endpoint_needed[i]) automap_endpoint_list.push_back(i);
+	}
+}
+
+
+// Returns the polygon color, or NONE if the polygon is not drawn
+short OverheadMapClass::classify_polygon(
+	short polygon_index)
+{
+	struct polygon_data *polygon= get_polygon_data(polygon_index);
+	short color;
+	
+	if (polygon->floor_transfer_mode==_xfer_landscape && polygon->ceiling_transfer_mode==_xfer_landscape)
+		return NONE;
+	if (POLYGON_IS_DETACHED(polygon))
+		return NONE;
+	
+	switch (polygon->type)
+	{
+		case _polygon_is_platform:
+			color= PLATFORM_IS_SECRET(get_platform_data(polygon->permutation)) ?
+				_polygon_color : _polygon_platform_color;
+			if (PLATFORM_IS_FLOODED(get_platform_data(polygon->permutation)))
+			{
+				short adj_index = find_flooding_polygon(polygon_index);
+				if (adj_index != NONE)
+				{
+					switch (get_polygon_data(adj_index)->type)
+					{
+						case _polygon_is_minor_ouch:
+							color = _polygon_minor_ouch_color;
+							break;
+						case _polygon_is_major_ouch:
+							color = _polygon_major_ouch_color;
+							break;
+					}
+				}
+			}
+			break;
 		
-		for (j=0;j<polygon->vertex_count;++j)
+		case _polygon_is_minor_ouch:
+			color = _polygon_minor_ouch_color;
+			break;
+		
+		case _polygon_is_major_ouch:
+			color = _polygon_major_ouch_color;
+			break;
+			
+		case _polygon_is_teleporter:
+			color = _polygon_teleporter_color;
+			break;
+			
+		case _polygon_is_hill:
+			color = _polygon_hill_color;
+			break;
+		
+		default:
+			color= _polygon_color;
+			break;
+	}
+
+	if (polygon->media_index!=NONE)
+	{
+		struct media_data *media= get_media_data(polygon->media_index);
+		
+		// LP change: idiot-proofing
+		if (media)
+		{
+			if (media->height>=polygon->floor_height)
+			{
+				switch (media->type)
+				{
+					case _media_water: color= _polygon_water_color; break;
+					case _media_lava: color= _polygon_lava_color; break;
+					case _media_goo: color= _polygon_goo_color; break;
+					// LP change: separated sewage and JjaroGoo
+					case _media_sewage: color= _polygon_sewage_color; break;
+					case _media_jjaro: color = _polygon_jjaro_color; break;
+				}
+			}
+		}
+	}
+	
+	return color;
+}
+
+
+// Returns the line color, or NONE if the line is not drawn
+short OverheadMapClass::classify_line(
+	short line_index)
+{
+	short line_color= NONE;
+	struct line_data *line= get_line_data(line_index);
+	struct polygon_data *clockwise_polygon= line->clockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->clockwise_polygon_owner);
+	struct polygon_data *counterclockwise_polygon= line->counterclockwise_polygon_owner==NONE ? NULL : get_polygon_data(line->counterclockwise_polygon_owner);
+
+	if (LINE_IS_SOLID(line) || LINE_IS_VARIABLE_ELEVATION(line))
+	{
+		if (LINE_IS_LANDSCAPED(line))
 		{
-			if (TEST_STATE_FLAG(polygon->endpoint_indexes[j], _endpoint_on_automap))
+			if ((!clockwise_polygon||clockwise_polygon->floor_transfer_mode!=_xfer_landscape) &&
+				(!counterclockwise_polygon||counterclockwise_polygon->floor_transfer_mode!=_xfer_landscape))
 			{
-				SET_STATE_FLAG(i, _polygon_on_automap, true);
-				break;
+				line_color= _elevation_line_color;
 			}
 		}
+		else
+		{
+			line_color= _solid_line_color;
+		}
 	}
+	else
+	{
+		if (clockwise_polygon->floor_height!=counterclockwise_polygon->floor_height)
+		{
+			line_color= LINE_IS_LANDSCAPED(line) ? NONE : static_cast<short>(_elevation_line_color);
+		}
+	}
+	
+	return line_color;
 }
 
 /* --------- the false automap */
@@ -38,6 +38,8 @@ Dec 17, 2000 (Loren Petrich):
 #include "shell.h"
 #include "FontHandler.h"
 
+#include <vector>
+
 
 /* ---------- constants */
 
@@ -168,6 +170,33 @@ class OverheadMapClass
 	// For the false automap
 	byte *saved_automap_lines, *saved_automap_polygons;
 
+	// Retained automap: the polygons and lines that pass the automap and landscape tests,
+	// with their colors, plus every endpoint the per-frame culling looks at.  It is rebuilt
+	// only when the automap bits, the platforms or media, or InvalidateOverheadMapGeometry()
+	// say it is stale, so a frame just transforms those endpoints and culls.
+	struct automap_polygon
+	{
+		short index;
+		short color;
+	};
+	struct automap_line
+	{
+		short index;
+		short color;
+	};
+	std::vector<automap_polygon> automap_polygon_list;
+	std::vector<automap_line> automap_line_list;
+	std::vector<short> automap_endpoint_list;
+	std::vector<byte> automap_bits_seen;
+	std::vector<int32> automap_motion_seen, automap_motion_now;
+	int32 automap_generation_seen;
+
+	bool automap_is_stale();
+	void rebuild_automap();
+	short classify_polygon(short polygon_index);
+	short classify_line(short line_index);
+	bool polygon_is_on_screen(short polygon_index);
+
 protected:
 
 	// Text justification
@@ -321,7 +350,8 @@ public:
 	void Render(overhead_map_data& Control);
 	
 	// Constructor (idiot-proofer)
-	OverheadMapClass(): ConfigPtr(NULL) {}
+	OverheadMapClass(): saved_automap_lines(NULL), saved_automap_polygons(NULL),
+		automap_generation_seen(-1), ConfigPtr(NULL) {}
 
 	// Destructor
 	virtual ~OverheadMapClass() {}
@@ -47,7 +47,10 @@ Jul 31, 2002 (Loren Petrich)
 #include "FileHandler.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
 #include <memory>
+#include <vector>
 
 #include "interface.h"
 #include "shell.h"
@@ -139,7 +142,8 @@ extern bool shapes_file_is_m1();
  *  Uncompress picture data, returns size of compressed image data that was read
  */
 
-// Uncompress (and endian-correct) scan line compressed by PackBits RLE algorithm
+// Uncompress (and endian-correct) scan line compressed by PackBits RLE algorithm;
+// runs are filled and copied a whole run at a time so the compiler can use block moves
 template <class T>
 static const uint8 *unpack_bits(const uint8 *src, int row_bytes, T *dst)
 {
@@ -160,34 +164,32 @@ static const uint8 *unpack_bits(const uint8 *src, int row_bytes, T *dst)
 
 			// RLE compressed run
 			int size = -c + 1;
-			T data;
 			if (sizeof(T) == 1) {
-				data = *src++;
+				memset(dst, *src++, size);
 				src_count--;
 			} else {
-				data = (src[0] << 8) | src[1];
+				T data = (src[0] << 8) | src[1];
 				src += 2;
 				src_count -= 2;
+				std::fill(dst, dst + size, data);
 			}
-			for (int i=0; i<size; i++)
-				*dst++ = data;
+			dst += size;
 
 		} else {
 
 			// Uncompressed run
 			int size = c + 1;
-			for (int i=0; i<size; i++) {
-				T data;
-				if (sizeof(T) == 1) {
-					data = *src++;
-					src_count--;
-				} else {
-					data = (src[0] << 8) | src[1];
-					src += 2;
-					src_count -= 2;
-				}
-				*dst++ = data;
+			if (sizeof(T) == 1) {
+				memcpy(dst, src, size);
+				src += size;
+				src_count -= size;
+			} else {
+				for (int i=0; i<size; i++)
+					dst[i] = (src[i * 2] << 8) | src[i * 2 + 1];
+				src += size * 2;
+				src_count -= size * 2;
 			}
+			dst += size;
 		}
 	}
 	return src;
@@ -215,15 +217,20 @@ static int uncompress_rle16(const uint8 *src, int row_bytes, uint8 *dst, int dst
 	return static_cast<int>(src - start);
 }
 
-static void copy_component_into_surface(const uint8 *src, uint8 *dst, int count, int component)
+// Interleave planar red, green and blue rows into 32-bit pixels in one pass,
+// leaving the fourth byte of each pixel alone
+static void copy_components_into_surface(const uint8 *red, const uint8 *green, const uint8 *blue, uint8 *dst, int count)
 {
+	int r, g, b;
 	if (PlatformIsLittleEndian()) {
-		dst += 2 - component;
+		r = 2; g = 1; b = 0;
 	} else {
-		dst += component + 1;
+		r = 1; g = 2; b = 3;
 	}
-	while (count--) {
-		*dst = *src++;
+	for (int x=0; x<count; x++) {
+		dst[r] = red[x];
+		dst[g] = green[x];
+		dst[b] = blue[x];
 		dst += 4;
 	}
 }
@@ -245,9 +252,7 @@ static int uncompress_rle32(const uint8 *src, int row_bytes, uint8 *dst, int dst
 		// "tmp" now contains "width" bytes of red, followed by "width"
 		// bytes of green and "width" bytes of blue, so we have to copy them
 		// into the surface in the right order
-		copy_component_into_surface(tmp, dst, width, 0);
-		copy_component_into_surface(tmp + width, dst, width, 1);
-		copy_component_into_surface(tmp + width * 2, dst, width, 2);
+		copy_components_into_surface(tmp, tmp + width, tmp + width * 2, dst, width);
 
 		dst += dst_pitch;
 	}
@@ -731,15 +736,28 @@ std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> picture_to_surface(Load
 template <class T>
 static void rescale(T *src_pixels, int src_pitch, T *dst_pixels, int dst_pitch, int width, int height, uint32 dx, uint32 dy)
 {
-	// Brute-force rescaling, no interpolation
+	// Brute-force rescaling, no interpolation; the column mapping is the same
+	// for every row, and rows that sample the same source row are copied whole
+	std::vector<uint32> columns(width);
+	uint32 sx = 0;
+	for (int x=0; x<width; x++) {
+		columns[x] = sx >> 16;
+		sx += dx;
+	}
+
 	uint32 sy = 0;
+	const T *previous_row = NULL;
+	uint32 previous_sy = 0;
 	for (int y=0; y<height; y++) {
-		T *p = src_pixels + src_pitch / sizeof(T) * (sy >> 16);
-		uint32 sx = 0;
-		for (int x=0; x<width; x++) {
-			dst_pixels[x] = p[sx >> 16];
-			sx += dx;
+		if (previous_row && (sy >> 16) == previous_sy) {
+			memcpy(dst_pixels, previous_row, width * sizeof(T));
+		} else {
+			const T *p = src_pixels + src_pitch / sizeof(T) * (sy >> 16);
+			for (int x=0; x<width; x++)
+				dst_pixels[x] = p[columns[x]];
 		}
+		previous_row = dst_pixels;
+		previous_sy = sy >> 16;
 		dst_pixels += dst_pitch / sizeof(T);
 		sy += dy;
 	}
@@ -783,16 +801,14 @@ SDL_Surface *rescale_surface(SDL_Surface *s, int width, int height)
 template <class T>
 static void tile(T *src_pixels, int src_pitch, T *dst_pixels, int dst_pitch, int src_width, int src_height, int dst_width, int dst_height)
 {
+	// Each destination row is its source row repeated, one span at a time
+	if (src_width <= 0)
+		return;
 	T *p = src_pixels;
 	int sy = 0;
 	for (int y=0; y<dst_height; y++) {
-		int sx = 0;
-		for (int x=0; x<dst_width; x++) {
-			dst_pixels[x] = p[sx];
-			sx++;
-			if (sx == src_width)
-				sx = 0;
-		}
+		for (int x=0; x<dst_width; x+=src_width)
+			memcpy(dst_pixels + x, p, std::min(src_width, dst_width - x) * sizeof(T));
 		dst_pixels += dst_pitch / sizeof(T);
 		sy++;
 		if (sy == src_height) {
@@ -54,6 +54,11 @@ struct overhead_map_data
 
 void _render_overhead_map(struct overhead_map_data *data);
 
+// The overhead map keeps its polygon and line classification between frames and only
+// notices automap, platform and media changes on its own; call this after anything
+// else that changes polygon types, floor heights, transfer modes or media assignments
+void InvalidateOverheadMapGeometry();
+
 class InfoTree;
 void parse_mml_overhead_map(const InfoTree& root);
 void reset_mml_overhead_map();
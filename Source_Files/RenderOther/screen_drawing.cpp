@@ -539,23 +539,7 @@ int ttf_font_info::_draw_text(SDL_Surface *s, const char *text, size_t length, i
 	SDL_Color c;
 	SDL_GetRGB(pixel, s->format, &c.r, &c.g, &c.b);
 	c.a = 0xff;
-	SDL_Surface *text_surface = 0;
-	if (utf8) 
-	{
-		char *temp = process_printable(text, length);
-		if (environment_preferences->smooth_text)
-			text_surface = TTF_RenderUTF8_Blended(get_ttf(style), temp, c);	
-		else
-			text_surface = TTF_RenderUTF8_Solid(get_ttf(style), temp, c);
-	}
-	else
-	{
-		uint16 *temp = process_macroman(text, length);
-		if (environment_preferences->smooth_text)
-			text_surface = TTF_RenderUNICODE_Blended(get_ttf(style), temp, c);
-		else
-			text_surface = TTF_RenderUNICODE_Solid(get_ttf(style), temp, c);
-	}
+	SDL_Surface *text_surface = render_run(text, length, style, utf8, c);
 	if (!text_surface) return 0;
 	
 	SDL_Rect dst_rect;
@@ -589,9 +573,8 @@ int ttf_font_info::_draw_text(SDL_Surface *s, const char *text, size_t length, i
 	if (s == MainScreenSurface())
 		MainScreenUpdateRect(x, y - TTF_FontAscent(get_ttf(style)), text_width(text, style, utf8), TTF_FontHeight(get_ttf(style)));
 
-	int width = text_surface->w;
-	SDL_FreeSurface(text_surface);
-	return width;
+	// the run cache owns text_surface
+	return text_surface->w;
 }
 
 static void draw_text(const char *text, int x, int y, uint32 pixel, const font_info *font, uint16 style)
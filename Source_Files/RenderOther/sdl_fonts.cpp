@@ -35,6 +35,8 @@
 #include <SDL2/SDL_endian.h>
 #include <vector>
 #include <map>
+#include <list>
+#include <unordered_map>
 
 #include <boost/tokenizer.hpp>
 #include <string>
@@ -67,6 +69,119 @@ static ttf_font_list_t ttf_font_list;
 extern vector<DirectorySpecifier> data_search_path;
 
 
+/*
+ *  Run cache
+ *
+ *  SDL_ttf measures and rasterizes a whole string per call, and the HUD, terminals
+ *  and menus ask for the same strings every frame.  Measured widths and rendered
+ *  surfaces are kept in small LRU caches keyed by the TTF_Font, the rendering
+ *  options and the processed text; text_width() and draw_text() on a string seen
+ *  recently are a lookup (and a blit).
+ */
+
+template <typename T>
+class ttf_run_cache
+{
+public:
+	ttf_run_cache(size_t capacity, void (*release)(T&)) : m_capacity(capacity), m_release(release) {}
+	~ttf_run_cache() { clear(); }
+
+	T *find(const std::string& key)
+	{
+		typename index_t::iterator it = m_index.find(key);
+		if (it == m_index.end())
+			return NULL;
+
+		m_entries.splice(m_entries.begin(), m_entries, it->second);
+		return &it->second->second;
+	}
+
+	T& insert(const std::string& key, const T& value)
+	{
+		if (m_entries.size() >= m_capacity)
+		{
+			if (m_release) m_release(m_entries.back().second);
+			m_index.erase(m_entries.back().first);
+			m_entries.pop_back();
+		}
+
+		m_entries.push_front(std::make_pair(key, value));
+		m_index[key] = m_entries.begin();
+		return m_entries.front().second;
+	}
+
+	// Drops every run whose key starts with prefix (a font being closed)
+	void flush(const std::string& prefix)
+	{
+		for (typename entries_t::iterator it = m_entries.begin(); it != m_entries.end(); )
+		{
+			if (it->first.compare(0, prefix.size(), prefix) == 0)
+			{
+				if (m_release) m_release(it->second);
+				m_index.erase(it->first);
+				it = m_entries.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	void clear()
+	{
+		for (typename entries_t::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+			if (m_release) m_release(it->second);
+		m_entries.clear();
+		m_index.clear();
+	}
+
+private:
+	typedef std::list<std::pair<std::string, T> > entries_t;
+	typedef std::unordered_map<std::string, typename entries_t::iterator> index_t;
+
+	size_t m_capacity;
+	void (*m_release)(T&);
+	entries_t m_entries;
+	index_t m_index;
+};
+
+static void free_run_surface(SDL_Surface*& surface)
+{
+	SDL_FreeSurface(surface);
+}
+
+static ttf_run_cache<int> ttf_width_cache(512, NULL);
+static ttf_run_cache<SDL_Surface *> ttf_surface_cache(128, free_run_surface);
+
+static std::string ttf_run_key_prefix(TTF_Font *font)
+{
+	return std::string(reinterpret_cast<const char *>(&font), sizeof(font));
+}
+
+// font, then one byte of flags, then (for surfaces) the color, then the text
+static void build_ttf_run_key(std::string& key, TTF_Font *font, uint8 flags, const SDL_Color *color, const char *text, bool utf8)
+{
+	key = ttf_run_key_prefix(font);
+	key += static_cast<char>(flags);
+	if (color)
+	{
+		key += static_cast<char>(color->r);
+		key += static_cast<char>(color->g);
+		key += static_cast<char>(color->b);
+	}
+
+	if (utf8)
+		key.append(text);
+	else
+	{
+		const uint16 *unicode = reinterpret_cast<const uint16 *>(text);
+		size_t count = 0;
+		while (unicode[count])
+			++count;
+		key.append(text, count * sizeof(uint16));
+	}
+}
+
+
 /*
  *  Initialize font management
  */
@@ -452,6 +567,9 @@ void ttf_font_info::_unload()
 			--(it->second.second);
 			if (it->second.second <= 0)
 			{
+				std::string prefix = ttf_run_key_prefix(it->second.first);
+				ttf_width_cache.flush(prefix);
+				ttf_surface_cache.flush(prefix);
 				TTF_CloseFont(it->second.first);
 				ttf_font_list.erase(m_keys[i]);
 			}
@@ -529,19 +647,54 @@ uint16 ttf_font_info::_text_width(const char *text, uint16 style, bool utf8) con
 
 uint16 ttf_font_info::_text_width(const char *text, size_t length, uint16 style, bool utf8) const
 {
+	static std::string key;
+	const char *temp = utf8 ? process_printable(text, length) : reinterpret_cast<const char *>(process_macroman(text, length));
+	build_ttf_run_key(key, get_ttf(style), utf8 ? 1 : 0, NULL, temp, utf8);
+
+	int *cached = ttf_width_cache.find(key);
+	if (cached)
+		return *cached;
+
 	int width = 0;
 	if (utf8)
-	{
-		char *temp = process_printable(text, length);
 		TTF_SizeUTF8(get_ttf(style), temp, &width, 0);
+	else
+		TTF_SizeUNICODE(get_ttf(style), reinterpret_cast<const uint16 *>(temp), &width, 0);
+	
+	return ttf_width_cache.insert(key, width);
+}
+
+SDL_Surface *ttf_font_info::render_run(const char *text, size_t length, uint16 style, bool utf8, SDL_Color color) const
+{
+	static std::string key;
+	bool smooth = environment_preferences->smooth_text;
+	const char *temp = utf8 ? process_printable(text, length) : reinterpret_cast<const char *>(process_macroman(text, length));
+	build_ttf_run_key(key, get_ttf(style), (utf8 ? 1 : 0) | (smooth ? 2 : 0), &color, temp, utf8);
+
+	SDL_Surface **cached = ttf_surface_cache.find(key);
+	if (cached)
+		return *cached;
+
+	SDL_Surface *surface;
+	if (utf8)
+	{
+		if (smooth)
+			surface = TTF_RenderUTF8_Blended(get_ttf(style), temp, color);
+		else
+			surface = TTF_RenderUTF8_Solid(get_ttf(style), temp, color);
 	}
 	else
 	{
-		uint16 *temp = process_macroman(text, length);
-		TTF_SizeUNICODE(get_ttf(style), temp, &width, 0);
+		const uint16 *unicode = reinterpret_cast<const uint16 *>(temp);
+		if (smooth)
+			surface = TTF_RenderUNICODE_Blended(get_ttf(style), unicode, color);
+		else
+			surface = TTF_RenderUNICODE_Solid(get_ttf(style), unicode, color);
 	}
-	
-	return width;
+	if (!surface)
+		return NULL;
+
+	return ttf_surface_cache.insert(key, surface);
 }
 
 int ttf_font_info::_trunc_text(const char *text, int max_width, uint16 style) const
@@ -144,6 +144,8 @@ protected:
 private:
 	char *process_printable(const char *src, int len) const;
 	uint16 *process_macroman(const char *src, int len) const;
+	// Rendered through the run cache in sdl_fonts.cpp, which owns the surface
+	SDL_Surface *render_run(const char *text, size_t length, uint16 style, bool utf8, SDL_Color color) const;
 	TTF_Font *get_ttf(uint16 style) const { return m_styles[style & (styleBold | styleItalic)]; }
 	virtual void _unload();
 };
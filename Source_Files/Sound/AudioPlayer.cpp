@@ -102,9 +102,9 @@ bool AudioPlayer::Play() {
 
 		ALint queued;
 
-		//If no buffers are queued, playback is finished 
+		//If no buffers are queued, playback is finished unless the player is still waiting for its data
 		alGetSourcei(audio_source->source_id, AL_BUFFERS_QUEUED, &queued);
-		if (queued == 0) return false; //End playing
+		if (queued == 0) return IsWaitingForData(); //End playing
 
 		alSourcePlay(audio_source->source_id);
 	}
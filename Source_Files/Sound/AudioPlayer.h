@@ -108,6 +108,7 @@ protected:
     std::unique_ptr<AudioSource> audio_source;
     virtual void Rewind();
     virtual bool ShouldRoutinelyStop() const { return true; }
+    virtual bool IsWaitingForData() const { return false; } //nothing could be queued yet but more data is on its way
 };
 
 #endif
\ No newline at end of file
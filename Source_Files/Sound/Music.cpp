@@ -122,8 +122,14 @@ void Music::Idle()
 {
 	if (!SoundManager::instance()->IsInitialized() || !SoundManager::instance()->IsActive()) return;
 
-	if (get_game_state() >= _game_in_progress && !music_slots[MusicSlot::Level].Playing() && LoadLevelMusic()) {
-		music_slots[MusicSlot::Level].Play();
+	auto& levelSlot = music_slots[MusicSlot::Level];
+	levelSlot.UpdateCurrentTrack();
+
+	if (get_game_state() >= _game_in_progress && !levelSlot.Playing() && LoadLevelMusic()) {
+		levelSlot.Play();
+	}
+	else if (levelSlot.Playing() && playlist.size() > 1 && !levelSlot.HasNextTrack()) {
+		levelSlot.QueueNextTrack(GetLevelMusic());
 	}
 
 	for (int i = 0; i < music_slots.size(); i++) {
@@ -165,6 +171,52 @@ void Music::Slot::Close()
 	Pause();
 	musicPlayer.reset();
 	decoder.reset();
+	next_decoder.reset();
+	next_is_queued = false;
+}
+
+//the player starts it right after the current track if the formats match; otherwise it waits for OpenNextTrack
+bool Music::Slot::QueueNextTrack(FileSpecifier* file)
+{
+	if (!file || !Playing() || next_decoder) return false;
+
+	next_decoder = StreamDecoder::Get(*file);
+	if (!next_decoder) return false;
+
+	next_music_file = *file;
+	next_is_queued = musicPlayer->QueueTrack(next_decoder);
+	return true;
+}
+
+//the player went on to the queued track by itself
+void Music::Slot::UpdateCurrentTrack()
+{
+	if (!musicPlayer || !next_is_queued || musicPlayer->GetTrackChanges() == track_changes_seen) return;
+
+	track_changes_seen = musicPlayer->GetTrackChanges();
+	decoder = next_decoder;
+	music_file = next_music_file;
+	next_decoder.reset();
+	next_is_queued = false;
+}
+
+//the track opened ahead came from a playlist that no longer applies
+void Music::Slot::ClearNextTrack()
+{
+	if (musicPlayer) musicPlayer->ClearQueuedTracks();
+	UpdateCurrentTrack(); //the player may have gone on to it before it was dropped
+	next_decoder.reset();
+	next_is_queued = false;
+}
+
+bool Music::Slot::OpenNextTrack()
+{
+	auto nextDecoder = next_decoder;
+	auto nextFile = next_music_file;
+	Close();
+	decoder = nextDecoder;
+	music_file = nextFile;
+	return decoder != nullptr;
 }
 
 bool Music::Slot::SetParameters(bool loop, float volume)
@@ -179,12 +231,17 @@ void Music::Slot::Play()
 {
 	if (!OpenALManager::Get() || Playing()) return;
 	musicPlayer = OpenALManager::Get()->PlayMusic(decoder, parameters);
+	track_changes_seen = 0;
 }
 
 bool Music::LoadLevelMusic()
 {
-	FileSpecifier* level_song_file = GetLevelMusic();
 	auto& slot = music_slots[MusicSlot::Level];
+
+	//a track opened ahead that could not be chained is still the next one to play
+	if (slot.HasNextTrack()) return slot.OpenNextTrack() && slot.SetParameters(playlist.size() == 1, 1);
+
+	FileSpecifier* level_song_file = GetLevelMusic();
 	return slot.Open(level_song_file) && slot.SetParameters(playlist.size() == 1, 1);
 }
 
@@ -220,6 +277,7 @@ void Music::ClearLevelMusic()
 {
 	playlist.clear(); 
 	marathon_1_song_index = NONE; 
+	music_slots[MusicSlot::Level].ClearNextTrack();
 	music_slots[MusicSlot::Level].SetParameters(true, 1);
 }
 
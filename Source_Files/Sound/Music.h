@@ -79,12 +79,21 @@ private:
 		float music_fade_start_volume;
 		bool music_fade_stop_no_volume;
 		MusicParameters parameters;
+		std::shared_ptr<StreamDecoder> next_decoder; //opened ahead of time so the player can chain it gaplessly
+		FileSpecifier next_music_file;
+		bool next_is_queued = false;
+		int track_changes_seen = 0;
 	public:
 		void Fade(float limitVolume, short duration, bool stopOnNoVolume = true);
 		bool Playing() const { return IsInit() && musicPlayer && musicPlayer->IsActive(); }
 		bool Open(FileSpecifier* file);
 		void Pause();
 		void Close();
+		bool QueueNextTrack(FileSpecifier* file);
+		bool HasNextTrack() const { return next_decoder != nullptr; }
+		void ClearNextTrack();
+		void UpdateCurrentTrack();
+		bool OpenNextTrack();
 		bool SetParameters(bool loop, float volume);
 		void Play();
 		float GetLimitFadeVolume() const { return music_fade_limit_volume; }
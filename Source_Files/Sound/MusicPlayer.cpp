@@ -1,18 +1,177 @@
 #include "MusicPlayer.h"
 #include "OpenALManager.h"
 
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* Decode-ahead: one worker thread keeps every playing music stream about
+   decode_ahead_seconds ahead of the mixer, so a slow codec frame or disk read
+   no longer stalls the audio callback. The decoded bytes go to the audio
+   thread through a per-player spsc queue. Decoders are only touched while
+   holding decode_mutex, which also covers a player sharing its decoder with
+   the one it replaces. The main thread never takes decode_mutex, so a slow
+   decode can't stall it. */
+static std::mutex decode_mutex;
+
+static std::mutex decode_ahead_mutex;
+static std::condition_variable decode_ahead_wakeup;
+static std::vector<std::weak_ptr<MusicPlayer>> decode_ahead_players; //guarded by decode_ahead_mutex
+static std::thread decode_ahead_thread;
+static bool decode_ahead_quit = false; //guarded by decode_ahead_mutex
+
+static constexpr auto decode_ahead_period = std::chrono::milliseconds(10);
+
+void MusicPlayer::DecodeAheadLoop() {
+	std::vector<std::shared_ptr<MusicPlayer>> players;
+	std::unique_lock<std::mutex> lock(decode_ahead_mutex);
+
+	while (!decode_ahead_quit) {
+
+		for (const auto& weakPlayer : decode_ahead_players) {
+			if (auto player = weakPlayer.lock()) players.push_back(player);
+		}
+
+		lock.unlock();
+
+		std::vector<MusicPlayer*> finished;
+		for (const auto& player : players) {
+			std::lock_guard<std::mutex> decodeLock(decode_mutex);
+			if (!player->DecodeAhead()) finished.push_back(player.get());
+		}
+
+		lock.lock();
+
+		auto done = [&finished](const std::weak_ptr<MusicPlayer>& weakPlayer) {
+			auto player = weakPlayer.lock();
+			return !player || std::find(finished.begin(), finished.end(), player.get()) != finished.end();
+		};
+		decode_ahead_players.erase(std::remove_if(decode_ahead_players.begin(), decode_ahead_players.end(), done), decode_ahead_players.end());
+
+		//dropping the last reference destroys the player, keep that outside both locks
+		lock.unlock();
+		players.clear();
+		lock.lock();
+
+		if (!decode_ahead_quit) decode_ahead_wakeup.wait_for(lock, decode_ahead_period);
+	}
+}
+
+//stops the worker at exit; declared after what it uses so it is destroyed first
+static struct DecodeAheadShutdown {
+	~DecodeAheadShutdown() {
+		if (!decode_ahead_thread.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(decode_ahead_mutex);
+			decode_ahead_quit = true;
+		}
+		decode_ahead_wakeup.notify_one();
+		decode_ahead_thread.join();
+	}
+} decode_ahead_shutdown;
+
 std::atomic<float> MusicPlayer::default_volume = { 1 };
-MusicPlayer::MusicPlayer(std::shared_ptr<StreamDecoder> decoder, MusicParameters parameters) : AudioPlayer(decoder->Rate(), decoder->IsStereo(), decoder->GetAudioFormat()) {
+MusicPlayer::MusicPlayer(std::shared_ptr<StreamDecoder> decoder, MusicParameters parameters) : AudioPlayer(decoder->Rate(), decoder->IsStereo(), decoder->GetAudioFormat()),
+	decoded_data(std::max(static_cast<int>(decoder->Rate() * decode_ahead_seconds) * decoder->BytesPerFrame(), num_buffers * buffer_samples)) {
 	this->decoder = decoder;
 	this->parameters = parameters;
-	this->decoder->Rewind();
+	loop = parameters.loop;
+	audio_format = decoder->GetAudioFormat();
+	stereo = decoder->IsStereo();
+	//the decoder may still be in use by the player we replace, the first decode rewinds it
+}
+
+void MusicPlayer::StartDecodeAhead(std::shared_ptr<MusicPlayer> player) {
+	std::lock_guard<std::mutex> lock(decode_ahead_mutex);
+	decode_ahead_players.push_back(player);
+	if (!decode_ahead_thread.joinable()) decode_ahead_thread = std::thread(DecodeAheadLoop);
+	decode_ahead_wakeup.notify_one();
+}
+
+//decode-ahead worker, holding decode_mutex; false once the player needs nothing more
+bool MusicPlayer::DecodeAhead() {
+	if (!is_active || stop_signal || end_of_stream) return false;
+
+	//drop what ClearQueuedTracks left behind, so it doesn't keep the queue full
+	while (next_tracks.read_available() && next_tracks.front().generation != track_state >> 32) next_tracks.pop();
+
+	std::array<uint8, decode_chunk_size> chunk;
+	while (decoded_data.write_available() >= chunk.size()) {
+		int size = Decode(chunk.data(), chunk.size());
+		if (size > 0) decoded_data.push(chunk.data(), size);
+		if (size < chunk.size()) {
+			end_of_stream = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//holding decode_mutex; loops, or goes on to the queued track, at the end of the current one
+int MusicPlayer::Decode(uint8* data, int length) {
+	int dataSize = 0;
+	bool restarted = false;
+
+	if (needs_rewind) {
+		decoder->Rewind();
+		needs_rewind = false;
+	}
+
+	while (true) {
+		int size = decoder->Decode(data + dataSize, length - dataSize);
+		dataSize += size;
+		if (dataSize == length) break;
+		if (restarted && size <= 0) break; //empty track, don't spin on it
+
+		QueuedTrack nextTrack;
+		bool switched = false;
+		while (!switched && next_tracks.pop(nextTrack)) {
+			//count the change, unless ClearQueuedTracks dropped the track in the meantime
+			uint64_t state = track_state;
+			while ((state >> 32) == nextTrack.generation && !track_state.compare_exchange_weak(state, state + 1)) {}
+			switched = (state >> 32) == nextTrack.generation;
+		}
+
+		if (switched) decoder = nextTrack.decoder;
+		else if (!loop) break;
+
+		decoder->Rewind();
+		restarted = true;
+	}
+
+	return dataSize;
 }
 
 int MusicPlayer::GetNextData(uint8* data, int length) {
-	int dataSize = decoder->Decode(data, length);
-	if (dataSize == length || !parameters.Get().loop) return dataSize;
-	decoder->Rewind();
-	return dataSize + GetNextData(data + dataSize, length - dataSize);
+	int dataSize = decoded_data.pop(data, length);
+	if (dataSize == length || end_of_stream) return dataSize;
+
+	//the worker fell behind; decode here rather than let the source run dry,
+	//if it's busy the player waits for it (see IsWaitingForData)
+	std::unique_lock<std::mutex> lock(decode_mutex, std::try_to_lock);
+	if (!lock) return dataSize;
+	dataSize += decoded_data.pop(data + dataSize, length - dataSize);
+	if (dataSize < length && !end_of_stream) {
+		int size = Decode(data + dataSize, length - dataSize);
+		if (size < length - dataSize) end_of_stream = true;
+		dataSize += size;
+	}
+	return dataSize;
+}
+
+bool MusicPlayer::QueueTrack(std::shared_ptr<StreamDecoder> nextDecoder) {
+	if (!nextDecoder || nextDecoder->Rate() != rate || nextDecoder->IsStereo() != stereo || nextDecoder->GetAudioFormat() != audio_format) return false;
+	if (end_of_stream) return false; //if it ends right after this, the caller still plays the track on its own
+	return next_tracks.push({ nextDecoder, static_cast<uint32_t>(track_state >> 32) }); //rewound when the player goes on to it
+}
+
+//only the worker pops the queue; tracks from an older generation are skipped and dropped there
+void MusicPlayer::ClearQueuedTracks() {
+	track_state += uint64_t(1) << 32;
 }
 
 SetupALResult MusicPlayer::SetUpALSourceIdle() {
@@ -8,23 +8,48 @@ struct MusicParameters {
 	bool loop = true;
 };
 
+//Music is decoded ahead of the mixer by a shared worker thread (see MusicPlayer.cpp)
 class MusicPlayer : public AudioPlayer {
 public:
 	MusicPlayer(std::shared_ptr<StreamDecoder> decoder, MusicParameters parameters); //Must not be used outside OpenALManager (public for make_shared)
 	static void SetDefaultVolume(float volume) { default_volume = volume; } //Since we can only change global music volume in settings, we don't have to care about AL sync here
 	static float GetDefaultVolume() { return default_volume; }
+	static void StartDecodeAhead(std::shared_ptr<MusicPlayer> player);
 	float GetPriority() const override { return 5; } //Doesn't really matter, just be above maximum volume (1) to be prioritized over sounds
-	void UpdateParameters(MusicParameters musicParameters) { parameters.Store(musicParameters); }
+	void UpdateParameters(MusicParameters musicParameters) { parameters.Store(musicParameters); loop = musicParameters.loop; }
 	MusicParameters GetParameters() const { return parameters.Get(); }
+	bool QueueTrack(std::shared_ptr<StreamDecoder> nextDecoder); //played right after the current one, false if it can't follow seamlessly
+	void ClearQueuedTracks(); //drops queued tracks the player has not gone on to yet
+	int GetTrackChanges() const { return static_cast<uint32_t>(track_state.load()); }
 private:
-	std::shared_ptr<StreamDecoder> decoder;
+	static constexpr float decode_ahead_seconds = 0.5f;
+	static constexpr int decode_chunk_size = buffer_samples;
+
+	struct QueuedTrack {
+		std::shared_ptr<StreamDecoder> decoder;
+		uint32_t generation; //of the queue when the track was added
+	};
+
+	std::shared_ptr<StreamDecoder> decoder; //only used while holding the decode lock
+	bool needs_rewind = true; //guarded by the decode lock
 	AtomicStructure<MusicParameters> parameters;
+	boost::lockfree::spsc_queue<uint8> decoded_data; //pipeline decode-ahead worker => audio thread
+	boost::lockfree::spsc_queue<QueuedTrack, boost::lockfree::capacity<2>> next_tracks; //pipeline main => decode-ahead worker
+	std::atomic_bool loop;
+	std::atomic_bool end_of_stream = { false };
+	std::atomic<uint64_t> track_state = { 0 }; //queue generation in the high half, track changes in the low half
+	AudioFormat audio_format;
+	bool stereo;
 	int GetNextData(uint8* data, int length) override;
+	int Decode(uint8* data, int length);
+	bool DecodeAhead();
+	static void DecodeAheadLoop();
 	SetupALResult SetUpALSourceIdle() override;
 	bool LoadParametersUpdates() override { return parameters.Update(); }
+	bool IsWaitingForData() const override { return !end_of_stream || decoded_data.read_available(); }
 	static std::atomic<float> default_volume;
 
 	friend class OpenALManager;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -54,11 +54,27 @@ void OpenALManager::ProcessAudioQueue() {
 		audio_players_queue.push_back(audioPlayer);
 	}
 
+	std::shared_ptr<SoundParametersBatch> batch;
+	while (sound_parameters_shared.pop(batch)) {
+		for (const auto& update : *batch) {
+			update.player->LoadBatchedParameters(update.parameters, update.rewind);
+		}
+	}
+
 	UpdateListener();
 	for (int i = 0; i < audio_players_queue.size(); i++) {
 
 		auto audio = audio_players_queue.front();
-		bool mustStillPlay = !audio->stop_signal && audio->AssignSource() && audio->Update() && audio->Play();
+		bool mustStillPlay = !audio->stop_signal && audio->AssignSource() && audio->Update();
+
+		if (mustStillPlay && profiling) {
+			auto start = std::chrono::steady_clock::now();
+			mustStillPlay = audio->Play();
+			render_profile.decode_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		}
+		else if (mustStillPlay) {
+			mustStillPlay = audio->Play();
+		}
 
 		audio_players_queue.pop_front();
 
@@ -140,9 +156,15 @@ std::shared_ptr<SoundPlayer> OpenALManager::PlaySound(const Sound& sound, const
 	return soundPlayer;
 }
 
+//false if the audio thread is too far behind to take the batch yet
+bool OpenALManager::UpdateSoundParameters(const std::shared_ptr<SoundParametersBatch>& batch) {
+	return sound_parameters_shared.push(batch);
+}
+
 std::shared_ptr<MusicPlayer> OpenALManager::PlayMusic(std::shared_ptr<StreamDecoder> decoder, MusicParameters parameters) {
 	if (!process_audio_active) return std::shared_ptr<MusicPlayer>();
 	auto musicPlayer = std::make_shared<MusicPlayer>(decoder, parameters);
+	MusicPlayer::StartDecodeAhead(musicPlayer);
 	audio_players_shared.push(musicPlayer);
 	return musicPlayer;
 }
@@ -203,8 +225,20 @@ void OpenALManager::RetrieveSource(const std::shared_ptr<AudioPlayer>& player) {
 //not output the audio once it has mixed it but instead, makes 
 //the mixed data available with alcRenderSamplesSOFT
 void OpenALManager::GetPlayBackAudio(uint8* data, int length) {
+	if (!profiling) {
+		ProcessAudioQueue();
+		alcRenderSamplesSOFT(p_ALCDevice, data, length);
+		return;
+	}
+
+	render_profile = {};
 	ProcessAudioQueue();
+
+	auto start = std::chrono::steady_clock::now();
 	alcRenderSamplesSOFT(p_ALCDevice, data, length);
+	render_profile.mix_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	render_profile.active_sources = std::count_if(audio_players_queue.begin(), audio_players_queue.end(),
+		[](const std::shared_ptr<AudioPlayer>& player) { return player->audio_source != nullptr; });
 }
 
 //This return true if the device supports switching from hrtf enabled <-> hrtf disabled
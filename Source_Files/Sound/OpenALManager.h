@@ -4,6 +4,7 @@
 #include "MusicPlayer.h"
 #include "SoundPlayer.h"
 #include "StreamPlayer.h"
+#include <chrono>
 #include <queue>
 
 #if defined (_MSC_VER) && !defined (M_PI)
@@ -47,6 +48,13 @@ struct AudioParameters {
 
 class OpenALManager {
 public:
+	//timings of the last GetPlayBackAudio call, filled in only while profiling
+	struct RenderProfile {
+		double mix_seconds; //alcRenderSamplesSOFT
+		double decode_seconds; //players fetching and decoding their data
+		int active_sources; //players holding a source after the call
+	};
+
 	static OpenALManager* Get() { return instance; }
 	static bool Init(const AudioParameters& parameters);
 	static void Shutdown();
@@ -55,6 +63,7 @@ public:
 	void StopAllPlayers();
 	std::shared_ptr<SoundPlayer> PlaySound(const Sound& sound, const SoundParameters& parameters);
 	std::shared_ptr<MusicPlayer> PlayMusic(std::shared_ptr<StreamDecoder> decoder, MusicParameters parameters);
+	bool UpdateSoundParameters(const std::shared_ptr<SoundParametersBatch>& batch);
 	std::shared_ptr<StreamPlayer> PlayStream(CallBackStreamPlayer callback, int rate, bool stereo, AudioFormat audioFormat, float initialGain = 1.0f, bool shouldRoutinelyStop = true);
 	std::unique_ptr<AudioPlayer::AudioSource> PickAvailableSource(const AudioPlayer& audioPlayer);
 	void UpdateListener(world_location3d listener) { listener_location.Set(listener); }
@@ -63,7 +72,10 @@ public:
 	float GetMasterVolume() const { return master_volume.load(); }
 	void ToggleDeviceMode(bool recording_device);
 	int GetFrequency() const { return audio_parameters.rate; }
+	int GetChannelCount() const { return static_cast<int>(audio_parameters.channel_type); }
 	void GetPlayBackAudio(uint8* data, int length);
+	void SetProfiling(bool profile) { profiling = profile; render_profile = {}; }
+	const RenderProfile& GetRenderProfile() const { return render_profile; }
 	bool Support_HRTF_Toggling() const;
 	bool Is_HRTF_Enabled() const;
 	bool IsBalanceRewindSound() const { return audio_parameters.balance_rewind; }
@@ -88,9 +100,12 @@ private:
 	void ProcessAudioQueue();
 	void ResyncPlayers();
 	bool is_using_recording_device = false;
+	bool profiling = false;
+	RenderProfile render_profile = {};
 	std::queue<std::unique_ptr<AudioPlayer::AudioSource>> sources_pool;
 	std::deque<std::shared_ptr<AudioPlayer>> audio_players_queue; //for audio thread only
 	boost::lockfree::spsc_queue<std::shared_ptr<AudioPlayer>, boost::lockfree::capacity<256>> audio_players_shared; //pipeline main => audio thread
+	boost::lockfree::spsc_queue<std::shared_ptr<SoundParametersBatch>, boost::lockfree::capacity<16>> sound_parameters_shared; //pipeline main => audio thread
 	int GetBestOpenALSupportedFormat();
 	void RetrieveSource(const std::shared_ptr<AudioPlayer>& player);
 
@@ -492,7 +492,7 @@ void SoundManager::ManagePlayers() {
 				updateParameters = updateParameters || stereo_parameters != parameters.stereo_parameters;
 			}
 
-			if (updateParameters) soundPlayer->UpdateParameters(parameters);
+			if (updateParameters) QueueParameterUpdate(soundPlayer, parameters);
 		}
 	}
 }
@@ -506,18 +506,48 @@ void SoundManager::UpdateListener() {
 void SoundManager::Idle()
 {
 	UpdateListener();
-	CauseAmbientSoundSourceUpdate();
+	if (active && parameters.volume_db > MINIMUM_VOLUME_DB && (parameters.flags & _ambient_sound_flag))
+	{
+		UpdateAmbientSoundSources();
+	}
 	ManagePlayers();
+	SubmitParameterUpdates();
 }
 
 void SoundManager::CauseAmbientSoundSourceUpdate()
 {
 	if (active && parameters.volume_db > MINIMUM_VOLUME_DB && (parameters.flags & _ambient_sound_flag))
 	{
-		UpdateAmbientSoundSources();
+		UpdateAmbientSoundSources(); //submitted with the rest of the next idle pass
 	}
 }
 
+void SoundManager::QueueParameterUpdate(const std::shared_ptr<SoundPlayer>& player, const SoundParameters& parameters, bool rewind)
+{
+	for (auto& update : pending_parameter_updates)
+	{
+		if (update.player == player)
+		{
+			update.parameters = parameters;
+			update.rewind = update.rewind || rewind;
+			return;
+		}
+	}
+
+	pending_parameter_updates.push_back({ player, parameters, rewind });
+}
+
+//hand everything gathered since the last pass to the audio thread in one go;
+//if it can't take it yet, keep merging into the same batch
+void SoundManager::SubmitParameterUpdates()
+{
+	if (pending_parameter_updates.empty()) return;
+
+	auto manager = OpenALManager::Get();
+	if (!manager || manager->UpdateSoundParameters(std::make_shared<SoundParametersBatch>(pending_parameter_updates)))
+		pending_parameter_updates.clear();
+}
+
 struct ambient_sound_data
 {
 	uint16 flags;
@@ -1065,8 +1095,7 @@ void SoundManager::UpdateAmbientSoundSources()
 			parameters.stereo_parameters.gain_right = ambient_sounds[i].variables.right_volume * 1.f / MAXIMUM_SOUND_VOLUME;
 
 			if (stereo_parameters != parameters.stereo_parameters) {
-				soundPlayer->UpdateParameters(parameters);
-				soundPlayer->UpdateRewindParameters(parameters);
+				QueueParameterUpdate(soundPlayer, parameters, true);
 			}
 		}
 		else if (LoadSound(ambient_sounds[i].sound_index)) {
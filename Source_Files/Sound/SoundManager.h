@@ -28,6 +28,7 @@
 #include "world.h"
 #include "SoundPlayer.h"
 #include <set>
+#include <vector>
 
 struct ambient_sound_data;
 
@@ -135,6 +136,11 @@ private:
 	uint16 GetSoundObstructionFlags(short sound_index, world_location3d* source);
 	void UpdateAmbientSoundSources();
 	void ManagePlayers();
+
+	// parameter changes are merged per player and reach the audio thread as one batch per idle pass
+	SoundParametersBatch pending_parameter_updates;
+	void QueueParameterUpdate(const std::shared_ptr<SoundPlayer>& player, const SoundParameters& parameters, bool rewind = false);
+	void SubmitParameterUpdates();
 	std::set<std::shared_ptr<SoundPlayer>> sound_players;
 	std::set<std::shared_ptr<SoundPlayer>> ambient_sound_players;
 	bool initialized;
@@ -127,6 +127,12 @@ bool SoundPlayer::LoadParametersUpdates() {
 
 	if (softStop && sound_transition.allow_transition) return true;
 
+	if (has_batched_parameters) {
+		bestParameters = batched_parameters;
+		lastPriority = Simulate(batched_parameters);
+		has_batched_parameters = false;
+	}
+
 	while (parameters.Consume(soundParameters)) {
 
 		float priority = Simulate(soundParameters);
@@ -139,6 +145,12 @@ bool SoundPlayer::LoadParametersUpdates() {
 
 	if (lastPriority > 0) parameters.Set(bestParameters);
 
+	if (has_batched_rewind_parameters) {
+		bestRewindParameters = batched_rewind_parameters;
+		rewindLastPriority = Simulate(batched_rewind_parameters);
+		has_batched_rewind_parameters = false;
+	}
+
 	while (rewind_parameters.Consume(soundParameters)) {
 
 		float priority = Simulate(soundParameters);
@@ -155,6 +167,17 @@ bool SoundPlayer::LoadParametersUpdates() {
 	return lastPriority > 0 || rewindLastPriority > 0 || softStop;
 }
 
+//the latest batched change wins, it is weighed against the queued ones on the next update
+void SoundPlayer::LoadBatchedParameters(const SoundParameters& soundParameters, bool rewind) {
+	batched_parameters = soundParameters;
+	has_batched_parameters = true;
+
+	if (rewind) {
+		batched_rewind_parameters = soundParameters;
+		has_batched_rewind_parameters = true;
+	}
+}
+
 //This is called everytime we process a player in the queue with this source
 SetupALResult SoundPlayer::SetUpALSourceIdle() {
 
@@ -89,12 +89,15 @@ private:
 	SetupALResult SetUpALSource3D();
 	bool SetUpALSourceInit() override;
 	bool LoadParametersUpdates() override;
+	void LoadBatchedParameters(const SoundParameters& parameters, bool rewind);
 	float ComputeParameterForTransition(float targetParameter, float currentParameter, int currentTick) const;
 	float ComputeVolumeForTransition(float targetVolume);
 	SoundBehavior ComputeVolumeForTransition(const SoundBehavior& targetSoundBehavior);
 	AtomicStructure<Sound> sound;
 	AtomicStructure<SoundParameters> parameters;
 	AtomicStructure<SoundParameters> rewind_parameters;
+	SoundParameters batched_parameters, batched_rewind_parameters; //for audio thread only, from OpenALManager's parameter batches
+	bool has_batched_parameters = false, has_batched_rewind_parameters = false;
 	SoundTransition sound_transition;
 	uint32_t data_length;
 	uint32_t current_index_data;
@@ -128,4 +131,13 @@ private:
 	friend class OpenALManager;
 };
 
+//a player's parameter change, handed to the audio thread along with the rest of its pass
+struct SoundParametersUpdate {
+	std::shared_ptr<SoundPlayer> player;
+	SoundParameters parameters;
+	bool rewind;
+};
+
+typedef std::vector<SoundParametersUpdate> SoundParametersBatch;
+
 #endif
\ No newline at end of file
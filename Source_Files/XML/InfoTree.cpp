@@ -111,6 +111,100 @@ void InfoTree::save_ini(std::ostringstream& stream) const
 	pt::write_ini<pt::iptree>(stream, *this);
 }
 
+static void write_binary_length(std::ostream& stream, uint32 length)
+{
+	char bytes[4] = { char(length), char(length >> 8), char(length >> 16), char(length >> 24) };
+	stream.write(bytes, 4);
+}
+
+static void write_binary_string(std::ostream& stream, const std::string& str)
+{
+	write_binary_length(stream, static_cast<uint32>(str.size()));
+	stream.write(str.data(), str.size());
+}
+
+// each node is its data, a child count, then (key, node) for every child
+static void write_binary_node(std::ostream& stream, const pt::iptree& node)
+{
+	write_binary_string(stream, node.data());
+	write_binary_length(stream, static_cast<uint32>(node.size()));
+	for (const auto& child : node)
+	{
+		write_binary_string(stream, child.first);
+		write_binary_node(stream, child.second);
+	}
+}
+
+// Binary trees are read back from a cache that may be damaged, so every
+// length is checked against what is left of the stream before anything is
+// allocated for it.
+struct BinaryTreeReader
+{
+	std::istream& stream;
+	std::streamoff remaining;
+	
+	uint32 read_length()
+	{
+		unsigned char bytes[4];
+		if (remaining < 4 || !stream.read(reinterpret_cast<char *>(bytes), 4))
+			throw InfoTree::unexpected_error("truncated binary tree");
+		remaining -= 4;
+		return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (uint32(bytes[3]) << 24);
+	}
+	
+	std::string read_string()
+	{
+		uint32 length = read_length();
+		if (length > remaining)
+			throw InfoTree::unexpected_error("truncated binary tree");
+		std::string str(length, '\0');
+		if (length && !stream.read(&str[0], length))
+			throw InfoTree::unexpected_error("truncated binary tree");
+		remaining -= length;
+		return str;
+	}
+	
+	void read_node(pt::iptree& node, int depth)
+	{
+		if (depth > max_depth)
+			throw InfoTree::unexpected_error("binary tree too deep");
+		
+		node.data() = read_string();
+		uint32 count = read_length();
+		if (count > remaining / smallest_child)
+			throw InfoTree::unexpected_error("truncated binary tree");
+		for (uint32 i = 0; i < count; ++i)
+		{
+			std::string key = read_string();
+			read_node(node.push_back(std::make_pair(key, pt::iptree()))->second, depth + 1);
+		}
+	}
+	
+	// key length, data length and child count
+	static const int smallest_child = 12;
+	static const int max_depth = 256;
+};
+
+InfoTree InfoTree::load_binary(std::istream& stream)
+{
+	std::streamoff start = stream.tellg();
+	stream.seekg(0, std::ios::end);
+	std::streamoff end = stream.tellg();
+	stream.seekg(start);
+	if (start < 0 || end < start)
+		throw InfoTree::unexpected_error("unreadable binary tree");
+	
+	BinaryTreeReader reader { stream, end - start };
+	InfoTree btree;
+	reader.read_node(btree, 0);
+	return btree;
+}
+
+void InfoTree::save_binary(std::ostream& stream) const
+{
+	write_binary_node(stream, *this);
+}
+
 bool InfoTree::read_fixed(std::string path, _fixed& value, float min, float max) const
 {
 	float temp;
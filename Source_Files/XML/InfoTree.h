@@ -58,6 +58,10 @@ public:
 	static InfoTree load_ini(std::istringstream& stream);
 	void save_ini(FileSpecifier filename) const;
 	void save_ini(std::ostringstream& stream) const;
+	
+	// compact form for caching already-parsed trees; not for interchange
+	static InfoTree load_binary(std::istream& stream);
+	void save_binary(std::ostream& stream) const;
 
 	template<typename T> bool read(std::string path, T& value) const
 	{
@@ -24,9 +24,12 @@
 #include "Plugins.h"
 
 #include <algorithm>
+#include <sstream>
+#include <unordered_map>
 
 #include "alephversion.h"
 #include "FileHandler.h"
+#include "find_files.h"
 #include "game_errors.h"
 #include "Logging.h"
 #include "preferences.h"
@@ -38,15 +41,57 @@
 
 namespace algo = boost::algorithm;
 
+// Directories are walked first; the manifests found are then parsed on
+// worker threads, and added in the order they were found
 class PluginLoader {
 public:
 	PluginLoader() { }
 	~PluginLoader() { }
 	
-	bool ParsePlugin(FileSpecifier& file);
 	bool ParseDirectory(FileSpecifier& dir);
+	void LoadPlugins();
+
+private:
+	struct Manifest {
+		FileSpecifier file;
+		TimeType date;	// 0 inside zip files, which are never cached
+		uintmax_t size;
+	};
+	
+	struct CachedManifest {
+		TimeType date;
+		uintmax_t size;
+		std::string tree;	// InfoTree::save_binary() form of <plugin>
+	};
+	
+	struct ParsedPlugin {
+		Plugin data;
+		bool valid = false;
+		std::string error;
+		bool cache = false;
+		std::string tree;
+	};
+	
+	static void ParsePlugin(Manifest& manifest, const CachedManifest* cached, ParsedPlugin& result);
+	static void BuildPlugin(const InfoTree& root, const DirectorySpecifier& directory, ParsedPlugin& result);
+	
+	static FileSpecifier cache_file();
+	static void read_cache();
+	static void save_cache();
+	
+	std::vector<Manifest> m_manifests;
+	
+	// keyed by path; a manifest whose date or size has changed is parsed again
+	static std::unordered_map<std::string, CachedManifest> m_cache;
+	static bool m_cache_loaded;
+	
+	static const uint32 k_cache_magic = FOUR_CHARS_TO_INT('p', 'l', 'g', 'c');
+	static const uint32 k_cache_version = 1;
 };
 
+std::unordered_map<std::string, PluginLoader::CachedManifest> PluginLoader::m_cache;
+bool PluginLoader::m_cache_loaded = false;
+
 bool Plugin::compatible() const {
 	if (required_version.size() > 0 && A1_DATE_VERSION < required_version)
 		return false;
@@ -283,147 +328,331 @@ static int utf8_to_int(const std::string& s)
 	}
 }
 
-bool PluginLoader::ParsePlugin(FileSpecifier& file_name)
+// Reads and parses a manifest that was not in the cache; false if it could
+// not be read at all
+static bool load_manifest(FileSpecifier& file_name, InfoTree& root)
 {
 	OpenedFile file;
-	if (file_name.Open(file)) 
-	{
-		int32 data_size;
-		file.GetLength(data_size);
-		std::vector<char> file_data;
-		file_data.resize(data_size);
+	int32 data_size;
+	if (!file_name.Open(file) || !file.GetLength(data_size))
+		return false;
+	
+	std::vector<char> file_data(data_size);
+	if (data_size && !file.Read(data_size, &file_data[0]))
+		return false;
+	
+	std::istringstream strm(std::string(file_data.begin(), file_data.end()));
+	root = InfoTree::load_xml(strm).get_child("plugin");
+	return true;
+}
 
-		if (file.Read(data_size, &file_data[0]))
-		{
-			DirectorySpecifier current_plugin_directory;
-			file_name.ToDirectory(current_plugin_directory);
+// Runs on a worker thread: errors are handed back rather than logged, and the
+// cache is only read here
+void PluginLoader::ParsePlugin(Manifest& manifest, const CachedManifest* cached, ParsedPlugin& result)
+{
+	DirectorySpecifier current_plugin_directory;
+	manifest.file.ToDirectory(current_plugin_directory);
 
-			char name[256];
-			current_plugin_directory.GetName(name);
-			
-			std::istringstream strm(std::string(file_data.begin(), file_data.end()));
+	char name[256];
+	current_plugin_directory.GetName(name);
+	
+	try {
+		InfoTree root;
+		bool from_cache = false;
+		if (cached)
+		{
 			try {
-				InfoTree root = InfoTree::load_xml(strm).get_child("plugin");
-				
-				Plugin Data = Plugin();
-				Data.directory = current_plugin_directory;
-				Data.enabled = true;
-				
-				root.read_attr("name", Data.name);
-				root.read_attr("version", Data.version);
-				root.read_attr("description", Data.description);
-				root.read_attr("minimum_version", Data.required_version);
-				
-				if (root.read_attr("hud_lua", Data.hud_lua) &&
-					!plugin_file_exists(Data, Data.hud_lua))
-					Data.hud_lua = "";
-				
-				if (root.read_attr("solo_lua", Data.solo_lua) &&
-					!plugin_file_exists(Data, Data.solo_lua))
-					Data.solo_lua = "";
-				
-				if (root.read_attr("stats_lua", Data.stats_lua) &&
-					!plugin_file_exists(Data, Data.stats_lua))
-					Data.stats_lua = "";
-				
-				if (root.read_attr("theme_dir", Data.theme) &&
-					!plugin_file_exists(Data, Data.theme + "/theme2.mml"))
-					Data.theme = "";
-				
-				for (const InfoTree &tree : root.children_named("mml"))
-				{
-					std::string mml_path;
-					if (tree.read_attr("file", mml_path) &&
-						plugin_file_exists(Data, mml_path))
-						Data.mmls.push_back(mml_path);
-				}
+				std::istringstream strm(cached->tree);
+				root = InfoTree::load_binary(strm);
+				from_cache = true;
+			} catch (const std::exception&) {
+				// a damaged entry is parsed again from the XML below
+			}
+		}
+		
+		if (!from_cache)
+		{
+			if (!load_manifest(manifest.file, root))
+				return;
+			
+			// manifests inside zip files have no date to check against
+			if (manifest.date)
+			{
+				std::ostringstream strm;
+				root.save_binary(strm);
+				result.tree = strm.str();
+				result.cache = true;
+			}
+		}
+		
+		BuildPlugin(root, current_plugin_directory, result);
+		
+	} catch (const InfoTree::parse_error& e) {
+		result.error = std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what();
+	} catch (const InfoTree::path_error& e) {
+		result.error = std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what();
+	} catch (const InfoTree::data_error& e) {
+		result.error = std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what();
+	} catch (const InfoTree::unexpected_error& e) {
+		result.error = std::string("There were parsing errors in ") + name + " Plugin.xml: " + e.what();
+	}
+}
 
-				for (const InfoTree &tree : root.children_named("shapes_patch"))
-				{
-					ShapesPatch patch;
-					tree.read_attr("file", patch.path);
-					tree.read_attr("requires_opengl", patch.requires_opengl);
-					if (plugin_file_exists(Data, patch.path))
-						Data.shapes_patches.push_back(patch);
-				}
+void PluginLoader::BuildPlugin(const InfoTree& root, const DirectorySpecifier& directory, ParsedPlugin& result)
+{
+	Plugin Data = Plugin();
+	Data.directory = directory;
+	Data.enabled = true;
+	
+	root.read_attr("name", Data.name);
+	root.read_attr("version", Data.version);
+	root.read_attr("description", Data.description);
+	root.read_attr("minimum_version", Data.required_version);
+	
+	if (root.read_attr("hud_lua", Data.hud_lua) &&
+		!plugin_file_exists(Data, Data.hud_lua))
+		Data.hud_lua = "";
+	
+	if (root.read_attr("solo_lua", Data.solo_lua) &&
+		!plugin_file_exists(Data, Data.solo_lua))
+		Data.solo_lua = "";
+	
+	if (root.read_attr("stats_lua", Data.stats_lua) &&
+		!plugin_file_exists(Data, Data.stats_lua))
+		Data.stats_lua = "";
+	
+	if (root.read_attr("theme_dir", Data.theme) &&
+		!plugin_file_exists(Data, Data.theme + "/theme2.mml"))
+		Data.theme = "";
+	
+	for (const InfoTree &tree : root.children_named("mml"))
+	{
+		std::string mml_path;
+		if (tree.read_attr("file", mml_path) &&
+			plugin_file_exists(Data, mml_path))
+			Data.mmls.push_back(mml_path);
+	}
 
-				for (const InfoTree &tree : root.children_named("scenario"))
-				{
-					ScenarioInfo info;
-					tree.read_attr("name", info.name);
-					if (info.name.size() > 31)
-						info.name.erase(31);
-					
-					tree.read_attr("id", info.scenario_id);
-					if (info.scenario_id.size() > 23)
-						info.scenario_id.erase(23);
-					
-					tree.read_attr("version", info.version);
-					if (info.version.size() > 7)
-						info.version.erase(7);
-					
-					if (info.name.size() || info.scenario_id.size())
-						Data.required_scenarios.push_back(info);
-				}
+	for (const InfoTree &tree : root.children_named("shapes_patch"))
+	{
+		ShapesPatch patch;
+		tree.read_attr("file", patch.path);
+		tree.read_attr("requires_opengl", patch.requires_opengl);
+		if (plugin_file_exists(Data, patch.path))
+			Data.shapes_patches.push_back(patch);
+	}
 
-				for (const InfoTree& tree : root.children_named("map_patch"))
-				{
-					MapPatch patch;
-					for (const InfoTree& cs_tree : tree.children_named("checksum"))
-					{
-						auto cs = cs_tree.get_value(static_cast<uint32_t>(0));
-						patch.parent_checksums.insert(cs);
-					}
+	for (const InfoTree &tree : root.children_named("scenario"))
+	{
+		ScenarioInfo info;
+		tree.read_attr("name", info.name);
+		if (info.name.size() > 31)
+			info.name.erase(31);
+		
+		tree.read_attr("id", info.scenario_id);
+		if (info.scenario_id.size() > 23)
+			info.scenario_id.erase(23);
+		
+		tree.read_attr("version", info.version);
+		if (info.version.size() > 7)
+			info.version.erase(7);
+		
+		if (info.name.size() || info.scenario_id.size())
+			Data.required_scenarios.push_back(info);
+	}
 
-					for (const InfoTree& rsrc_tree : tree.children_named("resource"))
-					{
-						std::string path;
-						int id;
-						std::string type;
-						
-						rsrc_tree.read_attr("type", type);
-						rsrc_tree.read_attr("id", id);
-						rsrc_tree.read_attr("data", path);
+	for (const InfoTree& tree : root.children_named("map_patch"))
+	{
+		MapPatch patch;
+		for (const InfoTree& cs_tree : tree.children_named("checksum"))
+		{
+			auto cs = cs_tree.get_value(static_cast<uint32_t>(0));
+			patch.parent_checksums.insert(cs);
+		}
 
-						auto key = std::make_pair(utf8_to_int(type), id);
-						if (key.first)
-						{
-							patch.resource_map.insert(std::make_pair(key, path));
-						}
-					}
+		for (const InfoTree& rsrc_tree : tree.children_named("resource"))
+		{
+			std::string path;
+			int id;
+			std::string type;
+			
+			rsrc_tree.read_attr("type", type);
+			rsrc_tree.read_attr("id", id);
+			rsrc_tree.read_attr("data", path);
 
-					if (patch.parent_checksums.size() &&
-						patch.resource_map.size())
-					{
-						Data.map_patches.push_back(patch);
-					}
-				}
-				
-				if (Data.name.length()) {
-					std::sort(Data.mmls.begin(), Data.mmls.end());
-					if (Data.theme.size()) {
-						Data.hud_lua = "";
-						Data.solo_lua = "";
-						Data.shapes_patches.clear();
-						Data.map_patches.clear();
-					}
-					Plugins::instance()->add(Data);
-				}
-				
-			} catch (const InfoTree::parse_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
-			} catch (const InfoTree::path_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
-			} catch (const InfoTree::data_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
-			} catch (const InfoTree::unexpected_error& e) {
-				logError("There were parsing errors in %s Plugin.xml: %s", name, e.what());
+			auto key = std::make_pair(utf8_to_int(type), id);
+			if (key.first)
+			{
+				patch.resource_map.insert(std::make_pair(key, path));
 			}
 		}
 
-		return true;
+		if (patch.parent_checksums.size() &&
+			patch.resource_map.size())
+		{
+			Data.map_patches.push_back(patch);
+		}
 	}
-	return false;
+	
+	if (Data.name.length()) {
+		std::sort(Data.mmls.begin(), Data.mmls.end());
+		if (Data.theme.size()) {
+			Data.hud_lua = "";
+			Data.solo_lua = "";
+			Data.shapes_patches.clear();
+			Data.map_patches.clear();
+		}
+		result.data = Data;
+		result.valid = true;
+	}
+}
+
+FileSpecifier PluginLoader::cache_file()
+{
+	FileSpecifier file;
+	file.SetToLocalDataDir();
+	file.AddPart("Plugin Cache");
+	return file;
+}
+
+// Same layout and checks as the MML cache: read whole, every size checked
+// against what is left, and anything unreadable just means a cold start
+void PluginLoader::read_cache()
+{
+	m_cache_loaded = true;
+	
+	FileSpecifier file = cache_file();
+	OpenedFile ofile;
+	int32 length;
+	if (!file.Exists() || !file.Open(ofile) || !ofile.GetLength(length))
+		return;
+	
+	try {
+		std::string data(length, '\0');
+		if (length == 0 || !ofile.Read(length, &data[0]))
+			return;
+		ofile.Close();
+		
+		const char *p = data.data();
+		size_t remaining = data.size();
+		auto take = [&p, &remaining](void *dest, size_t size) {
+			if (size > remaining)
+				return false;
+			memcpy(dest, p, size);
+			p += size;
+			remaining -= size;
+			return true;
+		};
+		
+		uint32 header[2];
+		if (!take(header, sizeof(header)) || header[0] != k_cache_magic || header[1] != k_cache_version)
+			return;
+		
+		int64_t date;
+		uint64 size;
+		uint32 sizes[2];
+		while (take(&date, sizeof(date)) && take(&size, sizeof(size)) && take(sizes, sizeof(sizes)))
+		{
+			if (sizes[0] > remaining || sizes[1] > remaining - sizes[0])
+				break;
+			
+			CachedManifest entry;
+			entry.date = static_cast<TimeType>(date);
+			entry.size = size;
+			entry.tree.assign(p + sizes[0], sizes[1]);
+			m_cache[std::string(p, sizes[0])] = std::move(entry);
+			p += sizes[0] + sizes[1];
+			remaining -= sizes[0] + sizes[1];
+		}
+	} catch (const std::exception& e) {
+		logWarning("Ignoring unreadable plugin cache %s: %s", file.GetPath(), e.what());
+		m_cache.clear();
+	}
+}
+
+// Machine-local, so stored in native byte order
+void PluginLoader::save_cache()
+{
+	std::ostringstream strm;
+	uint32 header[2] = { k_cache_magic, k_cache_version };
+	strm.write(reinterpret_cast<const char *>(header), sizeof(header));
+	
+	for (const auto& it : m_cache)
+	{
+		int64_t date = it.second.date;
+		uint64 size = it.second.size;
+		uint32 sizes[2] = { static_cast<uint32>(it.first.size()), static_cast<uint32>(it.second.tree.size()) };
+		strm.write(reinterpret_cast<const char *>(&date), sizeof(date));
+		strm.write(reinterpret_cast<const char *>(&size), sizeof(size));
+		strm.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+		strm.write(it.first.data(), sizes[0]);
+		strm.write(it.second.tree.data(), sizes[1]);
+	}
+	
+	std::string data = strm.str();
+	FileSpecifier file = cache_file();
+	OpenedFile ofile;
+	bool saved = false;
+	if (file.Open(ofile, true) || (file.Create(_typecode_unknown) && file.Open(ofile, true)))
+	{
+		saved = ofile.Write(static_cast<int32>(data.size()), &data[0]) && ofile.SetLength(static_cast<int32>(data.size()));
+		ofile.Close();
+	}
+	
+	if (!saved)
+		logWarning("Could not save plugin cache to %s", file.GetPath());
+}
+
+void PluginLoader::LoadPlugins()
+{
+	if (!m_cache_loaded)
+		read_cache();
+	
+	// looked up here, so the workers never touch the map
+	std::vector<const CachedManifest*> cached(m_manifests.size(), nullptr);
+	for (size_t i = 0; i < m_manifests.size(); ++i)
+	{
+		const Manifest& manifest = m_manifests[i];
+		auto it = m_cache.find(manifest.file.GetPath());
+		if (manifest.date && it != m_cache.end() &&
+			it->second.date == manifest.date && it->second.size == manifest.size)
+			cached[i] = &it->second;
+	}
+	
+	std::vector<ParsedPlugin> results(m_manifests.size());
+	parallel_scan(m_manifests.size(), [&](size_t i) {
+		ParsePlugin(m_manifests[i], cached[i], results[i]);
+	});
+	
+	// manifests that have gone away drop out of the cache here
+	std::unordered_map<std::string, CachedManifest> cache;
+	bool dirty = false;
+	for (size_t i = 0; i < m_manifests.size(); ++i)
+	{
+		const ParsedPlugin& result = results[i];
+		if (result.error.size())
+			logError("%s", result.error.c_str());
+		else if (result.valid)
+			Plugins::instance()->add(result.data);
+		
+		const Manifest& manifest = m_manifests[i];
+		if (result.cache)
+		{
+			cache[manifest.file.GetPath()] = { manifest.date, manifest.size, result.tree };
+			dirty = true;
+		}
+		else if (cached[i])
+		{
+			cache[manifest.file.GetPath()] = *cached[i];
+		}
+	}
+	
+	dirty = dirty || cache.size() != m_cache.size();
+	m_cache.swap(cache);
+	if (dirty)
+		save_cache();
+	
+	m_manifests.clear();
 }
 
 bool PluginLoader::ParseDirectory(FileSpecifier& dir) 
@@ -436,7 +665,7 @@ bool PluginLoader::ParseDirectory(FileSpecifier& dir)
 		FileSpecifier file = dir + it->name;
 		if (it->name == "Plugin.xml")
 		{
-			ParsePlugin(file);
+			m_manifests.push_back({ file, it->date, file.GetSize() });
 		}
 		else if (it->is_directory && it->name[0] != '.') 
 		{
@@ -451,7 +680,7 @@ bool PluginLoader::ParseDirectory(FileSpecifier& dir)
 				{
 					std::string archive = file.GetPath();
 					FileSpecifier file_name = FileSpecifier(archive.substr(0, archive.find_last_of('.'))) + zip_entry;
-					ParsePlugin(file_name);
+					m_manifests.push_back({ file_name, 0, 0 });
 				}
 			}
 		}
@@ -471,6 +700,7 @@ void Plugins::enumerate() {
 		DirectorySpecifier path = *it + "Plugins";
 		loader.ParseDirectory(path);
 	}
+	loader.LoadPlugins();
 	std::sort(m_plugins.begin(), m_plugins.end());
 	clear_game_error();
 	m_validated = false;
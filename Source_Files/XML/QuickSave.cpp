@@ -24,7 +24,9 @@
 #include "QuickSave.h"
 
 #include <fstream>
+#include <queue>
 #include <sstream>
+#include <unordered_map>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -36,6 +38,7 @@
 #endif
 
 #include "FileHandler.h"
+#include "find_files.h"
 #include "world.h"
 #include "map.h"
 #include "wad.h"
@@ -56,6 +59,9 @@
 #include "WadImageCache.h"
 #include "InfoTree.h"
 
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+
 namespace algo = boost::algorithm;
 
 const int RENDER_WIDTH = 1280;
@@ -68,13 +74,69 @@ const int PREVIEW_HEIGHT = 72;
 void create_updated_save(QuickSave& save);
 
 
+// Metadata is read only from saves that are new or changed since the last
+// scan, on worker threads; the rest comes from the cache
 class QuickSaveLoader {
 public:
     QuickSaveLoader() { }
     ~QuickSaveLoader() { }
     
     bool ParseDirectory(FileSpecifier& dir);
-    bool ParseQuickSave(FileSpecifier& file);
+
+private:
+    struct CachedQuickSave {
+        TimeType date;
+        uintmax_t size;
+        bool valid;
+        QuickSave save;
+    };
+    
+    static bool ParseQuickSave(FileSpecifier& file, QuickSave& save);
+    
+    // keyed by path
+    static std::unordered_map<std::string, CachedQuickSave> m_cache;
+};
+
+std::unordered_map<std::string, QuickSaveLoader::CachedQuickSave> QuickSaveLoader::m_cache;
+
+// Finishes quick saves off the game thread: the game state and preview are
+// captured synchronously, then PNG encoding and the file write (to a temp
+// file that is renamed into place) happen here
+class QuickSaveWriter {
+public:
+    static QuickSaveWriter* instance();
+    
+    // takes ownership of wad and preview
+    void enqueue(const QuickSave& save, const wad_header& header, wad_data *wad, int32 wad_length, SDL_Surface *preview);
+    
+    // blocks until every queued save is on disk
+    void wait();
+    
+    // reports finished saves; game thread only
+    void process();
+
+private:
+    struct Job {
+        QuickSave save;
+        wad_header header;
+        wad_data *wad;
+        int32 wad_length;
+        SDL_Surface *preview;
+        short error;
+    };
+    
+    QuickSaveWriter();
+    void finish(Job& job);
+    
+    std::queue<Job> m_pending;
+    std::vector<Job> m_finished;
+    bool m_busy;
+    
+    SDL_Thread *m_thread;
+    SDL_mutex *m_mutex;
+    SDL_cond *m_work_ready;
+    SDL_cond *m_work_done;
+    static int Run(void *);
 };
 
 class QuickSaveImageCache {
@@ -499,12 +561,13 @@ bool load_quick_save_dialog(FileSpecifier& saved_game)
 extern SDL_Surface *draw_surface;
 extern bool OGL_MapActive;
 
-static bool build_map_preview(std::ostringstream& ostream)
+// Render the overhead map on the game thread; encoding happens later
+static SDL_Surface *render_map_preview()
 {
     SDL_Rect r = {0, 0, RENDER_WIDTH, RENDER_HEIGHT};
     SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, r.w, r.h, 32, 0xff0000, 0x00ff00, 0x0000ff, 0);
     if (!surface)
-        return false;
+        return NULL;
 	
     SDL_FillRect(surface, &r, SDL_MapRGB(surface->format, 0, 0, 0));
 	
@@ -526,6 +589,11 @@ static bool build_map_preview(std::ostringstream& ostream)
     OGL_MapActive = old_OGL_MapActive;
     _restore_port();
 	
+    return surface;
+}
+
+static bool encode_map_preview(SDL_Surface *surface, std::ostringstream& ostream)
+{
     SDL_RWops *rwops = SDL_RWFromOStream(ostream);
 //#if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE)
 //    int ret = aoIMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
@@ -534,7 +602,6 @@ static bool build_map_preview(std::ostringstream& ostream)
 #else
     int ret = SDL_SaveBMP_RW(surface, rwops, false);
 #endif
-    SDL_FreeSurface(surface);
     SDL_RWclose(rwops);
 	
     return (ret == 0);
@@ -656,6 +723,122 @@ void create_updated_save(QuickSave& save)
 	}
 }
 
+QuickSaveWriter* QuickSaveWriter::instance() {
+    static QuickSaveWriter* m_instance = nullptr;
+    if (!m_instance) {
+        m_instance = new QuickSaveWriter;
+    }
+    
+    return m_instance;
+}
+
+QuickSaveWriter::QuickSaveWriter() : m_busy(false), m_thread(NULL)
+{
+    m_mutex = SDL_CreateMutex();
+    m_work_ready = SDL_CreateCond();
+    m_work_done = SDL_CreateCond();
+}
+
+void QuickSaveWriter::enqueue(const QuickSave& save, const wad_header& header, wad_data *wad, int32 wad_length, SDL_Surface *preview)
+{
+    Job job;
+    job.save = save;
+    job.header = header;
+    job.wad = wad;
+    job.wad_length = wad_length;
+    job.preview = preview;
+    job.error = 0;
+    
+    // start the worker with the first save
+    if (!m_thread)
+        m_thread = SDL_CreateThread(Run, "QuickSaveWriter_writeThread", this);
+    if (!m_thread)
+    {
+        // no worker; finish the save right here
+        finish(job);
+        m_finished.push_back(job);
+        process();
+        return;
+    }
+    
+    SDL_LockMutex(m_mutex);
+    m_pending.push(job);
+    SDL_CondSignal(m_work_ready);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void QuickSaveWriter::wait()
+{
+    SDL_LockMutex(m_mutex);
+    while (m_busy || !m_pending.empty())
+        SDL_CondWait(m_work_done, m_mutex);
+    SDL_UnlockMutex(m_mutex);
+}
+
+void QuickSaveWriter::process()
+{
+    std::vector<Job> finished;
+    SDL_LockMutex(m_mutex);
+    finished.swap(m_finished);
+    SDL_UnlockMutex(m_mutex);
+    
+    if (finished.empty())
+        return;
+    
+    bool any_saved = false;
+    for (std::vector<Job>::iterator it = finished.begin(); it != finished.end(); ++it)
+    {
+        if (it->error)
+            alert_user(infoError, strERRORS, fileError, it->error);
+        else
+            any_saved = true;
+    }
+    
+    if (any_saved)
+        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
+}
+
+void QuickSaveWriter::finish(Job& job)
+{
+    std::ostringstream image_stream;
+    if (job.preview)
+    {
+        encode_map_preview(job.preview, image_stream);
+        SDL_FreeSurface(job.preview);
+        job.preview = NULL;
+    }
+    
+    job.error = write_save_game_file(job.save.save_file, &job.header, job.wad, job.wad_length, build_save_metadata(job.save), image_stream.str());
+    free_wad(job.wad);
+    job.wad = NULL;
+}
+
+int QuickSaveWriter::Run(void *pv)
+{
+    QuickSaveWriter* writer = reinterpret_cast<QuickSaveWriter*>(pv);
+    
+    SDL_LockMutex(writer->m_mutex);
+    while (true)
+    {
+        while (writer->m_pending.empty())
+            SDL_CondWait(writer->m_work_ready, writer->m_mutex);
+        
+        Job job = writer->m_pending.front();
+        writer->m_pending.pop();
+        writer->m_busy = true;
+        SDL_UnlockMutex(writer->m_mutex);
+        
+        writer->finish(job);
+        
+        SDL_LockMutex(writer->m_mutex);
+        writer->m_finished.push_back(job);
+        writer->m_busy = false;
+        SDL_CondBroadcast(writer->m_work_done);
+    }
+    
+    return 0;
+}
+
 bool create_quick_save(void)
 {
     QuickSave save;
@@ -690,14 +873,30 @@ bool create_quick_save(void)
     save.save_file.FromDirectory(quicksave_dir);
     save.save_file.AddPart(base + ".sgaA");
 	
-    std::string metadata = build_save_metadata(save);
-    std::ostringstream image_stream;
-    bool success = build_map_preview(image_stream);
-    success = save_game_file(save.save_file, metadata, image_stream.str());
-    
-    if (success)
-        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
-    return success;
+    struct wad_header header;
+    int32 wad_length;
+    struct wad_data *wad = capture_save_game(save.save_file, &header, &wad_length);
+    if (!wad || error_pending())
+    {
+        short err = get_game_error(NULL);
+        if (wad) free_wad(wad);
+        alert_user(infoError, strERRORS, fileError, err);
+        clear_game_error();
+        return false;
+    }
+
+    QuickSaveWriter::instance()->enqueue(save, header, wad, wad_length, render_map_preview());
+    return true;
+}
+
+void wait_for_quick_saves(void)
+{
+    QuickSaveWriter::instance()->wait();
+}
+
+void process_quick_saves(void)
+{
+    QuickSaveWriter::instance()->process();
 }
 
 bool delete_quick_save(QuickSave& save)
@@ -713,49 +912,35 @@ bool delete_quick_save(QuickSave& save)
 	return save.save_file.Delete();
 }
 
-bool QuickSaveLoader::ParseQuickSave(FileSpecifier& file_name)
+// Runs on a worker thread; fills in save only if it has readable metadata.
+// Uses the raw tag reader, which leaves the game error and level memory alone
+bool QuickSaveLoader::ParseQuickSave(FileSpecifier& file_name, QuickSave& save)
 {
-	struct wad_header header;
-	struct wad_data *wad;
-
 	OpenedFile file;
-    if (file_name.Open(file))
-    {
-        if (read_wad_header(file, &header))
-		{
-			wad = read_indexed_wad_from_file(file, &header, SAVE_GAME_METADATA_INDEX, true);
-			if (wad)
-			{
-				size_t data_length;
-				char *raw_metadata = (char *)extract_type_from_wad(wad, SAVE_META_TAG, &data_length);
-				std::string metadata = std::string(raw_metadata, data_length);
-				
-				InfoTree pt;
-				std::istringstream strm(metadata);
-				try {
-					pt = InfoTree::load_ini(strm);
-				} catch (const InfoTree::ini_error& e) {
-					return false;
-				}
-				
-				QuickSave Data = QuickSave();
-				Data.save_file = file_name;
-				pt.read("name", Data.name);
-				pt.read("level_name", Data.level_name);
-				pt.read("ticks", Data.ticks);
-				pt.read("ticks_formatted", Data.formatted_ticks);
-				pt.read("time", Data.save_time);
-				pt.read("time_formatted", Data.formatted_time);
-				pt.read("players", Data.players);
-				QuickSaves::instance()->add(Data);
-				
-				free_wad(wad);
-			}
-		}
-		
-        return true;
-    }
-    return false;
+	std::vector<uint8> raw_metadata;
+	if (!file_name.Open(file) ||
+		!read_tag_from_wad_file(file, SAVE_GAME_METADATA_INDEX, SAVE_META_TAG, raw_metadata))
+		return false;
+	
+	InfoTree pt;
+	std::istringstream strm(std::string(raw_metadata.begin(), raw_metadata.end()));
+	try {
+		pt = InfoTree::load_ini(strm);
+	} catch (const InfoTree::ini_error& e) {
+		return false;
+	}
+	
+	QuickSave Data = QuickSave();
+	Data.save_file = file_name;
+	pt.read("name", Data.name);
+	pt.read("level_name", Data.level_name);
+	pt.read("ticks", Data.ticks);
+	pt.read("ticks_formatted", Data.formatted_ticks);
+	pt.read("time", Data.save_time);
+	pt.read("time_formatted", Data.formatted_time);
+	pt.read("players", Data.players);
+	save = Data;
+	return true;
 }
 
 bool QuickSaveLoader::ParseDirectory(FileSpecifier& dir)
@@ -764,12 +949,42 @@ bool QuickSaveLoader::ParseDirectory(FileSpecifier& dir)
     if (!dir.ReadDirectory(de))
         return false;
     
+    // saves that have gone away drop out of the cache here
+    std::unordered_map<std::string, CachedQuickSave> cache;
+    std::vector<FileSpecifier> changed_files;
+    std::vector<CachedQuickSave> changed;
     for (std::vector<dir_entry>::const_iterator it = de.begin(); it != de.end(); ++it) {
+        if (!algo::ends_with(it->name, ".sgaA"))
+            continue;
+        
+        // a save rewritten within the same second still changes size
         FileSpecifier file = dir + it->name;
-        if (algo::ends_with(it->name, ".sgaA"))
+        uintmax_t size = file.GetSize();
+        auto cached = m_cache.find(file.GetPath());
+        if (cached != m_cache.end() && cached->second.date == it->date &&
+            cached->second.size == size)
         {
-            ParseQuickSave(file);
+            cache.insert(*cached);
         }
+        else
+        {
+            changed_files.push_back(file);
+            changed.push_back({ it->date, size, false, QuickSave() });
+        }
+    }
+    
+    parallel_scan(changed_files.size(), [&](size_t i) {
+        changed[i].valid = ParseQuickSave(changed_files[i], changed[i].save);
+    });
+    
+    for (size_t i = 0; i < changed_files.size(); ++i)
+        cache[changed_files[i].GetPath()] = changed[i];
+    m_cache.swap(cache);
+    
+    for (const auto& it : m_cache)
+    {
+        if (it.second.valid)
+            QuickSaves::instance()->add(it.second.save);
     }
     
     return true;
@@ -787,6 +1002,7 @@ QuickSaves* QuickSaves::instance() {
 
 void QuickSaves::enumerate() {
     clear();
+    wait_for_quick_saves();
 	
     logContext("parsing quick saves");
     QuickSaveLoader loader;
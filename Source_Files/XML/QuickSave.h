@@ -64,6 +64,8 @@ private:
 };
 
 bool create_quick_save(void);
+void wait_for_quick_saves(void);
+void process_quick_saves(void);
 bool delete_quick_save(QuickSave& save);
 bool load_quick_save_dialog(FileSpecifier& saved_game);
 size_t saved_game_was_networked(FileSpecifier& saved_game);
@@ -57,6 +57,212 @@
 #include "XML_LevelScript.h"
 #include "InfoTree.h"
 
+#include <sstream>
+#include <unordered_map>
+
+// Parsed MML trees keyed by a hash of the MML source. Plugins and scenarios
+// reparse the same files at startup and on every level change; the cache
+// is also saved to disk, so the next launch skips the XML parser as well.
+// Each entry keeps its source too, so a hash collision is a miss rather than
+// the wrong tree.
+class MMLCache {
+public:
+	static MMLCache* instance();
+	
+	// throws InfoTree errors like InfoTree::load_xml()
+	InfoTree load(const std::string& source);
+	void save();
+
+private:
+	MMLCache() : m_loaded(false), m_dirty(false) { }
+	
+	struct Entry {
+		std::string source;
+		std::string tree;	// InfoTree::save_binary() form
+		bool used;
+	};
+	
+	static uint64 hash(const std::string& source);
+	static FileSpecifier cache_file();
+	void read();
+	
+	std::unordered_map<uint64, Entry> m_entries;
+	bool m_loaded;
+	bool m_dirty;
+	
+	static const uint32 k_magic = FOUR_CHARS_TO_INT('m', 'm', 'l', 'c');
+	static const uint32 k_version = 2;
+	// stale entries are kept only up to this total size
+	static const size_t k_unused_limit = 4 * 1024 * 1024;
+};
+
+MMLCache* MMLCache::instance()
+{
+	static MMLCache* m_instance = nullptr;
+	if (!m_instance) {
+		m_instance = new MMLCache;
+	}
+	
+	return m_instance;
+}
+
+// FNV-1a
+uint64 MMLCache::hash(const std::string& source)
+{
+	uint64 h = 14695981039346656037ULL;
+	for (unsigned char c : source)
+	{
+		h ^= c;
+		h *= 1099511628211ULL;
+	}
+	
+	// the version goes in too, so format changes miss instead of misparse
+	return h ^ k_version;
+}
+
+FileSpecifier MMLCache::cache_file()
+{
+	FileSpecifier file;
+	file.SetToLocalDataDir();
+	file.AddPart("MML Cache");
+	return file;
+}
+
+InfoTree MMLCache::load(const std::string& source)
+{
+	if (!m_loaded)
+		read();
+	
+	uint64 key = hash(source);
+	auto it = m_entries.find(key);
+	if (it != m_entries.end() && it->second.source == source)
+	{
+		try {
+			std::istringstream strm(it->second.tree);
+			InfoTree tree = InfoTree::load_binary(strm);
+			it->second.used = true;
+			return tree;
+		} catch (const std::exception&) {
+			// a damaged entry is parsed again from the XML below
+		}
+	}
+	
+	// only trees that parsed get cached
+	std::istringstream strm(source);
+	InfoTree tree = InfoTree::load_xml(strm);
+	
+	std::ostringstream bstrm;
+	tree.save_binary(bstrm);
+	Entry& entry = m_entries[key];
+	entry.source = source;
+	entry.tree = bstrm.str();
+	entry.used = true;
+	m_dirty = true;
+	
+	return tree;
+}
+
+// The whole cache comes in with one read; entries are decoded on use.
+// Sizes are checked against what is left of the file, so a truncated or
+// damaged cache only loses entries and never fails startup.
+void MMLCache::read()
+{
+	m_loaded = true;
+	
+	FileSpecifier file = cache_file();
+	OpenedFile ofile;
+	int32 length;
+	if (!file.Exists() || !file.Open(ofile) || !ofile.GetLength(length))
+		return;
+	
+	try {
+		std::string data(length, '\0');
+		if (length == 0 || !ofile.Read(length, &data[0]))
+			return;
+		ofile.Close();
+		
+		const char *p = data.data();
+		size_t remaining = data.size();
+		auto take = [&p, &remaining](void *dest, size_t size) {
+			if (size > remaining)
+				return false;
+			memcpy(dest, p, size);
+			p += size;
+			remaining -= size;
+			return true;
+		};
+		
+		uint32 header[2];
+		if (!take(header, sizeof(header)) || header[0] != k_magic || header[1] != k_version)
+			return;
+		
+		uint64 key;
+		uint32 sizes[2];
+		while (take(&key, sizeof(key)) && take(sizes, sizeof(sizes)))
+		{
+			if (sizes[0] > remaining || sizes[1] > remaining - sizes[0])
+				break;
+			
+			Entry entry;
+			entry.source.assign(p, sizes[0]);
+			entry.tree.assign(p + sizes[0], sizes[1]);
+			p += sizes[0] + sizes[1];
+			remaining -= sizes[0] + sizes[1];
+			entry.used = false;
+			m_entries[key] = std::move(entry);
+		}
+	} catch (const std::exception& e) {
+		logWarning("Ignoring unreadable MML cache %s: %s", file.GetPath(), e.what());
+		m_entries.clear();
+	}
+}
+
+// Machine-local, so stored in native byte order
+void MMLCache::save()
+{
+	if (!m_dirty)
+		return;
+	
+	std::ostringstream strm;
+	uint32 header[2] = { k_magic, k_version };
+	strm.write(reinterpret_cast<const char *>(header), sizeof(header));
+	
+	size_t unused_size = 0;
+	for (const auto& it : m_entries)
+	{
+		if (!it.second.used)
+		{
+			unused_size += it.second.source.size() + it.second.tree.size();
+			if (unused_size > k_unused_limit)
+				continue;
+		}
+		
+		uint32 sizes[2] = { static_cast<uint32>(it.second.source.size()), static_cast<uint32>(it.second.tree.size()) };
+		strm.write(reinterpret_cast<const char *>(&it.first), sizeof(it.first));
+		strm.write(reinterpret_cast<const char *>(sizes), sizeof(sizes));
+		strm.write(it.second.source.data(), sizes[0]);
+		strm.write(it.second.tree.data(), sizes[1]);
+	}
+	
+	std::string data = strm.str();
+	FileSpecifier file = cache_file();
+	OpenedFile ofile;
+	if (file.Open(ofile, true) || (file.Create(_typecode_unknown) && file.Open(ofile, true)))
+	{
+		if (ofile.Write(static_cast<int32>(data.size()), &data[0]) && ofile.SetLength(static_cast<int32>(data.size())))
+			m_dirty = false;
+		ofile.Close();
+	}
+	
+	if (m_dirty)
+		logWarning("Could not save MML cache to %s", file.GetPath());
+}
+
+void SaveMMLCache()
+{
+	MMLCache::instance()->save();
+}
+
 // This will reset all values changed by MML scripts which implement ResetValues() method
 // and are part of the master MarathonParser tree.
 void ResetAllMMLValues()
@@ -164,7 +370,18 @@ bool ParseMMLFromFile(const FileSpecifier& FileSpec)
 {
 	bool parse_error = false;
 	try {
-		InfoTree fileroot = InfoTree::load_xml(FileSpec);
+		FileSpecifier file = FileSpec;
+		OpenedFile ofile;
+		int32 length = 0;
+		if (!file.Open(ofile) || !ofile.GetLength(length))
+			throw InfoTree::unexpected_error(std::string("couldn't open '") + FileSpec.GetPath() + "' for reading (error " + std::to_string(file.GetError()) + ")");
+		
+		std::string source(length, '\0');
+		if (length && !ofile.Read(length, &source[0]))
+			throw InfoTree::unexpected_error(std::string("couldn't read '") + FileSpec.GetPath() + "'");
+		ofile.Close();
+		
+		InfoTree fileroot = MMLCache::instance()->load(source);
 		_ParseAllMML(fileroot);
 	} catch (const InfoTree::parse_error& ex) {
 		logError("Error parsing MML file (%s): %s", FileSpec.GetPath(), ex.what());
@@ -186,8 +403,7 @@ bool ParseMMLFromData(const char *buffer, size_t buflen)
 {
 	bool parse_error = false;
 	try {
-		std::istringstream strm(std::string(buffer, buflen));
-		InfoTree fileroot = InfoTree::load_xml(strm);
+		InfoTree fileroot = MMLCache::instance()->load(std::string(buffer, buflen));
 		_ParseAllMML(fileroot);
 	} catch (const InfoTree::parse_error& ex) {
 		logError("Error parsing MML data: %s", ex.what());
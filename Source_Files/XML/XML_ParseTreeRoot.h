@@ -36,4 +36,7 @@ class FileSpecifier;
 extern bool ParseMMLFromFile(const FileSpecifier& filespec);
 extern bool ParseMMLFromData(const char *buffer, size_t buflen);
 
+// write parsed trees out for the next launch
+extern void SaveMMLCache();
+
 #endif
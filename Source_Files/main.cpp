@@ -42,16 +42,27 @@ int main(int argc, char** argv)
 		// Initialize everything
 		initialize_application();
 
+		bool opened_document = false;
 		for (std::vector<std::string>::iterator it = shell_options.files.begin(); it != shell_options.files.end(); ++it)
 		{
 			if (handle_open_document(*it))
 			{
+				opened_document = true;
 				break;
 			}
 		}
 
-		// Run the main loop
-		main_event_loop();
+		if (!shell_options.export_movie.empty() && !opened_document)
+		{
+			logFatal("--export-movie requires a film to play");
+			fprintf(stderr, "--export-movie requires a film to play\n");
+			code = 1;
+		}
+		else
+		{
+			// Run the main loop
+			main_event_loop();
+		}
 
 	}
 	catch (std::exception& e) {
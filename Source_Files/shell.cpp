@@ -57,6 +57,7 @@
 #include "XML_ParseTreeRoot.h"
 #include "FileHandler.h"
 #include "Plugins.h"
+#include "QuickSave.h"
 #include "FilmProfile.h"
 
 #include "mytm.h"	// mytm_initialize(), for platform-specific shell_*.h
@@ -256,6 +257,10 @@ void initialize_application(void)
 	SDL_setenv("SDL_AUDIODRIVER", "directsound", 0);
 #endif
 
+	// Exporting a film needs no window; let it run on a headless box
+	if (!shell_options.export_movie.empty())
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+
 	// Initialize SDL
 	int retval = SDL_Init(SDL_INIT_VIDEO |
 						  (shell_options.nosound ? 0 : SDL_INIT_AUDIO) |
@@ -488,7 +493,9 @@ void initialize_application(void)
 
 void shutdown_application(void)
 {
+	wait_for_quick_saves();
 	WadImageCache::instance()->save_cache();
+	SaveMMLCache();
 	close_external_resources();
 
 	shutdown_dialogs();
@@ -680,14 +687,17 @@ void main_event_loop(void)
 		execute_timer_tasks(machine_tick_count());
 		idle_game_state(machine_tick_count());
 
+		// movie export runs as fast as frames can be encoded
 		if (game_state == _game_in_progress &&
-			get_fps_target() != 0)
+			get_fps_target() != 0 &&
+			!Movie::instance()->IsRecording())
 		{
 			int elapsed_machine_ticks = machine_tick_count() - cur_time;
 			int desired_elapsed_machine_ticks = MACHINE_TICKS_PER_SECOND / get_fps_target();
 
 			if (desired_elapsed_machine_ticks - elapsed_machine_ticks > desired_elapsed_machine_ticks / 3)
 			{
+				L_Idle_Collect_Garbage();
 				sleep_for_machine_ticks(1);
 			}
 		}
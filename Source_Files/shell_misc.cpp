@@ -45,6 +45,7 @@ bool chat_input_mode = false;
 #include "items.h"
 #include "TextStrings.h"
 #include "InfoTree.h"
+#include "QuickSave.h"
 
 #include <ctype.h>
 
@@ -298,6 +299,7 @@ void global_idle_proc(void)
 {
 	Music::instance()->Idle();
 	SoundManager::instance()->Idle();
+	process_quick_saves();
 }
 
 /*
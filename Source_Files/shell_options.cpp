@@ -120,7 +120,8 @@ static const std::vector<ShellOptionsFlag> shell_options_flags {
 
 static const std::vector<ShellOptionsString> shell_options_strings {
 	{"o", "output", "With -e, output to [file] and exit on quit", shell_options.output},
-	{"l", "replay-directory", "Directory with replays to load", shell_options.replay_directory}
+	{"l", "replay-directory", "Directory with replays to load", shell_options.replay_directory},
+	{"x", "export-movie", "Export the film given on the command line to [file] and quit; a .wav file gets only the audio, with mixer timings", shell_options.export_movie}
 };
 
 std::unordered_map<int, bool> ShellOptions::parse(int argc, char** argv, bool ignore_unknown_args)
@@ -24,6 +24,7 @@ struct ShellOptions {
 	bool editor;
 
 	std::string replay_directory;
+	std::string export_movie;
 
 	std::string directory;
 	std::vector<std::string> files;
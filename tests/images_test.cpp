@@ -0,0 +1,362 @@
+#include "cseries.h"
+#include "FileHandler.h"
+#include "images.h"
+#include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using SurfacePtr = std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>;
+
+// Big-endian writer for building PICT resources in memory
+class PictWriter {
+public:
+	void u8(uint8 value) { data.push_back(value); }
+	void be16(uint16 value) { u8(value >> 8); u8(value & 0xff); }
+	void be32(uint32 value) { be16(value >> 16); be16(value & 0xffff); }
+	void zeros(int count) { data.insert(data.end(), count, 0); }
+	void bytes(const std::vector<uint8>& values) { data.insert(data.end(), values.begin(), values.end()); }
+
+	std::vector<uint8> data;
+};
+
+// PackBits-encodes one scan line of unit_size-byte units, using repeat runs
+// wherever three or more units match and literal runs everywhere else
+static std::vector<uint8> pack_bits(const std::vector<uint8>& row, int unit_size)
+{
+	auto same = [&](int a, int b) {
+		return memcmp(&row[a * unit_size], &row[b * unit_size], unit_size) == 0;
+	};
+
+	std::vector<uint8> packed;
+	int units = static_cast<int>(row.size()) / unit_size;
+	int i = 0;
+	while (i < units) {
+		int run = 1;
+		while (i + run < units && run < 128 && same(i, i + run))
+			run++;
+
+		if (run >= 3) {
+			packed.push_back(static_cast<uint8>(1 - run));
+			packed.insert(packed.end(), row.begin() + i * unit_size, row.begin() + (i + 1) * unit_size);
+			i += run;
+		} else {
+			int start = i;
+			while (i < units && i - start < 128) {
+				if (i > start && i + 2 < units && same(i, i + 1) && same(i, i + 2))
+					break;
+				i++;
+			}
+			packed.push_back(static_cast<uint8>(i - start - 1));
+			packed.insert(packed.end(), row.begin() + start * unit_size, row.begin() + i * unit_size);
+		}
+	}
+	return packed;
+}
+
+// Writes a packed scan line with the byte count width the decoder expects
+static void write_packed_row(PictWriter& pict, const std::vector<uint8>& packed, int row_bytes)
+{
+	if (row_bytes > 250)
+		pict.be16(static_cast<uint16>(packed.size()));
+	else
+		pict.u8(static_cast<uint8>(packed.size()));
+	pict.bytes(packed);
+}
+
+// Writes the picture frame and the PixMap of a single CopyBits opcode
+static void begin_picture(PictWriter& pict, uint16 opcode, int width, int height, int row_bytes, int pack_type, int pixel_size)
+{
+	pict.be16(0);				// picSize
+	pict.be16(0);				// top
+	pict.be16(0);				// left
+	pict.be16(height);			// bottom
+	pict.be16(width);			// right
+
+	pict.be16(opcode);
+	if (opcode == 0x009a)
+		pict.be32(0);			// pmBaseAddr
+	pict.be16(row_bytes | 0x8000);
+	pict.be16(0);				// top
+	pict.be16(0);				// left
+	pict.be16(height);			// bottom
+	pict.be16(width);			// right
+	pict.be16(0);				// pmVersion
+	pict.be16(pack_type);
+	pict.zeros(14);				// packSize/hRes/vRes/pixelType
+	pict.be16(pixel_size);
+	pict.zeros(16);				// cmpCount/cmpSize/planeBytes/pmTable/pmReserved
+}
+
+// Writes the source/destination Rect and transfer mode, the packed rows and the end of the picture
+static void end_picture(PictWriter& pict, const std::vector<std::vector<uint8>>& rows, int row_bytes, int unit_size)
+{
+	pict.zeros(18);
+
+	size_t data_start = pict.data.size();
+	for (auto& row : rows)
+		write_packed_row(pict, pack_bits(row, unit_size), row_bytes);
+	if ((pict.data.size() - data_start) & 1)
+		pict.u8(0);
+
+	pict.be16(0x00ff);			// OpEndPic
+}
+
+static SurfacePtr load_picture(const std::vector<uint8>& pict)
+{
+	void* data = malloc(pict.size());
+	memcpy(data, pict.data(), pict.size());
+
+	LoadedResource rsrc;
+	rsrc.SetData(data, pict.size());
+	return picture_to_surface(rsrc);
+}
+
+static uint32 get_pixel(SDL_Surface* s, int x, int y)
+{
+	const uint8* p = static_cast<const uint8*>(s->pixels) + y * s->pitch + x * s->format->BytesPerPixel;
+	switch (s->format->BytesPerPixel) {
+		case 1:
+			return *p;
+		case 2:
+			return *reinterpret_cast<const uint16*>(p);
+		case 3:
+			return p[0] | (p[1] << 8) | (p[2] << 16);
+		default:
+			return *reinterpret_cast<const uint32*>(p);
+	}
+}
+
+static void set_pixel(SDL_Surface* s, int x, int y, uint32 value)
+{
+	uint8* p = static_cast<uint8*>(s->pixels) + y * s->pitch + x * s->format->BytesPerPixel;
+	switch (s->format->BytesPerPixel) {
+		case 1:
+			*p = value;
+			break;
+		case 2:
+			*reinterpret_cast<uint16*>(p) = value;
+			break;
+		case 3:
+			p[0] = value & 0xff;
+			p[1] = (value >> 8) & 0xff;
+			p[2] = (value >> 16) & 0xff;
+			break;
+		default:
+			*reinterpret_cast<uint32*>(p) = value;
+			break;
+	}
+}
+
+// Builds a surface whose pixels are all distinct enough that a misplaced copy shows up
+static SurfacePtr make_pattern_surface(int width, int height, int depth)
+{
+	SurfacePtr s(SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, depth, 0, 0, 0, 0), SDL_FreeSurface);
+	REQUIRE(s);
+
+	uint32 mask = depth == 32 ? 0xffffffff : (1u << depth) - 1;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			set_pixel(s.get(), x, y, ((x + 1) * 2654435761u ^ (y + 1) * 40503u) & mask);
+
+	if (s->format->palette) {
+		SDL_Color colors[256];
+		for (int i = 0; i < 256; i++)
+			colors[i] = { static_cast<uint8>(i), static_cast<uint8>(255 - i), static_cast<uint8>(i * 7), 0xff };
+		SDL_SetPaletteColors(s->format->palette, colors, 0, 256);
+	}
+
+	return s;
+}
+
+// Decodes an 8-bit indexed PICT and checks every pixel and palette entry
+static void check_indexed_picture(int width, int height)
+{
+	auto pixel = [](int x, int y) -> uint8 {
+		return (x / 37) % 2 ? (x * 13 + y) & 0xff : y * 5 + 1;
+	};
+
+	PictWriter pict;
+	int row_bytes = width;
+	begin_picture(pict, 0x0098, width, height, row_bytes, 0, 8);
+
+	pict.be32(0);				// ctSeed
+	pict.be16(0);				// flags
+	pict.be16(255);				// ctSize
+	for (int i = 0; i < 256; i++) {
+		pict.be16(255 - i);		// value, so entries are stored out of order
+		pict.be16(i << 8);
+		pict.be16((255 - i) << 8);
+		pict.be16(((i * 3) & 0xff) << 8);
+	}
+
+	std::vector<std::vector<uint8>> rows(height, std::vector<uint8>(row_bytes));
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			rows[y][x] = pixel(x, y);
+	end_picture(pict, rows, row_bytes, 1);
+
+	auto s = load_picture(pict.data);
+	REQUIRE(s);
+	REQUIRE(s->w == width);
+	REQUIRE(s->h == height);
+	REQUIRE(s->format->BytesPerPixel == 1);
+
+	for (int y = 0; y < height; y++) {
+		INFO("row " << y);
+		CHECK(memcmp(static_cast<uint8*>(s->pixels) + y * s->pitch, rows[y].data(), width) == 0);
+	}
+
+	for (int i = 0; i < 256; i++) {
+		INFO("color " << i);
+		const SDL_Color& color = s->format->palette->colors[255 - i];
+		CHECK(color.r == i);
+		CHECK(color.g == 255 - i);
+		CHECK(color.b == ((i * 3) & 0xff));
+	}
+}
+
+TEST_CASE("8-bit PICT with one-byte row counts decodes exactly", "[Images]")
+{
+	check_indexed_picture(120, 5);
+}
+
+TEST_CASE("8-bit PICT with two-byte row counts decodes exactly", "[Images]")
+{
+	check_indexed_picture(300, 4);
+}
+
+TEST_CASE("16-bit PICT packed by 16-bit chunks decodes exactly", "[Images]")
+{
+	const int width = 150, height = 4, row_bytes = width * 2;
+	auto pixel = [](int x, int y) -> uint16 {
+		return (x / 5) % 2 ? 0x7c00 | y : (x * 0x0421 + y) & 0x7fff;
+	};
+
+	PictWriter pict;
+	begin_picture(pict, 0x009a, width, height, row_bytes, 3, 16);
+
+	std::vector<std::vector<uint8>> rows(height, std::vector<uint8>(row_bytes));
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			rows[y][x * 2] = pixel(x, y) >> 8;
+			rows[y][x * 2 + 1] = pixel(x, y) & 0xff;
+		}
+	}
+	end_picture(pict, rows, row_bytes, 2);
+
+	auto s = load_picture(pict.data);
+	REQUIRE(s);
+	REQUIRE(s->w == width);
+	REQUIRE(s->h == height);
+	REQUIRE(s->format->BytesPerPixel == 2);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			INFO("pixel " << x << ", " << y);
+			CHECK(get_pixel(s.get(), x, y) == pixel(x, y));
+		}
+	}
+}
+
+TEST_CASE("32-bit PICT packed by component decodes exactly", "[Images]")
+{
+	const int width = 70, height = 3, row_bytes = width * 4;
+	auto red = [](int x, int y) -> uint8 { return x < 20 ? 0xc0 : x * 3 + y; };
+	auto green = [](int x, int y) -> uint8 { return (x / 4) % 2 ? 0x11 * y : x ^ 0x5a; };
+	auto blue = [](int x, int y) -> uint8 { return x > 50 ? 0x0f : 255 - x - y; };
+
+	PictWriter pict;
+	begin_picture(pict, 0x009a, width, height, row_bytes, 4, 32);
+
+	// Each scan line holds all the red bytes, then all the green, then all the blue
+	std::vector<std::vector<uint8>> rows(height, std::vector<uint8>(width * 3));
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			rows[y][x] = red(x, y);
+			rows[y][width + x] = green(x, y);
+			rows[y][width * 2 + x] = blue(x, y);
+		}
+	}
+	end_picture(pict, rows, row_bytes, 1);
+
+	auto s = load_picture(pict.data);
+	REQUIRE(s);
+	REQUIRE(s->w == width);
+	REQUIRE(s->h == height);
+	REQUIRE(s->format->BytesPerPixel == 4);
+
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			INFO("pixel " << x << ", " << y);
+			uint32 expected = (red(x, y) << 16) | (green(x, y) << 8) | blue(x, y);
+			CHECK((get_pixel(s.get(), x, y) & 0x00ffffff) == expected);
+		}
+	}
+}
+
+// Nearest-neighbour reference: destination (x, y) samples the source at the
+// 16.16 fixed-point step rounded down, as the original per-pixel loop did
+static void check_rescale(int depth, int src_width, int src_height, int width, int height)
+{
+	INFO("depth " << depth << ", " << src_width << "x" << src_height << " to " << width << "x" << height);
+	auto src = make_pattern_surface(src_width, src_height, depth);
+	SurfacePtr dst(rescale_surface(src.get(), width, height), SDL_FreeSurface);
+	REQUIRE(dst);
+	REQUIRE(dst->w == width);
+	REQUIRE(dst->h == height);
+	REQUIRE(dst->format->BitsPerPixel == depth);
+
+	uint32 dx = (src_width << 16) / width;
+	uint32 dy = (src_height << 16) / height;
+	int mismatches = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			if (get_pixel(dst.get(), x, y) != get_pixel(src.get(), (x * dx) >> 16, (y * dy) >> 16))
+				mismatches++;
+	CHECK(mismatches == 0);
+
+	if (src->format->palette)
+		CHECK(memcmp(dst->format->palette->colors, src->format->palette->colors, sizeof(SDL_Color) * 256) == 0);
+}
+
+TEST_CASE("Rescaled surfaces match nearest-neighbour sampling", "[Images]")
+{
+	for (int depth : { 8, 16, 32 }) {
+		check_rescale(depth, 13, 7, 40, 23);
+		check_rescale(depth, 13, 7, 5, 3);
+		check_rescale(depth, 64, 48, 640, 480);
+		check_rescale(depth, 9, 9, 9, 9);
+	}
+}
+
+static void check_tile(int depth, int src_width, int src_height, int width, int height)
+{
+	INFO("depth " << depth << ", " << src_width << "x" << src_height << " to " << width << "x" << height);
+	auto src = make_pattern_surface(src_width, src_height, depth);
+	SurfacePtr dst(tile_surface(src.get(), width, height), SDL_FreeSurface);
+	REQUIRE(dst);
+	REQUIRE(dst->w == width);
+	REQUIRE(dst->h == height);
+	REQUIRE(dst->format->BitsPerPixel == depth);
+
+	int mismatches = 0;
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			if (get_pixel(dst.get(), x, y) != get_pixel(src.get(), x % src_width, y % src_height))
+				mismatches++;
+	CHECK(mismatches == 0);
+
+	if (src->format->palette)
+		CHECK(memcmp(dst->format->palette->colors, src->format->palette->colors, sizeof(SDL_Color) * 256) == 0);
+}
+
+TEST_CASE("Tiled surfaces repeat the source exactly", "[Images]")
+{
+	for (int depth : { 8, 16, 24, 32 }) {
+		check_tile(depth, 5, 3, 12, 7);
+		check_tile(depth, 5, 3, 3, 2);
+		check_tile(depth, 16, 16, 640, 480);
+		check_tile(depth, 1, 1, 4, 4);
+	}
+}
@@ -3,9 +3,23 @@
 #include "FileHandler.h"
 #include "shell_options.h"
 #include "interface.h"
+#include "map.h"
+#include "player.h"
+#include "OverheadMapRenderer.h"
+#include "interpolated_world.h"
+#include "ephemera.h"
+#include "dynamic_limits.h"
+#include "preferences.h"
+#include "render.h"
+#include "media.h"
+#include "platforms.h"
 #include <catch2/catch_test_macros.hpp>
+#include <cstdlib>
+#include <functional>
 
 extern ShellOptions shell_options;
+extern void execute_timer_tasks(uint32 time);
+extern std::vector<int16_t> polygon_ephemera;
 
 using Replay = std::pair<std::string, uint16_t>; //replay file path and seed
 
@@ -17,6 +31,16 @@ static uint16_t get_seed_from_filename(const std::string& file_name) {
 	return stoi(name_without_ext.substr(seed_position + 1));
 }
 
+// The application can only be brought up once per process, so the test cases share it
+static void require_application() {
+	static bool initialized = false;
+	if (!initialized) {
+		initialize_application();
+		std::atexit(shutdown_application);
+		initialized = true;
+	}
+}
+
 #ifndef REPLAY_SET_SEED_FILENAME //enable and run this to set the correct file name with seed on new replay files
 
 static std::vector<Replay> get_replays(std::string& directory_path) {
@@ -55,7 +79,7 @@ TEST_CASE("Film replay", "[Replay]") {
 
 	const auto replays = get_replays(shell_options.replay_directory);
 
-	initialize_application();
+	require_application();
 
 	for (const auto& replay : replays) {
 		INFO(replay.first);
@@ -65,8 +89,328 @@ TEST_CASE("Film replay", "[Replay]") {
 		auto seed = get_random_seed();
 		CHECK(seed == replay.second);
 	}
+}
 
-	shutdown_application();
+// Plays the opened film the way main_event_loop() does, calling each_pass after every pass
+static void play_film(const std::function<void()>& each_pass) {
+	while (get_game_state() != _quit_game) {
+		global_idle_proc();
+		execute_timer_tasks(machine_tick_count());
+		idle_game_state(machine_tick_count());
+		each_pass();
+	}
+}
+
+// Records the overhead map's polygons and lines instead of drawing them; each
+// primitive is its vertex indexes followed by its color index
+class RecordingOverheadMap : public OverheadMapClass {
+public:
+	std::vector<std::vector<short>> polygons;
+	std::vector<std::vector<short>> lines;
+
+	void record(overhead_map_data& control) {
+		polygons.clear();
+		lines.clear();
+		Render(control);
+	}
+
+protected:
+	void draw_polygon(short vertex_count, short* vertices, rgb_color& color) override {
+		std::vector<short> polygon(vertices, vertices + vertex_count);
+		polygon.push_back(color.red);
+		polygons.push_back(polygon);
+	}
+
+	void draw_line(short* vertices, rgb_color& color, short pen_size) override {
+		lines.push_back({ vertices[0], vertices[1], static_cast<short>(color.red) });
+	}
+};
+
+// The overhead map as it was drawn before geometry was retained: every
+// polygon and line classified from scratch on each frame, in the same
+// primitive format as RecordingOverheadMap
+struct ReferenceOverheadMap {
+	std::vector<std::vector<short>> polygons;
+	std::vector<std::vector<short>> lines;
+
+	void record(const overhead_map_data& control) {
+		polygons.clear();
+		lines.clear();
+
+		/* a polygon is visible if any of its endpoints are */
+		std::vector<bool> endpoint_on_screen(dynamic_world->endpoint_count);
+		for (short i = 0; i < dynamic_world->endpoint_count; ++i) {
+			endpoint_data* endpoint = get_endpoint_data(i);
+			short x = control.left + control.half_width + ((endpoint->vertex.x - control.origin.x) >> (8 - control.scale));
+			short y = control.top + control.half_height + ((endpoint->vertex.y - control.origin.y) >> (8 - control.scale));
+			endpoint_on_screen[i] = x >= control.left && y >= control.top &&
+				y <= control.top + control.height && x <= control.left + control.width;
+		}
+
+		std::vector<bool> polygon_on_screen(dynamic_world->polygon_count);
+		for (short i = 0; i < dynamic_world->polygon_count; ++i) {
+			polygon_data* polygon = get_polygon_data(i);
+			for (short j = 0; j < polygon->vertex_count; ++j)
+				if (endpoint_on_screen[polygon->endpoint_indexes[j]])
+					polygon_on_screen[i] = true;
+		}
+
+		for (short i = 0; i < dynamic_world->polygon_count; ++i) {
+			polygon_data* polygon = get_polygon_data(i);
+			if (!POLYGON_IS_IN_AUTOMAP(i) || !polygon_on_screen[i] ||
+				(polygon->floor_transfer_mode == _xfer_landscape && polygon->ceiling_transfer_mode == _xfer_landscape) ||
+				POLYGON_IS_DETACHED(polygon))
+				continue;
+
+			short color;
+			switch (polygon->type) {
+				case _polygon_is_platform:
+					color = PLATFORM_IS_SECRET(get_platform_data(polygon->permutation)) ?
+						_polygon_color : _polygon_platform_color;
+					if (PLATFORM_IS_FLOODED(get_platform_data(polygon->permutation))) {
+						short adj_index = find_flooding_polygon(i);
+						if (adj_index != NONE) {
+							switch (get_polygon_data(adj_index)->type) {
+								case _polygon_is_minor_ouch: color = _polygon_minor_ouch_color; break;
+								case _polygon_is_major_ouch: color = _polygon_major_ouch_color; break;
+							}
+						}
+					}
+					break;
+				case _polygon_is_minor_ouch: color = _polygon_minor_ouch_color; break;
+				case _polygon_is_major_ouch: color = _polygon_major_ouch_color; break;
+				case _polygon_is_teleporter: color = _polygon_teleporter_color; break;
+				case _polygon_is_hill: color = _polygon_hill_color; break;
+				default: color = _polygon_color; break;
+			}
+
+			if (polygon->media_index != NONE) {
+				media_data* media = get_media_data(polygon->media_index);
+				if (media && media->height >= polygon->floor_height) {
+					switch (media->type) {
+						case _media_water: color = _polygon_water_color; break;
+						case _media_lava: color = _polygon_lava_color; break;
+						case _media_goo: color = _polygon_goo_color; break;
+						case _media_sewage: color = _polygon_sewage_color; break;
+						case _media_jjaro: color = _polygon_jjaro_color; break;
+					}
+				}
+			}
+
+			std::vector<short> primitive(polygon->endpoint_indexes, polygon->endpoint_indexes + polygon->vertex_count);
+			primitive.push_back(color);
+			polygons.push_back(primitive);
+		}
+
+		for (short i = 0; i < dynamic_world->line_count; ++i) {
+			line_data* line = get_line_data(i);
+			if (!LINE_IS_IN_AUTOMAP(i))
+				continue;
+			if (!(line->clockwise_polygon_owner != NONE && polygon_on_screen[line->clockwise_polygon_owner]) &&
+				!(line->counterclockwise_polygon_owner != NONE && polygon_on_screen[line->counterclockwise_polygon_owner]))
+				continue;
+
+			polygon_data* clockwise_polygon = line->clockwise_polygon_owner == NONE ? NULL : get_polygon_data(line->clockwise_polygon_owner);
+			polygon_data* counterclockwise_polygon = line->counterclockwise_polygon_owner == NONE ? NULL : get_polygon_data(line->counterclockwise_polygon_owner);
+
+			short color = NONE;
+			if (LINE_IS_SOLID(line) || LINE_IS_VARIABLE_ELEVATION(line)) {
+				if (LINE_IS_LANDSCAPED(line)) {
+					if ((!clockwise_polygon || clockwise_polygon->floor_transfer_mode != _xfer_landscape) &&
+						(!counterclockwise_polygon || counterclockwise_polygon->floor_transfer_mode != _xfer_landscape))
+						color = _elevation_line_color;
+				}
+				else {
+					color = _solid_line_color;
+				}
+			}
+			else if (clockwise_polygon->floor_height != counterclockwise_polygon->floor_height) {
+				color = LINE_IS_LANDSCAPED(line) ? NONE : static_cast<short>(_elevation_line_color);
+			}
+
+			if (color != NONE)
+				lines.push_back({ line->endpoint_indexes[0], line->endpoint_indexes[1], color });
+		}
+	}
+};
+
+TEST_CASE("Overhead map retained geometry matches per-frame classification", "[Replay][OverheadMap]") {
+
+	REQUIRE(!shell_options.directory.empty());
+	REQUIRE(!shell_options.replay_directory.empty());
+
+	const auto replays = get_replays(shell_options.replay_directory);
+
+	require_application();
+
+	// colors carry the classification, so a stale color shows up as a mismatch
+	static OvhdMap_CfgDataStruct config;
+	for (int i = 0; i < NUMBER_OF_POLYGON_COLORS; i++)
+		config.polygon_colors[i].red = i;
+	for (int i = 0; i < NUMBER_OF_LINE_DEFINITIONS; i++)
+		config.line_definitions[i].color.red = i;
+
+	for (const auto& replay : replays) {
+		INFO(replay.first);
+		REQUIRE(handle_open_document(replay.first));
+		set_replay_speed(INT16_MAX);
+
+		// kept across the whole film, as the game's renderer is
+		RecordingOverheadMap retained;
+		retained.ConfigPtr = &config;
+
+		int32 first_mismatch_tick = NONE;
+		play_film([&]() {
+			if (first_mismatch_tick != NONE || get_game_state() != _game_in_progress || !current_player)
+				return;
+
+			overhead_map_data control;
+			control.mode = _rendering_game_map;
+			control.scale = OVERHEAD_MAP_MINIMUM_SCALE;
+			control.origin.x = current_player->location.x;
+			control.origin.y = current_player->location.y;
+			control.origin_polygon_index = current_player->supporting_polygon_index;
+			control.width = 640;
+			control.height = 480;
+			control.half_width = control.width / 2;
+			control.half_height = control.height / 2;
+			control.top = control.left = 0;
+			control.draw_everything = false;
+
+			// a fresh renderer must agree too, not just the long-lived one
+			RecordingOverheadMap rebuilt;
+			rebuilt.ConfigPtr = &config;
+
+			ReferenceOverheadMap reference;
+
+			// as render_view() does before the map is drawn each frame
+			objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
+			retained.record(control);
+			objlist_clear(render_flags, RENDER_FLAGS_BUFFER_SIZE);
+			rebuilt.record(control);
+			reference.record(control);
+
+			if (retained.polygons != reference.polygons || retained.lines != reference.lines ||
+				rebuilt.polygons != reference.polygons || rebuilt.lines != reference.lines)
+				first_mismatch_tick = dynamic_world->tick_count;
+		});
+
+		CHECK(first_mismatch_tick == NONE);
+	}
+}
+
+
+// The parts of the world update_interpolated_world() writes to, so one frame
+// can be interpolated more than once from the same starting point
+struct InterpolatedWorldCopy {
+	std::vector<object_data> objects;
+	std::vector<polygon_data> polygons;
+	std::vector<side_data> sides;
+	std::vector<line_data> lines;
+	std::vector<object_data> ephemera;
+	std::vector<int16_t> polygon_ephemera;
+
+	void save() {
+		objects = ObjectList;
+		polygons = PolygonList;
+		sides = SideList;
+		lines = LineList;
+		ephemera.clear();
+		for (int i = 0; i < get_dynamic_limit(_dynamic_limit_ephemera); i++)
+			ephemera.push_back(*get_ephemera_data(i));
+		polygon_ephemera = ::polygon_ephemera;
+	}
+
+	void restore() const {
+		ObjectList = objects;
+		PolygonList = polygons;
+		SideList = sides;
+		LineList = lines;
+		for (int i = 0; i < static_cast<int>(ephemera.size()); i++)
+			*get_ephemera_data(i) = ephemera[i];
+		::polygon_ephemera = polygon_ephemera;
+	}
+};
+
+// Every field update_interpolated_world() may change, in a fixed order
+static std::vector<int32> interpolated_fields() {
+	std::vector<int32> fields;
+	auto add_object = [&](const object_data& object) {
+		fields.insert(fields.end(), { object.location.x, object.location.y, object.location.z, object.polygon, object.next_object });
+	};
+
+	for (const auto& object : ObjectList)
+		add_object(object);
+	for (const auto& polygon : PolygonList)
+		fields.insert(fields.end(), { polygon.floor_height, polygon.ceiling_height, polygon.first_object });
+	for (const auto& side : SideList)
+		fields.push_back(side.primary_texture.y0);
+	for (const auto& line : LineList)
+		fields.insert(fields.end(), { line.highest_adjacent_floor, line.lowest_adjacent_ceiling });
+	for (int i = 0; i < get_dynamic_limit(_dynamic_limit_ephemera); i++)
+		add_object(*get_ephemera_data(i));
+	fields.insert(fields.end(), polygon_ephemera.begin(), polygon_ephemera.end());
+
+	return fields;
+}
+
+TEST_CASE("Interpolating only what moved matches interpolating everything", "[Replay][Interpolation]") {
+
+	REQUIRE(!shell_options.directory.empty());
+	REQUIRE(!shell_options.replay_directory.empty());
+
+	const auto replays = get_replays(shell_options.replay_directory);
+
+	require_application();
+
+	// the world is only interpolated above 30 fps
+	auto fps_target = graphics_preferences->fps_target;
+	graphics_preferences->fps_target = 60;
+
+	for (const auto& replay : replays) {
+		INFO(replay.first);
+		REQUIRE(handle_open_document(replay.first));
+		set_replay_speed(INT16_MAX);
+
+		int32 first_mismatch_tick = NONE;
+		int32 last_checked_tick = NONE;
+		play_film([&]() {
+			if (first_mismatch_tick != NONE || get_game_state() != _game_in_progress || dynamic_world->tick_count == last_checked_tick)
+				return;
+			last_checked_tick = dynamic_world->tick_count;
+
+			// everything visible, so no entity is skipped for being off screen
+			std::vector<uint16> saved_render_flags = RenderFlagList;
+			for (int i = 0; i < dynamic_world->polygon_count; i++)
+				SET_RENDER_FLAG(i, _polygon_is_visible);
+
+			InterpolatedWorldCopy start;
+			start.save();
+
+			for (float heartbeat_fraction : { 0.25f, 0.5f, 0.75f, 1.f }) {
+				start.restore();
+				update_interpolated_world(heartbeat_fraction);
+				auto moving_only = interpolated_fields();
+
+				start.restore();
+				set_interpolate_every_entity(true);
+				update_interpolated_world(heartbeat_fraction);
+				set_interpolate_every_entity(false);
+
+				if (interpolated_fields() != moving_only) {
+					first_mismatch_tick = dynamic_world->tick_count;
+					break;
+				}
+			}
+
+			start.restore();
+			RenderFlagList = saved_render_flags;
+		});
+
+		CHECK(first_mismatch_tick == NONE);
+	}
+
+	graphics_preferences->fps_target = fps_target;
 }
 
 #else
@@ -111,7 +455,7 @@ TEST_CASE("Film replay set seed", "[Replay]") {
 
 	const auto replays = get_replays(shell_options.replay_directory);
 
-	initialize_application();
+	require_application();
 
 	for (const auto& replay : replays) {
 		INFO(replay);
@@ -129,8 +473,6 @@ TEST_CASE("Film replay set seed", "[Replay]") {
 		new_file.AddPart(name_with_seed);
 		REQUIRE(file.Rename(new_file));
 	}
-
-	shutdown_application();
 }
 
 #endif
\ No newline at end of file